@@ -90,7 +90,8 @@ o2_context->path_tree - a dictionary mapping service names to a
     to a services_entry that contains one remote_service_entry.
 
 o2_context->full_path_table is a dictionary for full paths, permitting a single hash 
-    table lookup for addresses of the form !synth/lfo/freq. In practice
+    table lookup for addresses of the form !synth/lfo/freq, and also for
+    /synth/lfo/freq when the address has no pattern characters. In practice
     an additional lookup of just the service name is required to 
     determine if the service is local and if there is a single handler
     for all messages to that service.
@@ -125,11 +126,14 @@ o2_context->fds_info is a parallel dynamic array of pointers to process info
 Sockets
 -------
 
-o2_context->fds_info has state to receive messages. Since reads may not
-read the entire message, we collect incoming bytes into in_length for
-the length count, and then in_message for the data. When a message is
-completely received, there is a handler function that is called to 
-process the message.
+o2_context->fds_info has state to receive messages. Each read from a TCP
+socket takes as many bytes as are available into in_buffer, and every
+complete length-prefixed message is copied out and delivered, so one
+read can deliver many messages. A partial message stays in in_buffer
+until the next read, except that a message too big for in_buffer gets
+its own in_message, and the rest of its data is read directly into it.
+When a message is completely received, there is a handler function that
+is called to process the message.
     For outgoing O2 messages, we have an associated process to tell
 where to send.
     For incoming O2 messages, no extra info is needed; just deliver 
@@ -144,7 +148,38 @@ to send a sequence of messages. Users, on the other hand, are
 allowed to have at most one pending message. After that, an attempt 
 to send will block until the pending message is sent. Then, the new
 message becomes pending. Users can detect the possibility of blocking
-by calling o2_can_send(service).
+by calling o2_can_send(service). Whenever a socket is writable, all of
+its queued messages (up to O2N_SEND_IOV at a time) are written with one
+sendmsg() call. If o2_tcp_deferred_send(TRUE) was called, new messages
+are only queued, and the connection is added to o2_context->tcp_flush;
+at the end of o2_poll() (and before o2_poll_wait() waits),
+o2n_tcp_flush() writes each queue, so a burst of small messages becomes
+a few large writes.
+    On Linux, if O2 is built with USE_IO_URING, sockets are not
+polled. Each socket has a multishot accept or receive request in an
+io_uring, and o2n_recv() processes completions, which carry data in
+buffers provided to the kernel. o2n_tcp_flush() submits the writes for
+all connections in o2_context->tcp_flush with one system call. Messages
+are delivered in the same order and with the same handlers as with
+poll(). If io_uring is not available at run time, O2 uses epoll() or
+poll() instead.
+    On Linux, each process also has an AF_UNIX stream server socket and
+an AF_UNIX datagram socket, named (in the abstract namespace) after its
+TCP server port. When a discovered process has our IP address or
+127.0.0.1, o2n_connect() tries the AF_UNIX server first and falls back
+to TCP. Once the remote process name (and so its TCP port) is known,
+UDP messages to it are sent to its AF_UNIX datagram socket. Nothing
+else changes: the connection has the same tags and life-cycle as TCP.
+    After an AF_UNIX connection is made, the client offers the server a
+shared memory segment (a memfd) with a ring for each direction. The
+segment and an eventfd "doorbell" are passed over the socket with
+!_o2/sh messages (see o2_net.c). Once both sides agree, o2n_send()
+copies the same bytes it would have written to the socket into the
+ring, UDP messages go there too, and o2n_recv() reads every ring on
+each call. A writer rings the reader's doorbell only if the reader
+said it is going to sleep in o2n_wait(), so processes that poll make
+no system calls to exchange messages. Shared memory is not used with
+io_uring, which cannot receive the descriptors.
 
 
 Discovery
@@ -506,6 +541,7 @@ to host byte order if necessary.
 #include "o2_send.h"
 #include "o2_sched.h"
 #include "o2_clock.h"
+#include "o2_pattern.h"
 
 #ifndef WIN32
 #include <sys/time.h>
@@ -612,6 +648,7 @@ void o2_context_init(o2_context_ptr context)
     o2_context = context;
     o2_context->hub[0] = 0; // set default condition, empty string
     o2_argv_initialize();
+    o2_pattern_cache_initialize();
     o2_node_initialize(&o2_context->full_path_table, NULL);
     
 }
@@ -660,6 +697,8 @@ int o2_initialize(const char *ensemble_name)
     o2_method_new("/_o2/dy", "ssiii", &o2_discovery_handler, 
                   NULL, FALSE, FALSE);
     o2_method_new("/_o2/hub", "", &o2_hub_handler, NULL, FALSE, FALSE);
+    o2_method_new("/_o2/bo", "s", &o2_byte_order_handler, NULL, FALSE, TRUE);
+    o2_method_new("/_o2/sh", "i", &o2_shm_handler, NULL, FALSE, TRUE);
     o2_method_new("/_o2/sv", NULL, &o2_services_handler, NULL, FALSE, FALSE);
     o2_method_new("/_o2/cs/cs", "", &o2_clocksynced_handler, NULL, FALSE, FALSE);
     o2_method_new("/_o2/ds", NULL, &o2_discovery_send_handler,
@@ -905,9 +944,11 @@ int o2_service_provider_new(o2string service_name, const char *properties,
         o2string our_ip_port = process->proc.name;
         // find the top entry
         o2_node_ptr top_entry = GET_SERVICE(ss->services, 0);
-        o2string top_ip_port = (top_entry->tag == INFO_TCP_SERVER ?
-                                o2_context->info->proc.name :
-                                ((o2n_info_ptr) top_entry)->proc.name);
+        // only remote processes have a proc.name; anything else (local
+        // handlers, OSC delegates, bridges, ...) is provided by us
+        o2string top_ip_port = (TAG_IS_REMOTE(top_entry->tag) ?
+                                ((o2n_info_ptr) top_entry)->proc.name :
+                                o2_context->info->proc.name);
         if (strcmp(our_ip_port, top_ip_port) > 0) {
             // move top entry from location 0 to end of array at index
             DA_SET(ss->services, o2_node_ptr, index, top_entry);
@@ -916,6 +957,7 @@ int o2_service_provider_new(o2string service_name, const char *properties,
     }
     // index is now indexing the first or last of services
     DA_SET(ss->services, o2_node_ptr, index, service);
+    o2_services_generation++;
     // special case for osc: need service name
     if (service->tag == NODE_OSC_REMOTE_SERVICE) {
         ((osc_info_ptr) service)->service_name = ss->key;
@@ -1034,24 +1076,65 @@ int o2_poll()
     o2_sched_poll(); // deal with the timestamped message
     o2n_recv(); // receive and dispatch messages
     o2_deliver_pending();
+    if (o2_context && o2_context->tcp_flush.length) {
+        o2n_tcp_flush(); // send TCP messages deferred by handlers
+    }
+    if (o2_context && o2_context->udp_batch.length) {
+        o2n_udp_flush(); // send UDP messages batched by handlers
+    }
     return O2_SUCCESS;
 }
 
 
-int o2_stop_flag = FALSE;
+// shorten timeout (negative means none) so that we wake up at when,
+// which is measured in the same units as now (when < 0 means no deadline)
+static o2_time earlier_timeout(o2_time timeout, o2_time when, o2_time now)
+{
+    if (when < 0) return timeout;
+    o2_time wait = when - now;
+    if (wait < 0) wait = 0;
+    return (timeout < 0 || wait < timeout) ? wait : timeout;
+}
 
-#ifdef WIN32
-#define usleep(x) Sleep((x)/1000)
-#endif
+
+int o2_poll_wait(o2_time max_timeout)
+{
+    if (!o2_ensemble_name) {
+        return O2_NOT_INITIALIZED;
+    }
+    // messages sent since the last o2_poll() must not wait for a wakeup
+    if (o2_context->tcp_flush.length) {
+        o2n_tcp_flush();
+    }
+    if (o2_context->udp_batch.length) {
+        o2n_udp_flush();
+    }
+    // wake up no later than the next scheduled message on either scheduler
+    o2_time now = o2_local_time();
+    o2_time timeout = earlier_timeout(max_timeout,
+                                      o2_sched_earliest(&o2_ltsched), now);
+    if (o2_gtsched_started) {
+        timeout = earlier_timeout(timeout, o2_sched_earliest(&o2_gtsched),
+                                  o2_local_to_global(now));
+    }
+    if (timeout != 0) {
+        o2n_wait(timeout);
+    }
+    return o2_poll();
+}
+
+
+int o2_stop_flag = FALSE;
 
 int o2_run(int rate)
 {
     if (rate <= 0) rate = 1000; // poll about every ms
-    int sleep_usec = 1000000 / rate;
+    // poll at least rate times per second, and sooner for I/O or
+    // scheduled messages
+    o2_time max_timeout = 1.0 / rate;
     o2_stop_flag = FALSE;
     while (!o2_stop_flag) {
-        o2_poll();
-        usleep(sleep_usec);
+        o2_poll_wait(max_timeout);
     }
     return O2_SUCCESS;
 }
@@ -1115,8 +1198,12 @@ int o2_status(const char *service)
 }
 
 
-int o2_can_send(const char *service)
+// find the TCP connection used to send to service; sets *info to NULL
+// if service does not send via TCP. Returns O2_SUCCESS or an error code.
+//
+static int service_tcp_info(const char *service, o2n_info_ptr *info)
 {
+    *info = NULL;
     if (!o2_ensemble_name) {
         return O2_NOT_INITIALIZED;
     }
@@ -1128,18 +1215,40 @@ int o2_can_send(const char *service)
         return O2_FAIL;
     }
     if (TAG_IS_REMOTE(entry->tag)) {
-        o2n_info_ptr proc = (o2n_info_ptr) entry;
-        return (proc->out_message ? O2_BLOCKED : O2_SUCCESS);
+        *info = (o2n_info_ptr) entry;
     } else if (entry->tag == NODE_OSC_REMOTE_SERVICE) {
-        osc_info_ptr oip = (osc_info_ptr) entry;
-        if (oip->tcp_socket_info) {
-            return (oip->tcp_socket_info->out_message ? O2_BLOCKED : O2_SUCCESS);
-        }
+        *info = ((osc_info_ptr) entry)->tcp_socket_info;
     }
     return O2_SUCCESS;
 }
 
 
+int o2_can_send(const char *service)
+{
+    o2n_info_ptr info;
+    int rslt = service_tcp_info(service, &info);
+    if (rslt || !info) {
+        return rslt;
+    }
+    if (o2n_queue_high) { // queue is allowed to grow up to the watermark
+        return (info->congested ? O2_BLOCKED : O2_SUCCESS);
+    }
+    return (info->out_message ? O2_BLOCKED : O2_SUCCESS);
+}
+
+
+int o2_send_queue_depth(const char *service, int *bytes)
+{
+    o2n_info_ptr info;
+    int rslt = service_tcp_info(service, &info);
+    if (bytes) *bytes = (info ? info->out_bytes : 0);
+    if (rslt) {
+        return rslt;
+    }
+    return (info ? info->out_count : 0);
+}
+
+
 #ifdef WIN32
 int gettimeofday(struct timeval * tp, struct timezone * tzp)
 {
@@ -1200,6 +1309,9 @@ int o2_finish()
     if (!o2_ensemble_name) { // see if we're running
         return O2_NOT_INITIALIZED;
     }
+    if (o2_context) {
+        o2n_tcp_flush(); // send any deferred TCP messages
+    }
     if (o2n_socket_delete_flag) {
         // we were counting on o2_recv() to clean up some sockets, but
         // it hasn't been called
@@ -1221,6 +1333,7 @@ int o2_finish()
         o2_node_finish(&o2_context->path_tree);
         o2_node_finish(&o2_context->full_path_table);
         o2_argv_finish();
+        o2_pattern_cache_finish();
     }
     o2n_finish();
 
@@ -1228,6 +1341,7 @@ int o2_finish()
     o2_sched_finish(&o2_ltsched);
     o2_discovery_finish();
     o2_clock_finish();
+    o2_message_pool_finish(); // after all messages are freed
 
     O2_FREE((void *) o2_ensemble_name);
     o2_ensemble_name = NULL;
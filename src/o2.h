@@ -170,6 +170,10 @@ as a result of calling o2_hub() and providing an O2 process address.
 Processes must exchange discovery messages to be connected. The *dy* 
 parameter, if true, requests that the receiver reply with a discovery message.
 
+`/_o2/bo "s"` *byte_order* - sent by TCP when processes connect. The
+*byte_order* is "l" or "b"; processes with the same byte order send
+messages to each other by TCP without swapping bytes.
+
 `/_o2/hub ""` - requests the receiver to become the hub for the sender
 
 `/_o2/cs/cs ""` - announces when clock sync is obtained.
@@ -567,6 +571,15 @@ typedef struct o2_msg_data {
  * within o2_messages and are passed to method handlers, but cannot be
  * allocated, scheduled, sent, or freed. They are always the data field
  * of a containing o2_message.
+ *
+ * A message can be shared by several senders or receivers without
+ * copying (see o2_message_ref() and o2_message_view()). A shared
+ * message must not be modified, and O2 makes a private copy whenever
+ * it needs to modify a shared message.
+ *
+ * If you build a message yourself rather than with o2_message_finish()
+ * or o2_service_message_finish(), allocate it with #O2_MALLOC and set
+ * refs and flags to 0 before calling o2_message_send().
  */
 typedef struct o2_message {
     union {
@@ -574,7 +587,11 @@ typedef struct o2_message {
         int64_t pad_if_needed;   ///< make sure allocated is 8-byte aligned
     };
     union {
-        int tcp_flag;            ///< send message by tcp?
+        struct {
+            int tcp_flag;        ///< send message by tcp?
+            uint16_t refs;       ///< extra references (see o2_message_ref())
+            uint16_t flags;      ///< used internally, e.g. to mark views
+        };
         int64_t pad_if_needed2;  ///< make sure allocated is 8-byte aligned 
     };
     int32_t allocated;       ///< how many bytes allocated in data part
@@ -746,6 +763,22 @@ typedef void (*o2_method_handler)(const o2_msg_data_ptr msg, const char *types,
                                   o2_arg_ptr *argv, int argc, void *user_data);
 
 
+/**
+ * \brief signature for a handler installed by o2_method_new_struct()
+ *
+ * @param msg The full message in host byte order.
+ * @param data The message arguments decoded into a struct with the
+ *             layout given to o2_method_new_struct(). The struct is
+ *             reused for every message, so copy anything you need
+ *             after the handler returns. Strings and blobs point into
+ *             msg.
+ * @param user_data This contains the user_data value passed to
+ *             o2_method_new_struct().
+ */
+typedef void (*o2_struct_handler)(const o2_msg_data_ptr msg, const void *data,
+                                  void *user_data);
+
+
 /**
  *  \brief Start O2.
  *
@@ -1200,6 +1233,96 @@ int o2_method_new(const char *path, const char *typespec,
                   o2_method_handler h, void *user_data, int coerce, int parse);
 
 
+/**
+ * \brief Add a handler that receives arguments in a struct.
+ *
+ * Instead of an argument vector, the handler gets a pointer to a
+ * struct of the caller's design. Argument i of each message is
+ * coerced to typespec[i] and stored at offsets[i] in the struct:
+ * 'i', 'c', 'm' and 'B' as int32_t, 'h' as int64_t, 'f' as float,
+ * 'd' and 't' as double, 's' and 'S' as const char *, and 'b' as
+ * o2_blob_ptr. 'T', 'F', 'N' and 'I' store nothing. For example:
+ * \code{.c}
+ * typedef struct { float gain; int32_t voice; } gain_msg;
+ * int offsets[] = { offsetof(gain_msg, gain), offsetof(gain_msg, voice) };
+ * o2_method_new_struct("/synth/gain", "fi", offsets, sizeof(gain_msg),
+ *                      &gain_handler, NULL);
+ * \endcode
+ * Messages that cannot be coerced to typespec are dropped.
+ *
+ * @param path      the address including the service name (see
+ *                      o2_method_new())
+ * @param typespec  the types of the struct fields. Arrays and vectors
+ *                      are not allowed.
+ * @param offsets   the offset of each field; offsets are copied
+ * @param struct_size the size of the struct
+ * @param h         the handler
+ * @param user_data pointer saved and passed to handler
+ *
+ * @return O2_SUCCESS if succeed, O2_BAD_TYPE if typespec contains
+ *         arrays or vectors, O2_BAD_ARGS if a field is outside the
+ *         struct, otherwise as o2_method_new().
+ */
+int o2_method_new_struct(const char *path, const char *typespec,
+                         const int *offsets, int struct_size,
+                         o2_struct_handler h, void *user_data);
+
+
+/**
+ * \brief Remove a handler added by o2_method_new().
+ *
+ * @param path the address of the handler, including the service name,
+ *                 e.g. "/synth/osc/freq". The service must be local.
+ *
+ * @return O2_SUCCESS, or O2_FAIL if there is no such handler.
+ */
+int o2_remove_method(const char *path);
+
+
+/**
+ * \brief Get statistics of the pattern address cache of a service.
+ *
+ * When a local service receives a message whose address contains
+ * pattern characters (see #o2_send()), it remembers which handlers
+ * matched the address, so that later messages with the same address
+ * do not search for handlers again. The most recently used
+ * addresses are kept, and all are forgotten whenever a method or
+ * service is added or removed.
+ *
+ * @param service the service name
+ * @param hits    where to store the number of messages delivered to
+ *                    remembered handlers
+ * @param misses  where to store the number of messages that required a
+ *                    search
+ *
+ * @return O2_SUCCESS, or O2_NO_SERVICE if the service does not exist.
+ */
+int o2_dispatch_cache_stats(const char *service, int64_t *hits,
+                            int64_t *misses);
+
+
+/**
+ * \brief Make lookups of full paths and services faster.
+ *
+ * Messages to addresses that start with "!" are delivered by looking
+ * up the whole address in a table of all handler paths, and every
+ * message looks up its service name. After an application has added
+ * its methods and services, these tables rarely change, so this
+ * function replaces them with read-only tables where each lookup
+ * takes one hash and at most one string compare, no matter how many
+ * paths there are.
+ *
+ * Any later change to a table, e.g. by #o2_method_new,
+ * #o2_service_new, or the discovery of another process, returns that
+ * table to the normal, slower lookup. Call #o2_dispatch_freeze again
+ * to freeze it.
+ *
+ * @return O2_SUCCESS, or O2_FAIL if a table could not be frozen (it
+ *     still works normally).
+ */
+int o2_dispatch_freeze(void);
+
+
 /**
  *  \brief Process current O2 messages.
  *
@@ -1221,14 +1344,118 @@ int o2_method_new(const char *path, const char *typespec,
  */
 int o2_poll(void);
 
+/**
+ * \brief Wait for activity, then process current O2 messages.
+ *
+ * Blocks until a socket has incoming data, the next message scheduled
+ * on #o2_ltsched or #o2_gtsched is due, or max_timeout has elapsed,
+ * whichever comes first, then calls o2_poll(). Use this instead of
+ * o2_poll() followed by a sleep to get low latency without burning
+ * CPU time when nothing is happening.
+ *
+ * @param max_timeout the longest time to wait in seconds, or a negative
+ *        number to wait only for sockets and scheduled messages.
+ *
+ * @return 0 (O2_SUCCESS) if succeed, -1 (O2_FAIL) if not.
+ */
+int o2_poll_wait(o2_time max_timeout);
+
 /**
  * \brief Run O2.
  *
- * Call o2_poll() at the rate (in Hz) indicated.
+ * Call o2_poll_wait() repeatedly, so that messages are handled as soon
+ * as they arrive or become due, and o2_poll() is called at least at the
+ * rate (in Hz) indicated. If rate is zero or negative, the rate is 1000.
+ * To wait only for incoming and scheduled messages, call
+ * #o2_poll_wait with a negative max_timeout instead.
  * Returns if a handler sets #o2_stop_flag to non-zero.
  */
 int o2_run(int rate);
 
+/**
+ * \brief Select epoll() or poll() to check for socket events.
+ *
+ * On Linux, O2 can be compiled with O2_EPOLL defined (see USE_EPOLL in
+ * CMakeLists.txt), in which case o2_poll() uses epoll() by default, and
+ * the cost of each call depends on the number of active sockets rather
+ * than the total number of sockets. This function switches between
+ * epoll() and poll() and may be called at any time.
+ *
+ * If O2 is compiled with O2_IO_URING (see USE_IO_URING in
+ * CMakeLists.txt) and the kernel supports io_uring, sockets are neither
+ * polled nor registered with epoll, so this function has no effect, and
+ * epoll() cannot be requested.
+ *
+ * @param flag TRUE to use epoll(), FALSE to use poll()
+ *
+ * @return the previous setting, or #O2_FAIL if epoll() was requested
+ *         but O2 was not compiled with O2_EPOLL, or epoll_create1()
+ *         failed in #o2_initialize (O2 then uses poll()), or O2 uses
+ *         io_uring.
+ */
+int o2_use_epoll(int flag);
+
+/**
+ * \brief Get the mechanism that o2_poll() uses to receive from sockets.
+ *
+ * @return "io_uring", "epoll" or "poll" (see #o2_use_epoll)
+ */
+const char *o2_poll_backend(void);
+
+/**
+ * \brief Batch outgoing UDP messages.
+ *
+ * Normally, each UDP message (including OSC messages sent by UDP to a
+ * service created with o2_osc_delegate()) is sent immediately with one
+ * system call. With batching, UDP messages are held and sent together
+ * (with sendmmsg() on Linux) when max_bytes have accumulated, when 64
+ * messages are waiting, or at the end of o2_poll(), whichever comes
+ * first. Thus, a message sent by a handler is delayed by at most the
+ * remainder of the current o2_poll(). Messages sent outside of a
+ * handler wait until the next call to o2_poll(), or are sent by
+ * o2_poll_wait() before it waits.
+ *
+ * @param max_bytes the number of bytes that causes an immediate send,
+ *        or 0 (the default) to disable batching
+ *
+ * @return the previous value of max_bytes
+ */
+int o2_udp_batch(int max_bytes);
+
+/**
+ * \brief Get statistics on batched UDP messages.
+ *
+ * The average batch size is messages / batches. Any parameter may be NULL.
+ *
+ * @param batches set to the number of batches sent
+ * @param messages set to the total number of messages in all batches
+ * @param largest set to the number of messages in the largest batch
+ */
+void o2_udp_batch_stats(int64_t *batches, int64_t *messages, int *largest);
+
+/**
+ * \brief Defer TCP sends to the end of o2_poll().
+ *
+ * Normally, O2 tries to send each TCP message as soon as it is sent.
+ * Since O2 sockets use the TCP_NODELAY option, a burst of small messages
+ * can become a burst of small network packets. When deferred sending is
+ * on, TCP messages are queued until the end of the current o2_poll()
+ * (or the next call to o2_poll() or o2_poll_wait() if not called
+ * from a handler), and then all messages for each connection are
+ * written together. This
+ * adds at most one polling period of delay, but can greatly reduce the
+ * number of packets and system calls. With io_uring (see
+ * #o2_poll_backend), the writes for all connections are also submitted
+ * with one system call; without deferred sending, each message is
+ * written when it is sent, as with poll() or epoll().
+ *
+ * @param flag TRUE to defer TCP sends, FALSE (the default) to send
+ *        immediately
+ *
+ * @return the previous setting
+ */
+int o2_tcp_deferred_send(int flag);
+
 /**
  * \brief Check the status of the service.
  *
@@ -1321,6 +1548,63 @@ int o2_status(const char *service);
 int o2_can_send(const char *service);
 
 
+/**
+ * \brief Get the number of messages waiting to be sent to a service.
+ *
+ * @param service the name of the service.
+ * @param bytes if not NULL, where to store the total size in bytes of
+ *        the waiting messages.
+ *
+ * @return the number of messages queued on the TCP connection used to
+ * send to service (0 if the service is local or is not reached by TCP),
+ * #O2_FAIL if the service is unknown, or another error code (all error
+ * codes are negative).
+ *
+ * All services offered by one process share the connection, so the
+ * result counts messages to every service of that process.
+ */
+int o2_send_queue_depth(const char *service, int *bytes);
+
+
+/**
+ * \brief Function called when a TCP send queue crosses a watermark.
+ *
+ * @param process the name (ip:port) of the process the connection goes
+ *        to, or NULL if it is a connection to an OSC server.
+ * @param congested TRUE if the queue reached the high watermark, FALSE
+ *        if it has since drained to the low watermark.
+ * @param user_data the value passed to #o2_send_queue_limits().
+ */
+typedef void (*o2_queue_callback)(const char *process, int congested,
+                                  void *user_data);
+
+
+/**
+ * \brief Limit the memory used by TCP send queues.
+ *
+ * By default, #o2_send_cmd() blocks until a previous message is sent,
+ * so the queue for each connection stays short. After this function
+ * is called with a non-zero \p high, #o2_send_cmd() never blocks.
+ * Instead, messages are queued until the bytes waiting on a connection
+ * reach \p high. The connection is then congested: #o2_can_send()
+ * returns #O2_BLOCKED, and #o2_send_cmd() drops the message and returns
+ * #O2_BLOCKED. When the queue drains to \p low bytes, the connection is
+ * no longer congested. Messages that O2 sends internally are always
+ * queued.
+ *
+ * @param high the high watermark in bytes, or 0 to restore the default
+ *        blocking behavior.
+ * @param low the low watermark in bytes (no greater than \p high)
+ * @param callback if not NULL, a function to call each time a connection
+ *        becomes congested or stops being congested.
+ * @param user_data a value passed to \p callback.
+ *
+ * @return #O2_SUCCESS, or #O2_BAD_ARGS if the watermarks are invalid.
+ */
+int o2_send_queue_limits(int high, int low, o2_queue_callback callback,
+                         void *user_data);
+
+
 /**
  * \brief A variable indicating that the clock is the master or is
  *        synchronized to the master.
@@ -1465,6 +1749,53 @@ int o2_send_marker(const char *path, double time, int tcp_flag,
                    __VA_ARGS__, O2_MARKER_A, O2_MARKER_B)
 
 
+/** \brief a precompiled message for #o2_template_send */
+typedef struct o2_template *o2_template_ptr;
+
+/**
+ * \brief Prepare to send many messages to one address.
+ *
+ *  A template holds the padded address and type string of a message,
+ *  and the service that the address resolves to, so that sending
+ *  with #o2_template_send only writes the timestamp and data. The
+ *  service is looked up again automatically when services are added,
+ *  replaced or removed. Use this when the same address and type
+ *  string are sent many times, e.g. in a control loop.
+ *
+ *  @param path an address pattern as in #o2_send
+ *  @param typestring the type string for the message (see #o2_send)
+ *  @param tcp_flag send with #o2_send_cmd (TRUE) or #o2_send (FALSE)
+ *
+ *  @return the template, or NULL if path is not a valid address.
+ *  Free the template with #o2_template_free.
+ */
+o2_template_ptr o2_template_new(const char *path, const char *typestring,
+                                int tcp_flag);
+
+/**
+ * \brief Free a template created by #o2_template_new.
+ */
+void o2_template_free(o2_template_ptr tpl);
+
+/**
+ * \brief Construct and send an O2 message from a template.
+ *
+ *  @param tpl the template from #o2_template_new
+ *  @param time when to dispatch the message (see #o2_send)
+ *  @param ... the data of the message. There is one parameter for each
+ *  character in the template's typestring.
+ *
+ *  @return #O2_SUCCESS if success, #O2_FAIL if not.
+ */
+/** \hideinitializer */ // turn off Doxygen report on o2_template_send_marker()
+#define o2_template_send(tpl, ...) \
+    o2_template_send_marker(tpl, __VA_ARGS__, O2_MARKER_A, O2_MARKER_B)
+
+/** \cond INTERNAL */ \
+int o2_template_send_marker(o2_template_ptr tpl, double time, ...);
+/** \endcond */
+
+
 /**
  * \brief Send an O2 message. (See also macros #o2_send and #o2_send_cmd).
  *
@@ -1948,6 +2279,74 @@ o2_message_ptr o2_service_message_finish(o2_time time,
  */
 void o2_message_free(o2_message_ptr msg);
 
+/**
+ * \brief Limit the memory used to recycle messages.
+ *
+ * Messages of up to 64KB are allocated from pools, one for each
+ * power-of-two size class starting at 256 bytes. An empty pool is
+ * refilled by allocating a slab of at least 16KB and dividing it into
+ * messages. Freed messages return to their pool, and slabs are not
+ * freed until o2_finish() is called, so each pool stops taking new slabs
+ * when it holds max_bytes. After that, and for larger messages, each
+ * message is allocated and freed individually with #O2_MALLOC and
+ * #O2_FREE.
+ *
+ * @param max_bytes the number of bytes each size class may hold
+ *        (default 512KB)
+ *
+ * @return the previous value of max_bytes
+ */
+int o2_message_pool_limit(int max_bytes);
+
+/**
+ * \brief add a reference to a message.
+ *
+ * Every reference must be released by sending the message or by
+ * calling o2_message_free(). While there is more than one reference,
+ * the message is shared and must not be modified. This allows a
+ * message to be sent and also kept, e.g. to send it again later,
+ * without building or copying it: o2_message_send(o2_message_ref(msg)).
+ *
+ * @param msg the message to share
+ *
+ * @return msg, or a copy of msg if it already has too many references
+ */
+o2_message_ptr o2_message_ref(o2_message_ptr msg);
+
+/**
+ * \brief make a message that shares the data of another message.
+ *
+ * The new message, or view, has the timestamp, type string and data of
+ * msg, but the service name in the address is replaced by service.
+ * Use this to send one message to several services: the view holds
+ * a reference to msg rather than a copy of its data, and when a view
+ * is sent to a remote process by TCP, the data is written to the
+ * socket directly from msg. The caller keeps its reference to msg.
+ * The view is sent with o2_message_send() or freed with
+ * o2_message_free() like any other message.
+ *
+ * @param msg the message to share
+ * @param service the service name for the view, or NULL to keep the
+ *        address of msg
+ *
+ * @return the view
+ */
+o2_message_ptr o2_message_view(o2_message_ptr msg, const char *service);
+
+/**
+ * \brief Get statistics on message allocation.
+ *
+ * Any parameter may be NULL.
+ *
+ * @param hits set to the number of messages taken from a pool without
+ *        allocating memory
+ * @param misses set to the number of messages that required a call to
+ *        #O2_MALLOC, either to refill a pool or for an individual message
+ * @param bytes_held set to the total size of all slabs held by pools
+ */
+void o2_message_pool_stats(int64_t *hits, int64_t *misses,
+                           int64_t *bytes_held);
+
 
 /**
  * \brief send a message allocated by o2_send_start().
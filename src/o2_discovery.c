@@ -140,6 +140,21 @@ static o2_message_ptr make_o2_dy_msg(o2n_info_ptr info, int tcp_flag,
 }
 
 
+// send our byte order to a newly connected process by TCP. Processes
+// with the same byte order send messages to each other without
+// swapping bytes. This is not part of !_o2/dy because O2 processes
+// that do not know about it would reject !_o2/dy with another type
+// string. Instead, they have no handler for !_o2/bo and drop it.
+//
+static void send_byte_order(o2n_info_ptr remote)
+{
+    o2_send_start();
+    o2_add_string(IS_LITTLE_ENDIAN ? "l" : "b");
+    o2_message_ptr msg = o2_message_finish(0.0, "!_o2/bo", TRUE);
+    if (msg) o2_send_by_tcp(remote, FALSE, msg);
+}
+
+
 /**
  * Broadcast discovery message (!o2/dy) to a discovery port.
  *
@@ -222,7 +237,9 @@ int o2_discovered_a_remote_process(const char *ip, int tcp, int udp, int dy)
 {
     o2n_info_ptr remote = o2_message_source;
     if (dy == O2_DY_CALLBACK) { // similar to info, but close connection first
-        o2_info_remove(remote); // we are going to be the client
+        // we are going to be the client. remote is delivering this
+        // message, so it cannot be removed until the message is handled
+        o2n_info_mark_to_free(remote);
         dy = O2_DY_INFO; 
     }
 
@@ -263,7 +280,11 @@ int o2_discovered_a_remote_process(const char *ip, int tcp, int udp, int dy)
             o2_send_by_tcp(remote, FALSE,
                     make_o2_dy_msg(o2_context->info, TRUE, O2_DY_CONNECT));
             o2_send_clocksync(remote);
+            send_byte_order(remote);
             o2_send_services(remote);
+#ifdef __linux__
+            o2n_shm_offer(remote); // if remote is on this host
+#endif
         }
     } else if (dy == O2_DY_HUB) {
         remote->proc.name = o2_heapify(name);
@@ -273,6 +294,7 @@ int o2_discovered_a_remote_process(const char *ip, int tcp, int udp, int dy)
         o2_send_by_tcp(remote, FALSE,
                 make_o2_dy_msg(o2_context->info, TRUE, O2_DY_REPLY));
         o2_send_clocksync(remote);
+        send_byte_order(remote);
         o2_send_services(remote);
     } else if (dy == O2_DY_REPLY) { // first message from hub
         remote->proc.name = o2_heapify(name);
@@ -292,6 +314,7 @@ int o2_discovered_a_remote_process(const char *ip, int tcp, int udp, int dy)
         remote->proc.name = o2_heapify(name);
         o2_service_provider_new(name, NULL, (o2_node_ptr) remote, remote);
         o2_send_clocksync(remote);
+        send_byte_order(remote);
         o2_send_services(remote);
         O2_DBg(printf("%s ** discovery got CONNECT from client %s, %s\n",
                        o2_debug_prefix, name, "connection complete"));
@@ -312,6 +335,9 @@ int o2_discovered_a_remote_process(const char *ip, int tcp, int udp, int dy)
 #endif
     inet_pton(AF_INET, ip, &(remote->proc.udp_sa.sin_addr.s_addr));
     remote->proc.udp_sa.sin_port = htons(udp);
+    if (remote->is_unix) { // send UDP messages by AF_UNIX too
+        remote->unix_port = tcp;
+    }
 
     return O2_SUCCESS;
 }
@@ -627,6 +653,8 @@ static void hub_has_new_client(o2n_info_ptr nc)
                 break;
             }
             case INFO_TCP_SERVER:          // this represents the local process, ignore
+            case INFO_UNIX_SERVER:         // also the local process
+            case INFO_SHM_DOORBELL:        // also the local process
             case INFO_UDP_SOCKET:          // not a process representation
             case INFO_OSC_UDP_SERVER:      // osc sockets are not O2 processes
             case INFO_OSC_TCP_SERVER:
@@ -653,6 +681,35 @@ void o2_hub_handler(o2_msg_data_ptr msg, const char *types,
 }
 
 
+// /_o2/bo handler: records the byte order of the sender, 'l' or 'b'
+//
+void o2_byte_order_handler(o2_msg_data_ptr msg, const char *types,
+                           o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(o2_message_source);
+    char order = argv[0]->s[0];
+    if (TAG_IS_REMOTE(o2_message_source->tag) &&
+        (order == 'l' || order == 'b')) {
+        o2_message_source->proc.byte_order = order;
+    }
+}
+
+
+// /_o2/sh handler: sets up shared memory with a process on this host.
+// The argument says what step of the protocol this is (see o2_net.c)
+//
+void o2_shm_handler(o2_msg_data_ptr msg, const char *types,
+                    o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(o2_message_source);
+#ifdef __linux__
+    if (TAG_IS_REMOTE(o2_message_source->tag)) {
+        o2n_shm_message(o2_message_source, argv[0]->i32);
+    }
+#endif
+}
+
+
 
 // /_o2/sv handler: called when services become available or are removed. Arguments are
 //     process name, service1, added_flag, service_or_tapper, 
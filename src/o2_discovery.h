@@ -55,6 +55,12 @@ void o2_discovery_init_handler(o2_msg_data_ptr msg, const char *types,
 void o2_hub_handler(o2_msg_data_ptr msg, const char *types,
                     o2_arg_ptr *argv, int argc, void *user_data);
 
+void o2_byte_order_handler(o2_msg_data_ptr msg, const char *types,
+                           o2_arg_ptr *argv, int argc, void *user_data);
+
+void o2_shm_handler(o2_msg_data_ptr msg, const char *types,
+                    o2_arg_ptr *argv, int argc, void *user_data);
+
 void o2_services_handler(o2_msg_data_ptr msg, const char *types,
                          o2_arg_ptr *argv, int argc, void *user_data);
 
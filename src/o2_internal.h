@@ -158,6 +158,7 @@ void o2_dbg_msg(const char *src, o2_msg_data_ptr msg,
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <math.h>
 #include <assert.h>
 
@@ -153,6 +153,8 @@ int o2_osc_delegate(const char *service_name, const char *ip,
         rslt = o2n_connect(ip, port_num, INFO_OSC_TCP_CONNECTING);
         if (rslt) goto fail_and_exit;
         osc->tcp_socket_info = *DA_LAST(o2_context->fds_info, o2n_info_ptr);
+        // o2_info_remove() uses the name to find and clear tcp_socket_info
+        osc->tcp_socket_info->osc.service_name = o2_heapify(service_name);
         if (osc->tcp_socket_info->net_tag == NET_TCP_CONNECTION) {
             // somehow connection completed already
             osc->tcp_socket_info->tag = INFO_OSC_TCP_CONNECTION;
@@ -289,6 +291,7 @@ int o2_deliver_osc(o2n_info_ptr info)
     o2_message_ptr o2msg = osc_to_o2(info->in_message->length, msg_data,
                                      info->osc.service_name);
     o2_message_free(info->in_message);
+    info->in_message = NULL; // a handler may remove info
     if (!o2msg) {
         return O2_FAIL;
     }
@@ -361,9 +364,15 @@ int o2_send_osc(osc_info_ptr service, o2_msg_data_ptr data,
     O2_DBO(o2_dbg_msg("original O2 msg is", data, NULL, NULL));
     // Now we have an OSC message at msg->address. Send it.
     if (service->tcp_socket_info == NULL) { // must be UDP
-        if (sendto(o2n_udp_send_sock, osc_msg, osc_len,
-                   0, (struct sockaddr *) &(service->udp_sa),
-                   sizeof(service->udp_sa)) < 0) {
+        if (o2n_udp_batch_limit) { // copy from msg_data to batch it
+            o2_message_ptr msg = o2_alloc_size_message(osc_len);
+            if (!msg) return O2_NO_MEMORY;
+            msg->length = osc_len;
+            memcpy((char *) &(msg->data), osc_msg, osc_len);
+            o2n_udp_send(msg, &(service->udp_sa));
+        } else if (sendto(o2n_udp_send_sock, osc_msg, osc_len,
+                          0, (struct sockaddr *) &(service->udp_sa),
+                          sizeof(service->udp_sa)) < 0) {
             perror("o2_send_osc");
             return O2_SEND_FAIL;
         }
@@ -375,11 +384,12 @@ int o2_send_osc(osc_info_ptr service, o2_msg_data_ptr data,
         if (!msg) return O2_NO_MEMORY;
         msg->next = NULL;
         msg->tcp_flag = TRUE;
+        msg->flags |= O2_MSG_NET_ORDER; // OSC data must not be swapped
         msg->length = osc_len;
         char *dst = (char *) &(msg->data);
         memcpy(dst, osc_msg, osc_len);
         // now msg has length and data for OSC message
-        o2_send_by_tcp(service->tcp_socket_info, TRUE, msg);
+        return o2_send_shared_by_tcp(service->tcp_socket_info, TRUE, msg);
     }
     return O2_SUCCESS;
 }
@@ -62,6 +62,19 @@
 #include "o2_send.h"
 #include "o2_interoperation.h"
 
+// byte swapping and coercion of vectors use SSE2 on x86 (always available
+// on x86-64), and swapping uses AVX2 if the compiler targets it (e.g.
+// with -mavx2)
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define O2_SSE2 1
+#ifdef __AVX2__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
 
 // --------- PART 1 : SCRATCH AREAS FOR MESSAGE CONSTRUCTION --------
 // Construct messages by writing type string to msg_types and data to
@@ -79,6 +92,9 @@
 // type strings, but if the message is short, the copy cost is probably
 // insignificant compared to all the other work to send, schedule, and
 // dispatch the message.
+//     The exception is o2_send() and o2_send_cmd(), which get the type
+// string and all the data at once, so o2_message_build() sizes the
+// message first and writes it directly without using these arrays.
 
 
 // make sure enough memory is allocated to add an element to msg_data
@@ -358,8 +374,11 @@ o2_message_ptr o2_service_message_finish(
     }
     memcpy(dst, address, addr_len);
     dst = PTR(last_32 + 1);
-    last_32 = (int32_t *) (dst + types_size - sizeof(int32_t));
-    *last_32 = 0; // fil last 32-bit word with zeros
+    if (types_size) { // bundles have no type string, so do not overwrite
+                      // the end of the address
+        last_32 = (int32_t *) (dst + types_size - sizeof(int32_t));
+        *last_32 = 0; // fil last 32-bit word with zeros
+    }
     // if building a bundle, types will be ',', and types will be
     // copied to the message, but types will be overwritten by the
     // first message of the bundle (or if the bundle has zero messages,
@@ -522,34 +541,181 @@ MX_TYPE(rd_int64, int64_t)
 
 // ------- PART 5 : GENERAL MESSAGE FUNCTIONS -------
 
-/// a free list of 240-byte (MESSAGE_DEFAULT_SIZE) o2_messages
-o2_message_ptr message_freelist = NULL;
+// Messages are recycled through pools, one for each size class. Class k
+// holds messages whose total size (including the next, tcp_flag,
+// allocated and length fields and the zero pad) is
+// O2_POOL_MIN_SIZE << k. When a pool is empty, a slab of at least
+// O2_POOL_SLAB_SIZE bytes is allocated and cut into messages for that
+// class. Slabs are only freed by o2_finish(), so the memory carved into
+// each pool is limited to message_pool_limit bytes. If o2_finish() is
+// called from a handler, the message being delivered (and others that
+// were received with it) are still in use, so slabs are freed when the
+// last pooled message is freed. Beyond that, and for
+// messages that are too big for any class, messages are allocated
+// individually and freed with O2_FREE.
+//
+// A pooled message has O2_MSG_POOLED set in flags. Because a message
+// built by an application may have any flags, o2_message_free() also
+// checks that allocated is the class data size, so that a message is
+// only ever put into a pool of its own size.
+//
+#define O2_POOL_MIN_SIZE 256
+#define O2_POOL_CLASSES 9 // largest class is 64KB
+#define O2_POOL_SLAB_SIZE 16384
+
+typedef struct message_pool {
+    o2_message_ptr freelist;
+    int64_t held; // bytes carved into messages for this pool
+} message_pool, *message_pool_ptr;
+
+// each slab starts with a link to the previously allocated slab
+typedef union slab_header {
+    union slab_header *next;
+    int64_t pad_if_needed; // make sure messages are 8-byte aligned
+} slab_header, *slab_header_ptr;
+
+static message_pool message_pools[O2_POOL_CLASSES];
+static slab_header_ptr message_slabs = NULL;
+static int message_pool_limit = 512 * 1024;
+static int64_t message_pool_hits = 0;
+static int64_t message_pool_misses = 0;
+static int64_t message_pool_out = 0; // pooled messages not yet freed
+static int message_pool_finish_pending = FALSE;
 
-// get a free message of size MESSAGE_DEFAULT_SIZE
-static o2_message_ptr message_alloc()
+#if IS_LITTLE_ENDIAN
+// Views sent by TCP need their base in network byte order, but the base
+// may still be in use in host order, so views point into a converted
+// copy, or twin, of the base instead. Views of one base are normally
+// sent one after another (e.g. to each tapper of a service), so caching
+// the twin of the most recent base converts each payload only once.
+static o2_message_ptr twin_base = NULL; // not a counted reference
+static o2_message_ptr twin = NULL;
+#endif
+
+
+// return the size class for a message with size bytes of data, or
+// O2_POOL_CLASSES if size is too big for any class
+static int pool_class(int size)
 {
-    o2_message_ptr msg;
-    if (!message_freelist) {
-        msg = (o2_message_ptr) o2_malloc(MESSAGE_DEFAULT_SIZE);
-        // printf("new msg %p\n", msg);
-        msg->allocated = MESSAGE_ALLOCATED_FROM_SIZE(MESSAGE_DEFAULT_SIZE);
-        MSG_ZERO_END(msg, MESSAGE_DEFAULT_SIZE);
+    int k = 0;
+    int total = MESSAGE_SIZE_FROM_ALLOCATED(size);
+    while (k < O2_POOL_CLASSES && (O2_POOL_MIN_SIZE << k) < total) k++;
+    return k;
+}
+
+
+// allocate a slab for class k and put its messages on the freelist;
+// returns FALSE if the pool has reached message_pool_limit
+static int pool_refill(int k)
+{
+    message_pool_ptr pool = &message_pools[k];
+    int msg_size = O2_POOL_MIN_SIZE << k;
+    int slab_size = msg_size < O2_POOL_SLAB_SIZE ? O2_POOL_SLAB_SIZE : msg_size;
+    if (pool->held + slab_size > message_pool_limit) {
+        return FALSE;
+    }
+    slab_header_ptr header =
+            (slab_header_ptr) O2_MALLOC(sizeof(slab_header) + slab_size);
+    if (!header) return FALSE;
+    header->next = message_slabs;
+    message_slabs = header;
+    pool->held += slab_size;
+    char *slab = (char *) (header + 1);
+    for (char *p = slab; p < slab + slab_size; p += msg_size) {
+        o2_message_ptr msg = (o2_message_ptr) p;
+        msg->allocated = MESSAGE_ALLOCATED_FROM_SIZE(msg_size);
+        MSG_ZERO_END(msg, msg_size);
+        msg->next = pool->freelist;
+        pool->freelist = msg;
+    }
+    return TRUE;
+}
+
+
+static void pool_free_slabs()
+{
+    while (message_slabs) {
+        slab_header_ptr next = message_slabs->next;
+        O2_FREE(message_slabs);
+        message_slabs = next;
+    }
+    for (int k = 0; k < O2_POOL_CLASSES; k++) {
+        message_pools[k].freelist = NULL;
+        message_pools[k].held = 0;
+    }
+}
+
+
+// free all slabs; called by o2_finish() after every other message it
+// knows of has been freed. If pooled messages are still in use (by a
+// handler that called o2_finish()), wait until they are freed.
+void o2_message_pool_finish()
+{
+#if IS_LITTLE_ENDIAN
+    if (twin) {
+        o2_message_free(twin);
+        twin = NULL;
+    }
+    twin_base = NULL;
+#endif
+    if (message_pool_out > 0) {
+        message_pool_finish_pending = TRUE;
     } else {
-        msg = message_freelist;
-        message_freelist = message_freelist->next;
-        msg->length = 0;
+        pool_free_slabs();
+    }
+}
+
+
+int o2_message_pool_limit(int max_bytes)
+{
+    int old = message_pool_limit;
+    message_pool_limit = max_bytes;
+    return old;
+}
+
+
+void o2_message_pool_stats(int64_t *hits, int64_t *misses,
+                           int64_t *bytes_held)
+{
+    if (hits) *hits = message_pool_hits;
+    if (misses) *misses = message_pool_misses;
+    if (bytes_held) {
+        int64_t held = 0;
+        for (int k = 0; k < O2_POOL_CLASSES; k++) {
+            held += message_pools[k].held;
+        }
+        *bytes_held = held;
     }
-    return msg;
 }
 
 
 void o2_message_free(o2_message_ptr msg)
 {
     assert(msg->length != -1);  // check if message is already freed
+    if (msg->refs) { // shared message: just drop one reference
+        msg->refs--;
+        return;
+    }
+    if (msg->flags & O2_MSG_VIEW) {
+        o2_message_free(o2_get_view_info(msg)->base);
+    }
+#if IS_LITTLE_ENDIAN
+    if (msg == twin_base) { // network order copy is no longer valid
+        twin_base = NULL;
+        o2_message_free(twin);
+        twin = NULL;
+    }
+#endif
     msg->length = -1;
-    if (msg->allocated == MESSAGE_ALLOCATED_FROM_SIZE(MESSAGE_DEFAULT_SIZE)) {
-        msg->next = message_freelist;
-        message_freelist = msg;
+    int k = pool_class(msg->allocated);
+    if ((msg->flags & O2_MSG_POOLED) && k < O2_POOL_CLASSES &&
+        msg->allocated == MESSAGE_ALLOCATED_FROM_SIZE(O2_POOL_MIN_SIZE << k)) {
+        msg->next = message_pools[k].freelist;
+        message_pools[k].freelist = msg;
+        if (--message_pool_out == 0 && message_pool_finish_pending) {
+            message_pool_finish_pending = FALSE;
+            pool_free_slabs();
+        }
     } else {
         O2_FREE(msg);
     }
@@ -568,15 +734,180 @@ void o2_message_list_free(o2_message_ptr msg)
 
 o2_message_ptr o2_alloc_size_message(int size)
 {
-    if (size <= MESSAGE_ALLOCATED_FROM_SIZE(MESSAGE_DEFAULT_SIZE)) {
-        // standard pre-allocated message is big enough so use one */
-        return message_alloc();
+    o2_message_ptr msg;
+    int k = pool_class(size);
+    if (k < O2_POOL_CLASSES) {
+        message_pool_ptr pool = &message_pools[k];
+        if (pool->freelist) {
+            message_pool_hits++;
+        } else if (pool_refill(k)) {
+            message_pool_misses++;
+        } else {
+            goto not_pooled;
+        }
+        msg = pool->freelist;
+        pool->freelist = msg->next;
+        message_pool_out++;
+        msg->refs = 0;
+        msg->flags = O2_MSG_POOLED;
+        msg->length = 0;
+        return msg;
+    }
+  not_pooled:
+    message_pool_misses++;
+    msg = (o2_message_ptr) O2_MALLOC(MESSAGE_SIZE_FROM_ALLOCATED(size));
+    msg->allocated = size;
+    msg->refs = 0;
+    msg->flags = 0;
+    msg->length = 0;
+    return msg;
+}
+
+
+// ------- shared messages and views -------
+// A message with refs > 0 is shared: it must not be modified or linked
+// into a list (next can link a message into only one list), and
+// o2_message_free() just drops a reference. Code that modifies or
+// links messages calls o2_message_unshare() to get a private copy.
+//
+// A view (flags & O2_MSG_VIEW) holds only a timestamp and address. An
+// o2_view_info stored at the end of its data part holds a reference to
+// a base message and locates the rest of the view (type string and
+// data) within the base. The TCP send queue writes views directly
+// from the base (see o2n_enqueue()), so the payload is not copied.
+// Elsewhere, o2_message_unshare() turns a view into a normal message.
+
+static o2_message_ptr view_new(o2_message_ptr base, o2_time timestamp,
+        const char *address, const char *service, char *tail, int tail_len,
+        int tcp_flag)
+{
+    const char *rest = address + 1; // part of address to keep
+    int addr_len = (int) strlen(address);
+    if (service) { // replace service name, keeping '/' or '!'
+        rest = strchr(address + 1, '/');
+        if (!rest) rest = address + addr_len;
+        addr_len = 1 + (int) strlen(service) + (int) strlen(rest);
+    }
+    int header_len = sizeof(o2_time) + WORD_OFFSET(addr_len + 4);
+    o2_message_ptr view = o2_alloc_size_message(header_len + 4 +
+                              sizeof(o2_view_info) + sizeof(int64_t));
+    view->next = NULL;
+    view->tcp_flag = tcp_flag;
+    view->flags |= O2_MSG_VIEW;
+    view->length = header_len + tail_len;
+    view->data.timestamp = timestamp;
+    char *dst = view->data.address;
+    // zero the end of the address and an empty type string, which
+    // makes o2_msg_data_print() safe on the view
+    *((int32_t *) (dst + header_len - sizeof(o2_time) - 4)) = 0;
+    *((int32_t *) (dst + header_len - sizeof(o2_time))) = 0;
+    *dst++ = address[0];
+    if (service) {
+        strcpy(dst, service);
+        dst += strlen(service);
+    }
+    strcpy(dst, rest);
+
+    o2_view_info_ptr info = o2_get_view_info(view);
+    info->base = o2_message_ref(base);
+    // if o2_message_ref() made a copy, tail moves to the same offset:
+    info->tail = PTR(&info->base->data) + (tail - PTR(&base->data));
+    info->tail_len = tail_len;
+    return view;
+}
+
+
+o2_view_info_ptr o2_get_view_info(o2_message_ptr view)
+{
+    return (o2_view_info_ptr)
+            ((size_t) (PTR(&view->data) + view->allocated -
+                       sizeof(o2_view_info)) & ~(size_t) 7);
+}
+
+
+// copy msg to a new private message
+static o2_message_ptr message_copy(o2_message_ptr msg)
+{
+    o2_message_ptr copy = o2_alloc_size_message(msg->length);
+    copy->next = NULL;
+    copy->tcp_flag = msg->tcp_flag;
+    copy->length = msg->length;
+    if (msg->flags & O2_MSG_VIEW) {
+        o2_view_info_ptr info = o2_get_view_info(msg);
+        int header_len = msg->length - info->tail_len;
+        memcpy(&copy->data, &msg->data, header_len);
+        memcpy(PTR(&copy->data) + header_len, info->tail, info->tail_len);
     } else {
-        o2_message_ptr msg = (o2_message_ptr)
-            o2_malloc(MESSAGE_SIZE_FROM_ALLOCATED(size));
-        msg->allocated = size;
+        memcpy(&copy->data, &msg->data, msg->length);
+    }
+    return copy;
+}
+
+
+o2_message_ptr o2_message_ref(o2_message_ptr msg)
+{
+    if (msg->refs == UINT16_MAX) { // out of references, so copy
+        return message_copy(msg);
+    }
+    msg->refs++;
+    return msg;
+}
+
+
+o2_message_ptr o2_message_view(o2_message_ptr msg, const char *service)
+{
+    if (msg->flags & O2_MSG_VIEW) { // share the base, not the view
+        o2_view_info_ptr info = o2_get_view_info(msg);
+        return view_new(info->base, msg->data.timestamp, msg->data.address,
+                        service, info->tail, info->tail_len, msg->tcp_flag);
+    }
+    int header_len = sizeof(o2_time) + o2_strsize(msg->data.address);
+    return view_new(msg, msg->data.timestamp, msg->data.address, service,
+                    PTR(&msg->data) + header_len, msg->length - header_len,
+                    msg->tcp_flag);
+}
+
+
+o2_message_ptr o2_view_new(o2_message_ptr base, o2_msg_data_ptr embedded,
+                           int tcp_flag)
+{
+    int header_len = sizeof(o2_time) + o2_strsize(embedded->address);
+    return view_new(base, embedded->timestamp, embedded->address, NULL,
+                    PTR(embedded) + header_len,
+                    MSG_DATA_LENGTH(embedded) - header_len, tcp_flag);
+}
+
+
+o2_message_ptr o2_message_unshare(o2_message_ptr msg)
+{
+    if (!msg->refs && !(msg->flags & O2_MSG_VIEW)) {
         return msg;
     }
+    o2_message_ptr copy = message_copy(msg);
+    o2_message_free(msg); // drop our reference
+    return copy;
+}
+
+
+void o2_view_to_network(o2_message_ptr view)
+{
+#if IS_LITTLE_ENDIAN
+    int64_t i64_time = *(int64_t *) &(view->data.timestamp);
+    i64_time = swap64(i64_time);
+    view->data.timestamp = *(o2_time *) &i64_time;
+
+    o2_view_info_ptr info = o2_get_view_info(view);
+    o2_message_ptr base = info->base;
+    if (base != twin_base) {
+        if (twin) o2_message_free(twin);
+        twin = message_copy(base);
+        o2_msg_swap_endian(&(twin->data), TRUE);
+        twin_base = base;
+    }
+    info->base = o2_message_ref(twin);
+    info->tail = PTR(&info->base->data) + (info->tail - PTR(&base->data));
+    o2_message_free(base);
+#endif
 }
 
 
@@ -702,6 +1033,82 @@ ssize_t o2_validate_bundle(void *data, ssize_t size)
 
 #endif // VALIDATION_FUNCTIONS
 
+// swap the byte order of n 32-bit values at data, which need only be
+// 4-byte aligned. This is used for vectors and for runs of 32-bit
+// arguments in o2_msg_swap_endian().
+//
+void o2_swap32_array(void *data, int n)
+{
+    char *p = (char *) data;
+    int i = 0;
+#ifdef __AVX2__
+    const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+            11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4,
+            11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 8 <= n; i += 8) {
+        __m256i *v = (__m256i *) (p + i * sizeof(int32_t));
+        _mm256_storeu_si256(v, _mm256_shuffle_epi8(_mm256_loadu_si256(v),
+                                                   order));
+    }
+#endif
+#ifdef O2_SSE2
+    for (; i + 4 <= n; i += 4) {
+        __m128i *v = (__m128i *) (p + i * sizeof(int32_t));
+        __m128i x = _mm_loadu_si128(v);
+        // swap bytes in each 16-bit word, then swap the words
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(v, x);
+    }
+#endif
+    for (; i < n; i++) {
+        int32_t *x = (int32_t *) (p + i * sizeof(int32_t));
+        *x = swap32(*x);
+    }
+}
+
+
+// swap the byte order of n 64-bit values at data, which need only be
+// 4-byte aligned (see o2_swap32_array())
+//
+void o2_swap64_array(void *data, int n)
+{
+    char *p = (char *) data;
+    int i = 0;
+#ifdef __AVX2__
+    const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+            15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+            15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 4 <= n; i += 4) {
+        __m256i *v = (__m256i *) (p + i * sizeof(int64_t));
+        _mm256_storeu_si256(v, _mm256_shuffle_epi8(_mm256_loadu_si256(v),
+                                                   order));
+    }
+#endif
+#ifdef O2_SSE2
+    for (; i + 2 <= n; i += 2) {
+        __m128i *v = (__m128i *) (p + i * sizeof(int64_t));
+        __m128i x = _mm_loadu_si128(v);
+        // swap bytes in each 16-bit word, then reverse the 4 words
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128(v, x);
+    }
+#endif
+    for (; i < n; i++) {
+        int64_t *x = (int64_t *) (p + i * sizeof(int64_t));
+        *x = swap64(*x);
+    }
+}
+
+
+#define IS_32_BIT_TYPE(t) ((t) == O2_INT32 || (t) == O2_FLOAT || \
+        (t) == O2_BOOL || (t) == O2_MIDI || (t) == O2_CHAR)
+#define IS_64_BIT_TYPE(t) ((t) == O2_INT64 || (t) == O2_DOUBLE || \
+        (t) == O2_TIME)
+
 #define PREPARE_TO_ACCESS(typ) \
     char *end = data_next + sizeof(typ); \
     if (end > end_of_msg) return O2_INVALID_MSG;
@@ -740,11 +1147,14 @@ int o2_msg_swap_endian(o2_msg_data_ptr msg, int is_host_order)
             case O2_BOOL:
             case O2_MIDI:
             case O2_FLOAT:
-            case O2_CHAR: {
-                PREPARE_TO_ACCESS(int32_t);
-                int32_t i = *(int32_t *)data_next;
-                *(int32_t *)data_next = swap32(i);
+            case O2_CHAR: { // swap a run of 32-bit arguments together
+                int n = 1;
+                while (IS_32_BIT_TYPE(types[n])) n++;
+                char *end = data_next + n * sizeof(int32_t);
+                if (end > end_of_msg) return O2_INVALID_MSG;
+                o2_swap32_array(data_next, n);
                 data_next = end;
+                types += n - 1;
                 break;
             }
             case O2_BLOB: {
@@ -766,11 +1176,14 @@ int o2_msg_swap_endian(o2_msg_data_ptr msg, int is_host_order)
             }
             case O2_TIME:
             case O2_INT64:
-            case O2_DOUBLE: {
-                PREPARE_TO_ACCESS(int64_t);
-                int64_t i = *(int64_t *)data_next;
-                *(int64_t *)data_next = swap64(i);
+            case O2_DOUBLE: { // swap a run of 64-bit arguments together
+                int n = 1;
+                while (IS_64_BIT_TYPE(types[n])) n++;
+                char *end = data_next + n * sizeof(int64_t);
+                if (end > end_of_msg) return O2_INVALID_MSG;
+                o2_swap64_array(data_next, n);
                 data_next = end;
+                types += n - 1;
                 break;
             }
             case O2_STRING:
@@ -796,24 +1209,15 @@ int o2_msg_swap_endian(o2_msg_data_ptr msg, int is_host_order)
                 data_next = end;
                 // now test for vector data within end_of_msg
                 end += len;
-                if (end > end_of_msg) return O2_INVALID_MSG;
-                // swap each vector element
-                len /= 4; // assuming 32-bit elements
-                o2_type vtype = *types++;
-                if (vtype == O2_DOUBLE || vtype == O2_INT64) {
-                    len /= 2; // half as many elements if they are 64-bits
-                }
-                for (int i = 0; i < len; i++) { // for each vector element
-                    if (vtype == O2_INT32 || vtype == O2_FLOAT) {
-                        *(int32_t *)data_next =
-                                swap32(*(int32_t *)data_next);
-                        data_next += sizeof(int32_t);
-                    } else if (vtype == O2_INT64 || vtype == O2_DOUBLE) {
-                        *(int64_t *)data_next =
-                                swap64(*(int64_t *)data_next);
-                        data_next += sizeof(int64_t);
-                    }
+                if (len < 0 || end > end_of_msg) return O2_INVALID_MSG;
+                // swap the vector elements; the element type follows 'v'
+                o2_type vtype = *++types;
+                if (vtype == O2_INT32 || vtype == O2_FLOAT) {
+                    o2_swap32_array(data_next, len / (int) sizeof(int32_t));
+                } else if (IS_64_BIT_TYPE(vtype)) {
+                    o2_swap64_array(data_next, len / (int) sizeof(int64_t));
                 }
+                data_next = end;
                 break;
             }
             default:
@@ -828,104 +1232,412 @@ int o2_msg_swap_endian(o2_msg_data_ptr msg, int is_host_order)
 }
 
 
+// o2_message_build is used by o2_send() and o2_send_cmd(), where the
+// type string is known in advance, so it does not use the scratch
+// areas. One pass over typestring and ap computes the message size,
+// and a second pass writes the address, types and data directly into
+// the message. If net_order, the message is for a remote process, so
+// the timestamp and data are written in network byte order and the
+// message is marked with O2_MSG_NET_ORDER so that it is not swapped
+// again when it is sent.
+//
+#if IS_LITTLE_ENDIAN
+#define BUILD_32(dst, x) \
+    *((int32_t *) (dst)) = (net_order ? swap32(x) : (x)); (dst) += 4
+#define BUILD_64(dst, x) \
+    *((int64_t *) (dst)) = (net_order ? swap64(x) : (x)); (dst) += 8
+#else
+#define BUILD_32(dst, x) *((int32_t *) (dst)) = (x); (dst) += 4
+#define BUILD_64(dst, x) *((int64_t *) (dst)) = (x); (dst) += 8
+#endif
+
+// write the data for o2_message_build() and o2_template_build(). If
+// types is not NULL, the type codes are also written to *types, and
+// unknown type codes are skipped. Returns the end of the data.
+//
+static char *build_data(char **types, char *data, const char *typestring,
+                        int net_order, va_list *ap)
+{
+    for (const char *t = typestring; *t; t++) {
+        switch (*t) {
+            case O2_INT32:
+            case O2_CHAR: {
+                int32_t x = va_arg(*ap, int);
+                BUILD_32(data, x);
+                break;
+            }
+            case O2_BOOL: {
+                int32_t x = (va_arg(*ap, int) != 0);
+                BUILD_32(data, x);
+                break;
+            }
+            case O2_FLOAT: {
+                float f = (float) va_arg(*ap, double);
+                int32_t x = *((int32_t *) &f);
+                BUILD_32(data, x);
+                break;
+            }
+            case O2_MIDI: {
+                int32_t x = (int32_t) va_arg(*ap, uint32_t);
+                BUILD_32(data, x);
+                break;
+            }
+            case O2_SYMBOL:
+            case O2_STRING: {
+                char *string = va_arg(*ap, char *);
+                int size = o2_strsize(string);
+                *((int32_t *) (data + size - sizeof(int32_t))) = 0;
+                memcpy(data, string, strlen(string));
+                data += size;
+                break;
+            }
+            case O2_BLOB: {
+                o2_blob_ptr blob = va_arg(*ap, o2_blob_ptr);
+                int32_t size = blob->size;
+                BUILD_32(data, size);
+                if (size > 0) {
+                    *((int32_t *) (data + ((size - 1) & ~3))) = 0;
+                    memcpy(data, blob->data, size);
+                }
+                data += (size + 3) & ~3;
+                break;
+            }
+            case O2_INT64: {
+                int64_t x = va_arg(*ap, int64_t);
+                BUILD_64(data, x);
+                break;
+            }
+            case O2_TIME:
+            case O2_DOUBLE: {
+                double d = va_arg(*ap, double);
+                int64_t x = *((int64_t *) &d);
+                BUILD_64(data, x);
+                break;
+            }
+            case O2_TRUE:
+            case O2_FALSE:
+            case O2_NIL:
+            case O2_INFINITUM:
+                break;
+            default:
+                continue;
+        }
+        if (types) *(*types)++ = *t;
+    }
+    return data;
+}
+
+
+#ifndef USE_ANSI_C
+// check that the arguments end with O2_MARKER_A and O2_MARKER_B
+//
+static int build_markers_ok(va_list *ap)
+{
+    void *i = va_arg(*ap, void *);
+    if ((((unsigned long) i) & 0xFFFFFFFFUL) !=
+        (((unsigned long) O2_MARKER_A) & 0xFFFFFFFFUL)) {
+        return FALSE;
+    }
+    i = va_arg(*ap, void *);
+    return ((((unsigned long) i) & 0xFFFFFFFFUL) ==
+            (((unsigned long) O2_MARKER_B) & 0xFFFFFFFFUL));
+}
+#endif
+
+
+static void build_timestamp(o2_message_ptr m, o2_time timestamp,
+                            int net_order)
+{
+    m->data.timestamp = timestamp;
+#if IS_LITTLE_ENDIAN
+    if (net_order) {
+        int64_t x = swap64(*((int64_t *) &timestamp));
+        m->data.timestamp = *((o2_time *) &x);
+        m->flags |= O2_MSG_NET_ORDER;
+    }
+#endif
+}
+
+
 int o2_message_build(o2_message_ptr *msg, o2_time timestamp,
                      const char *service_name, const char *path,
-                     const char *typestring, int tcp_flag, va_list ap)
+                     const char *typestring, int tcp_flag, int net_order,
+                     va_list ap)
 {
-    o2_send_start();
-    
-    // add data, a NULL typestring or "" means "no arguments"
-    while (typestring && *typestring) {
-        switch (*typestring++) {
-            case O2_INT32: // get int in case int32 was promoted to int64
-                o2_add_int32(va_arg(ap, int));
+    // a NULL typestring or "" means "no arguments"
+    if (!typestring) typestring = "";
+    // pass 1: find the lengths of the type string and data
+    va_list ap2;
+    va_copy(ap2, ap);
+    int types_len = 1; // for ','
+    int data_len = 0;
+    for (const char *t = typestring; *t; t++) {
+        switch (*t) {
+            case O2_INT32:
+            case O2_CHAR:
+            case O2_BOOL:
+                va_arg(ap2, int);
+                data_len += sizeof(int32_t);
                 break;
-                
             case O2_FLOAT:
-                o2_add_float((float) va_arg(ap, double));
+                va_arg(ap2, double);
+                data_len += sizeof(float);
                 break;
-                
-            case O2_SYMBOL:
-                o2_add_symbol(va_arg(ap, char *));
+            case O2_MIDI:
+                va_arg(ap2, uint32_t);
+                data_len += sizeof(uint32_t);
                 break;
-                
+            case O2_SYMBOL:
             case O2_STRING: {
-                char *string = va_arg(ap, char *);
-                o2_add_string(string);
+                char *string = va_arg(ap2, char *);
 #ifndef USE_ANSI_C
                 if (string == (char *) O2_MARKER_A) {
                     fprintf(stderr,
                             "o2 error: o2_send or o2_message_add called with "
                             "invalid string pointer, probably arg mismatch.\n");
+                    goto error_exit;
                 }
 #endif
+                data_len += o2_strsize(string);
                 break;
             }
-                
-            case O2_BLOB:
-                // argument should be a pointer to an o2_blob!
-                o2_add_blob(va_arg(ap, o2_blob_ptr));
+            case O2_BLOB: // argument should be a pointer to an o2_blob!
+                data_len += sizeof(int32_t) +
+                            ((va_arg(ap2, o2_blob_ptr)->size + 3) & ~3);
                 break;
-                
             case O2_INT64:
-                o2_add_int64(va_arg(ap, int64_t));
+                va_arg(ap2, int64_t);
+                data_len += sizeof(int64_t);
                 break;
-                
             case O2_TIME:
-                o2_add_time(va_arg(ap, double));
-                break;
-                
             case O2_DOUBLE:
-                o2_add_double(va_arg(ap, double));
+                va_arg(ap2, double);
+                data_len += sizeof(double);
                 break;
-                
-            case O2_CHAR:
-                o2_add_char(va_arg(ap, int));
+            case O2_TRUE:
+            case O2_FALSE:
+            case O2_NIL:
+            case O2_INFINITUM:
                 break;
-                
+            default: // unknown types are left out of the message
+                fprintf(stderr, "o2 warning: unknown type '%c'\n", *t);
+                continue;
+        }
+        types_len++;
+    }
+#ifndef USE_ANSI_C
+    if (!build_markers_ok(&ap2)) { // bad format/args
+        goto error_exit;
+    }
+#endif
+    va_end(ap2);
+
+    // allocate the message and write the address
+    int addr_len = (int) strlen(path);
+    // if service is provided, we'll prepend '/', so add 1 to string length
+    int service_len = (service_name ? (int) strlen(service_name) + 1 : 0);
+    int addr_size = (service_len + addr_len + 4) & ~3;
+    int types_size = (types_len + 4) & ~3;
+    int msg_size = sizeof(o2_time) + addr_size + types_size + data_len;
+    o2_message_ptr m = o2_alloc_size_message(msg_size);
+    if (!m) {
+        va_end(ap);
+        return O2_FAIL;
+    }
+    m->next = NULL;
+    m->tcp_flag = tcp_flag;
+    m->length = msg_size;
+    char *dst = m->data.address;
+    *((int32_t *) (dst + addr_size - sizeof(int32_t))) = 0; // zero pad
+    if (service_name) {
+        *dst = '/';
+        memcpy(dst + 1, service_name, service_len);
+        dst += service_len;
+    }
+    memcpy(dst, path, addr_len);
+
+    // pass 2: write the type string and data
+    char *types = m->data.address + addr_size;
+    char *data = types + types_size;
+    *types++ = ',';
+    va_list ap3; // ap may be an array type, so copy it to pass a pointer
+    va_copy(ap3, ap);
+    build_data(&types, data, typestring, net_order, &ap3);
+    va_end(ap3);
+    va_end(ap);
+    while (types < m->data.address + addr_size + types_size) {
+        *types++ = 0;
+    }
+    build_timestamp(m, timestamp, net_order);
+    *msg = m;
+    return O2_SUCCESS;
+#ifndef USE_ANSI_C
+  error_exit:
+    fprintf(stderr, "o2 error: o2_send or o2_send_cmd called with mismatching types and data.\n");
+    va_end(ap2);
+    va_end(ap);
+    return O2_BAD_ARGS;
+#endif
+}
+
+
+// o2_template_new() does the work of pass 1 of o2_message_build()
+// that does not depend on the data: the address and type string are
+// padded and stored in the template, and the data length is known
+// except for strings and blobs.
+//
+o2_template_ptr o2_template_new(const char *path, const char *typestring,
+                                int tcp_flag)
+{
+    if (!path || (path[0] != '/' && path[0] != '!')) {
+        return NULL;
+    }
+    // a NULL typestring or "" means "no arguments"
+    if (!typestring) typestring = "";
+    int types_len = 1; // for ','
+    int data_len = 0;
+    int varsize = FALSE;
+    for (const char *t = typestring; *t; t++) {
+        switch (*t) {
+            case O2_INT32:
+            case O2_CHAR:
+            case O2_BOOL:
+            case O2_FLOAT:
             case O2_MIDI:
-                o2_add_midi(va_arg(ap, uint32_t));
+                data_len += sizeof(int32_t);
                 break;
-                
-            case O2_BOOL:
-                o2_add_bool(va_arg(ap, int));
+            case O2_SYMBOL:
+            case O2_STRING:
+                varsize = TRUE;
+                break;
+            case O2_BLOB:
+                data_len += sizeof(int32_t);
+                varsize = TRUE;
+                break;
+            case O2_INT64:
+            case O2_TIME:
+            case O2_DOUBLE:
+                data_len += sizeof(int64_t);
                 break;
-                
             case O2_TRUE:
             case O2_FALSE:
             case O2_NIL:
             case O2_INFINITUM:
-                add_type(typestring[-1]);
-                break;
-                
-                // fall through to unknown type
-            default: {
-                fprintf(stderr, "o2 warning: unknown type '%c'\n", *(typestring - 1));
                 break;
-            }
+            default: // unknown types are left out of the message
+                fprintf(stderr, "o2 warning: unknown type '%c'\n", *t);
+                continue;
         }
+        types_len++;
     }
-    
+    int addr_size = o2_strsize(path);
+    int types_size = (types_len + 4) & ~3;
+    o2_template_ptr tpl = (o2_template_ptr)
+            O2_MALLOC(offsetof(o2_template, header) + addr_size + types_size);
+    tpl->tcp_flag = tcp_flag;
+    tpl->header_size = addr_size + types_size;
+    tpl->types_offset = addr_size + 1;
+    tpl->data_len = data_len;
+    tpl->varsize = varsize;
+    tpl->generation = o2_services_generation - 1; // not found yet
+    tpl->service = NULL;
+    tpl->services = NULL;
+    char *dst = tpl->header;
+    *((int32_t *) (dst + addr_size - sizeof(int32_t))) = 0; // zero pad
+    memcpy(dst, path, strlen(path));
+    dst += addr_size;
+    *((int32_t *) (dst + types_size - sizeof(int32_t))) = 0; // zero pad
+    *dst++ = ',';
+    for (const char *t = typestring; *t; t++) {
+        if (strchr("icBfmsSbhtdTFNI", *t)) *dst++ = *t;
+    }
+    return tpl;
+}
+
+
+void o2_template_free(o2_template_ptr tpl)
+{
+    O2_FREE(tpl);
+}
+
+
+// build a message from a template: like o2_message_build(), but only
+// strings and blobs need a pass to find the message size
+//
+int o2_template_build(o2_message_ptr *msg, o2_template_ptr tpl,
+                      o2_time timestamp, int net_order, va_list ap)
+{
+    const char *typestring = tpl->header + tpl->types_offset;
+    int data_len = tpl->data_len;
+    va_list ap2;
+    va_copy(ap2, ap);
+    if (tpl->varsize) { // add the sizes of strings and blobs
+        for (const char *t = typestring; *t; t++) {
+            switch (*t) {
+                case O2_INT32:
+                case O2_CHAR:
+                case O2_BOOL:
+                    va_arg(ap2, int);
+                    break;
+                case O2_FLOAT:
+                case O2_TIME:
+                case O2_DOUBLE:
+                    va_arg(ap2, double);
+                    break;
+                case O2_MIDI:
+                    va_arg(ap2, uint32_t);
+                    break;
+                case O2_INT64:
+                    va_arg(ap2, int64_t);
+                    break;
+                case O2_SYMBOL:
+                case O2_STRING: {
+                    char *string = va_arg(ap2, char *);
 #ifndef USE_ANSI_C
-    void *i = va_arg(ap, void *);
-    if ((((unsigned long) i) & 0xFFFFFFFFUL) !=
-        (((unsigned long) O2_MARKER_A) & 0xFFFFFFFFUL)) {
-        // bad format/args
-        goto error_exit;
+                    if (string == (char *) O2_MARKER_A) {
+                        goto error_exit;
+                    }
+#endif
+                    data_len += o2_strsize(string);
+                    break;
+                }
+                case O2_BLOB:
+                    data_len += (va_arg(ap2, o2_blob_ptr)->size + 3) & ~3;
+                    break;
+                default:
+                    break;
+            }
+        }
+        va_end(ap2);
+        va_copy(ap2, ap);
     }
-    i = va_arg(ap, void *);
-    if ((((unsigned long) i) & 0xFFFFFFFFUL) !=
-        (((unsigned long) O2_MARKER_B) & 0xFFFFFFFFUL)) {
+    int msg_size = sizeof(o2_time) + tpl->header_size + data_len;
+    o2_message_ptr m = o2_alloc_size_message(msg_size);
+    if (!m) {
+        va_end(ap2);
+        return O2_FAIL;
+    }
+    memcpy(m->data.address, tpl->header, tpl->header_size);
+    build_data(NULL, m->data.address + tpl->header_size, typestring,
+               net_order, &ap2);
+#ifndef USE_ANSI_C
+    if (!build_markers_ok(&ap2)) {
+        o2_message_free(m);
         goto error_exit;
     }
 #endif
-    va_end(ap);
-    *msg = o2_service_message_finish(timestamp, service_name, path, tcp_flag);
-    return (*msg ? O2_SUCCESS : O2_FAIL);
+    va_end(ap2);
+    m->next = NULL;
+    m->tcp_flag = tpl->tcp_flag;
+    m->length = msg_size;
+    build_timestamp(m, timestamp, net_order);
+    *msg = m;
+    return O2_SUCCESS;
 #ifndef USE_ANSI_C
   error_exit:
-    fprintf(stderr, "o2 error: o2_send or o2_send_cmd called with mismatching types and data.\n");
-    va_end(ap);
+    fprintf(stderr, "o2 error: o2_template_send called with mismatching "
+            "types and data.\n");
+    va_end(ap2);
     return O2_BAD_ARGS;
 #endif
 }
@@ -967,6 +1679,9 @@ int o2_extract_start(o2_msg_data_ptr msg)
     // times remaining data.
     int arg_needed = types_len * 8;
     if (arg_needed > msg_data_len * 6) arg_needed = msg_data_len * 6;
+    // but a vector of 32-bit elements coerced to 64-bit elements needs
+    // twice its size
+    if (strchr(mx_types, O2_VECTOR)) arg_needed += msg_data_len * 2;
     arg_needed += 16; // add some space for safety
     need_argv(argv_needed, arg_needed);
     
@@ -1059,6 +1774,130 @@ static o2_arg_ptr convert_float(o2_type to_type, double d, int siz)
 }
 
 
+// coerce n vector elements at src from from_type to to_type, appending
+// them to arg_data. Common conversions have their own loops (using SSE2
+// where possible) so that there is no switch per element. Returns FALSE
+// if an element cannot be coerced.
+//
+#define CONVERSION(from, to) (((from) << 8) + (to))
+#define CONVERT_LOOP(from_type, to_type) \
+    for (; i < n; i++) ((to_type *) dst)[i] = (to_type) ((from_type *) src)[i]
+
+static int convert_vector(o2_type from_type, o2_type to_type,
+                          const char *src, int n)
+{
+    char *dst = (char *) ARG_NEXT;
+    int i = 0;
+    if (to_type == O2_TIME) to_type = O2_DOUBLE;
+    switch (CONVERSION(from_type, to_type)) {
+        case CONVERSION(O2_INT32, O2_FLOAT):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128i x = _mm_loadu_si128((__m128i *) (src + i * 4));
+                _mm_storeu_ps((float *) dst + i, _mm_cvtepi32_ps(x));
+            }
+#endif
+            CONVERT_LOOP(int32_t, float);
+            break;
+        case CONVERSION(O2_INT32, O2_DOUBLE):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128i x = _mm_loadu_si128((__m128i *) (src + i * 4));
+                _mm_storeu_pd((double *) dst + i, _mm_cvtepi32_pd(x));
+                _mm_storeu_pd((double *) dst + i + 2,
+                              _mm_cvtepi32_pd(_mm_srli_si128(x, 8)));
+            }
+#endif
+            CONVERT_LOOP(int32_t, double);
+            break;
+        case CONVERSION(O2_FLOAT, O2_INT32):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps((float *) src + i);
+                _mm_storeu_si128((__m128i *) (dst + i * 4),
+                                 _mm_cvttps_epi32(x));
+            }
+#endif
+            CONVERT_LOOP(float, int32_t);
+            break;
+        case CONVERSION(O2_FLOAT, O2_DOUBLE):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps((float *) src + i);
+                _mm_storeu_pd((double *) dst + i, _mm_cvtps_pd(x));
+                _mm_storeu_pd((double *) dst + i + 2,
+                              _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            }
+#endif
+            CONVERT_LOOP(float, double);
+            break;
+        case CONVERSION(O2_DOUBLE, O2_INT32):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128i lo = _mm_cvttpd_epi32(_mm_loadu_pd((double *) src + i));
+                __m128i hi = _mm_cvttpd_epi32(
+                        _mm_loadu_pd((double *) src + i + 2));
+                _mm_storeu_si128((__m128i *) (dst + i * 4),
+                                 _mm_unpacklo_epi64(lo, hi));
+            }
+#endif
+            CONVERT_LOOP(double, int32_t);
+            break;
+        case CONVERSION(O2_DOUBLE, O2_FLOAT):
+#ifdef O2_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((double *) src + i));
+                __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((double *) src + i + 2));
+                _mm_storeu_ps((float *) dst + i, _mm_movelh_ps(lo, hi));
+            }
+#endif
+            CONVERT_LOOP(double, float);
+            break;
+        case CONVERSION(O2_INT32, O2_INT64): CONVERT_LOOP(int32_t, int64_t);
+            break;
+        case CONVERSION(O2_INT64, O2_INT32): CONVERT_LOOP(int64_t, int32_t);
+            break;
+        case CONVERSION(O2_INT64, O2_FLOAT): CONVERT_LOOP(int64_t, float);
+            break;
+        case CONVERSION(O2_INT64, O2_DOUBLE): CONVERT_LOOP(int64_t, double);
+            break;
+        case CONVERSION(O2_FLOAT, O2_INT64): CONVERT_LOOP(float, int64_t);
+            break;
+        case CONVERSION(O2_DOUBLE, O2_INT64): CONVERT_LOOP(double, int64_t);
+            break;
+        default: // unusual types: convert one element at a time
+            for (; i < n; i++) {
+                o2_arg_ptr rslt;
+                switch (from_type) {
+                    case O2_INT32:
+                        rslt = convert_int(to_type, ((int32_t *) src)[i],
+                                           sizeof(int32_t));
+                        break;
+                    case O2_INT64:
+                        rslt = convert_int(to_type, ((int64_t *) src)[i],
+                                           sizeof(int64_t));
+                        break;
+                    case O2_FLOAT:
+                        rslt = convert_float(to_type, ((float *) src)[i],
+                                             sizeof(float));
+                        break;
+                    case O2_DOUBLE:
+                        rslt = convert_float(to_type, ((double *) src)[i],
+                                             sizeof(double));
+                        break;
+                    default:
+                        return FALSE;
+                }
+                if (!rslt) return FALSE;
+            }
+            return TRUE; // convert_int() and convert_float() update arg_data
+    }
+    o2_context->arg_data.length += n * (to_type == O2_INT64 ||
+                                        to_type == O2_DOUBLE ? 8 : 4);
+    return TRUE;
+}
+
+
 static o2_arg ea, sa;
 o2_arg_ptr o2_got_end_array = &ea;
 o2_arg_ptr o2_got_start_array = &sa;
@@ -1101,59 +1940,22 @@ o2_arg_ptr o2_get_next(o2_type to_type)
             mx_vector_to_vector_pending = FALSE;
             return NULL; // bad message
         }
-        switch (*mx_type_next++) { // switch on actual (in message) type
-            case O2_INT32:
-                rslt->v.len >>= 2; // byte count / 4
-                if (to_type != O2_INT32) {
-                    for (int i = 0; i < rslt->v.len; i++) {
-                        if (!convert_int(to_type, MX_INT32, sizeof(int32_t)))
-                            return NULL;
-                        mx_data_next += sizeof(int32_t);
-                    }
-                } else {
-                    MX_SKIP(sizeof(int32_t) * rslt->v.len);
-                }
-                break;
-            case O2_INT64:
-                rslt->v.len >>= 3; // byte count / 8
-                if (to_type != O2_INT64) {
-                    // we'll need len int64s of free space
-                    for (int i = 0; i < rslt->v.len; i++) {
-                        if (!convert_int(to_type, MX_INT64, sizeof(int32_t)))
-                            return NULL;
-                        mx_data_next += sizeof(int64_t);
-                    }
-                } else {
-                    MX_SKIP(sizeof(int64_t) * rslt->v.len);
-                }
-                break;
-            case O2_FLOAT:
-                rslt->v.len >>= 2; // byte count / 4
-                if (to_type != O2_FLOAT) {
-                    for (int i = 0; i < rslt->v.len; i++) {
-                        if (!convert_float(to_type, MX_FLOAT, sizeof(float)))
-                            return NULL;
-                        mx_data_next += sizeof(float);
-                    }
-                } else {
-                    MX_SKIP(sizeof(float) * rslt->v.len);
-                }
-                break;
-            case O2_DOUBLE:
-                rslt->v.len >>= 3; // byte count / 8
-                if (to_type != O2_DOUBLE) {
-                    for (int i = 0; i < rslt->v.len; i++) {
-                        if (!convert_float(to_type, MX_DOUBLE, sizeof(double)))
-                            return NULL;
-                        mx_data_next += sizeof(double);
-                    }
-                } else {
-                    MX_SKIP(sizeof(double) * rslt->v.len);
-                }
-                break;
-            default:
+        o2_type from_type = *mx_type_next++; // actual (in message) type
+        int elem_size;
+        switch (from_type) {
+            case O2_INT32: case O2_FLOAT: elem_size = 4; break;
+            case O2_INT64: case O2_DOUBLE: elem_size = 8; break;
+            default: return NULL;
+        }
+        rslt->v.len /= elem_size; // byte count to element count
+        if (to_type != from_type) {
+            if (!convert_vector(from_type, to_type, mx_data_next,
+                                rslt->v.len)) {
                 return NULL;
-                break;
+            }
+            mx_data_next += elem_size * rslt->v.len;
+        } else {
+            MX_SKIP(elem_size * rslt->v.len);
         }
         o2_context->argc--; // argv already has pointer to vector
     } else if (mx_vector_to_array) {
@@ -1215,31 +2017,29 @@ o2_arg_ptr o2_get_next(o2_type to_type)
         rslt->v.vi = (int32_t *) ARG_NEXT;
         rslt->v.typ = to_type; // now we know what the element type will be
         while (*mx_type_next != O2_ARRAY_END) {
-            switch (*mx_type_next++) {
-                case O2_INT32:
-                    convert_int(to_type, MX_INT32, sizeof(int32_t));
-                    mx_data_next += sizeof(int32_t);
-                    break;
-                case O2_INT64:
-                    convert_int(to_type, MX_INT64, sizeof(int64_t));
-                    mx_data_next += sizeof(int64_t);
-                    break;
-                case O2_FLOAT:
-                    convert_float(to_type, MX_FLOAT, sizeof(float));
-                    mx_data_next += sizeof(float);
-                    break;
-                case O2_DOUBLE:
-                    convert_float(to_type, MX_DOUBLE, sizeof(double));
-                    mx_data_next += sizeof(double);
-                    break;
-                default:
-                    return NULL; // bad type string (no ']') or bad types
+            // convert each run of elements of the same type at once
+            o2_type from_type = *mx_type_next;
+            int elem_size;
+            switch (from_type) {
+                case O2_INT32: case O2_FLOAT: elem_size = 4; break;
+                case O2_INT64: case O2_DOUBLE: elem_size = 8; break;
+                default: return NULL; // bad type string (no ']') or bad types
             }
-            rslt->v.len++;
-            if (mx_data_next > mx_barrier) {
+            int run = 1;
+            while (mx_type_next[run] == from_type) run++;
+            mx_type_next += run;
+            if (mx_data_next + run * elem_size > mx_barrier) {
                 mx_array_to_vector_pending = FALSE;
                 return NULL; // badly formatted message
             }
+            if (from_type == to_type) {
+                memcpy(ARG_NEXT, mx_data_next, run * elem_size);
+                o2_context->arg_data.length += run * elem_size;
+            } else {
+                convert_vector(from_type, to_type, mx_data_next, run);
+            }
+            mx_data_next += run * elem_size;
+            rslt->v.len += run;
         }
         mx_array_to_vector_pending = FALSE;
     } else {
@@ -1257,7 +2057,7 @@ o2_arg_ptr o2_get_next(o2_type to_type)
                 }
                 break;
             case O2_FALSE:
-                if (to_type != O2_TRUE) {
+                if (to_type != O2_FALSE) {
                     rslt = convert_int(to_type, 0, sizeof(int32_t));
                 }
                 break;
@@ -1384,6 +2184,411 @@ o2_arg_ptr o2_get_next(o2_type to_type)
 }
 
 
+// Decode plans: o2_get_next() decides what to do with each argument by
+// switching on both the message type and the requested type. A handler
+// with a type string gets the same pair of type strings over and over,
+// so the decision for each argument is made once and stored in a plan
+// as an op code. o2_decode_plan_extract() then builds argv with a
+// single switch per argument. Arrays and vectors are left to
+// o2_get_next() (see plan->generic).
+
+// op codes for decode plans:
+#define PLAN_NO_DATA 0 // argument has no data (T, F, N, I)
+#define PLAN_32 1      // pointer to 32-bit data in message
+#define PLAN_64 2      // pointer to 64-bit data in message
+#define PLAN_STRING 3  // pointer to string or symbol in message
+#define PLAN_BLOB 4    // pointer to blob in message
+#define PLAN_I_TO_H 5  // the following convert to a new value in arg_data
+#define PLAN_I_TO_F 6
+#define PLAN_I_TO_D 7
+#define PLAN_H_TO_I 8
+#define PLAN_H_TO_F 9
+#define PLAN_H_TO_D 10
+#define PLAN_F_TO_I 11
+#define PLAN_F_TO_H 12
+#define PLAN_F_TO_D 13
+#define PLAN_D_TO_I 14
+#define PLAN_D_TO_H 15
+#define PLAN_D_TO_F 16
+#define PLAN_INT32 17  // the following use convert_int() or convert_float()
+#define PLAN_INT64 18  //     for conversions to B, T and F, which depend
+#define PLAN_FLOAT 19  //     on the value (e.g. 0 cannot be coerced to T)
+#define PLAN_DOUBLE 20
+#define PLAN_TRUE 21
+#define PLAN_FALSE 22
+#define PLAN_MISMATCH -1 // the message type cannot be coerced
+#define PLAN_GENERIC -2  // array or vector: use o2_get_next()
+
+// find the op code to coerce from from_type to to_type
+//
+static int plan_op(o2_type from_type, o2_type to_type)
+{
+    if (from_type == O2_ARRAY_START || from_type == O2_ARRAY_END ||
+        from_type == O2_VECTOR || to_type == O2_ARRAY_START ||
+        to_type == O2_ARRAY_END || to_type == O2_VECTOR) {
+        return PLAN_GENERIC;
+    }
+    switch (from_type) {
+        case O2_INT32:
+            switch (to_type) {
+                case O2_INT32: return PLAN_32;
+                case O2_INT64: return PLAN_I_TO_H;
+                case O2_FLOAT: return PLAN_I_TO_F;
+                case O2_DOUBLE: case O2_TIME: return PLAN_I_TO_D;
+                case O2_BOOL: case O2_TRUE: case O2_FALSE: return PLAN_INT32;
+            }
+            break;
+        case O2_BOOL:
+            switch (to_type) {
+                case O2_BOOL: return PLAN_32;
+                case O2_INT32: case O2_INT64: case O2_FLOAT: case O2_DOUBLE:
+                case O2_TIME: case O2_TRUE: case O2_FALSE: return PLAN_INT32;
+            }
+            break;
+        case O2_INT64:
+            switch (to_type) {
+                case O2_INT64: return PLAN_64;
+                case O2_INT32: return PLAN_H_TO_I;
+                case O2_FLOAT: return PLAN_H_TO_F;
+                case O2_DOUBLE: case O2_TIME: return PLAN_H_TO_D;
+                case O2_BOOL: case O2_TRUE: case O2_FALSE: return PLAN_INT64;
+            }
+            break;
+        case O2_FLOAT:
+            switch (to_type) {
+                case O2_FLOAT: return PLAN_32;
+                case O2_INT32: return PLAN_F_TO_I;
+                case O2_INT64: return PLAN_F_TO_H;
+                case O2_DOUBLE: case O2_TIME: return PLAN_F_TO_D;
+                case O2_BOOL: case O2_TRUE: case O2_FALSE: return PLAN_FLOAT;
+            }
+            break;
+        case O2_DOUBLE:
+        case O2_TIME:
+            switch (to_type) {
+                case O2_DOUBLE: case O2_TIME: return PLAN_64;
+                case O2_INT32: return PLAN_D_TO_I;
+                case O2_INT64: return PLAN_D_TO_H;
+                case O2_FLOAT: return PLAN_D_TO_F;
+                case O2_BOOL: case O2_TRUE: case O2_FALSE: return PLAN_DOUBLE;
+            }
+            break;
+        case O2_TRUE:
+        case O2_FALSE:
+            if (to_type == from_type) return PLAN_NO_DATA;
+            switch (to_type) {
+                case O2_INT32: case O2_INT64: case O2_FLOAT: case O2_DOUBLE:
+                case O2_TIME: case O2_BOOL:
+                    return from_type == O2_TRUE ? PLAN_TRUE : PLAN_FALSE;
+            }
+            break;
+        case O2_STRING:
+        case O2_SYMBOL:
+            if (to_type == O2_STRING || to_type == O2_SYMBOL) {
+                return PLAN_STRING;
+            }
+            break;
+        case O2_CHAR:
+        case O2_MIDI:
+            if (to_type == from_type) return PLAN_32;
+            break;
+        case O2_BLOB:
+            if (to_type == O2_BLOB) return PLAN_BLOB;
+            break;
+        case O2_NIL:
+        case O2_INFINITUM:
+            if (to_type == from_type) return PLAN_NO_DATA;
+            break;
+        default: // let o2_get_next() report unknown types
+            return PLAN_GENERIC;
+    }
+    return PLAN_MISMATCH;
+}
+
+
+// minimum number of bytes of message data that op reads for an
+// argument of message type type (strings and blobs count as 4 bytes)
+//
+static int plan_data_size(int op, o2_type type)
+{
+    if (op == PLAN_NO_DATA || op == PLAN_TRUE || op == PLAN_FALSE) {
+        return 0;
+    } else if (op == PLAN_STRING || op == PLAN_BLOB) {
+        return sizeof(int32_t);
+    }
+    return (type == O2_INT64 || type == O2_DOUBLE || type == O2_TIME ?
+            sizeof(int64_t) : sizeof(int32_t));
+}
+
+
+// make a plan to extract arguments of type handler_types from messages
+// with type string msg_types (both without ','). The strings must have
+// the same length.
+//
+o2_decode_plan_ptr o2_decode_plan_new(const char *msg_types,
+                                      const char *handler_types)
+{
+    int types_len = (int) strlen(msg_types);
+    assert(types_len == (int) strlen(handler_types));
+    o2_decode_plan_ptr plan = (o2_decode_plan_ptr) O2_MALLOC(
+            offsetof(o2_decode_plan, ops) + types_len * 3 + 1);
+    plan->argc = types_len;
+    plan->generic = FALSE;
+    plan->data_len = 0;
+    plan->arg_len = 0;
+    memcpy(plan->ops + types_len, handler_types, types_len);
+    plan->types = plan->ops + types_len * 2;
+    memcpy(plan->types, msg_types, types_len + 1);
+    for (int i = 0; i < types_len; i++) {
+        int op = plan_op(msg_types[i], handler_types[i]);
+        if (op == PLAN_GENERIC) {
+            plan->generic = TRUE;
+            return plan;
+        } else if (op == PLAN_MISMATCH) {
+            plan->argc = -1;
+            return plan;
+        }
+        plan->ops[i] = op;
+        plan->data_len += plan_data_size(op, msg_types[i]);
+        if (op >= PLAN_I_TO_H) {
+            plan->arg_len += sizeof(int64_t); // at most 8 bytes per result
+        }
+    }
+    return plan;
+}
+
+
+void o2_decode_plan_free(o2_decode_plan_ptr plan)
+{
+    O2_FREE(plan);
+}
+
+
+// write the conversion of a from_type in the message to a new to_type
+// value in arg_data
+#define PLAN_CONVERT(from_type, to_type)                        \
+    rslt = ARG_NEXT;                                            \
+    ARG_DATA(rslt, to_type, (to_type) *((from_type *) data));   \
+    data += sizeof(from_type);                                  \
+    break;
+
+// check that the remaining arguments, starting with argument i at
+// data, fit in the message. data_left is the minimum size of their
+// data and is updated for the next argument. A long string or blob
+// moves the following arguments, so this is checked for every argument.
+#define PLAN_CHECK_BOUNDS(i)                                    \
+    if (data + data_left > barrier) return O2_FAIL;             \
+    data_left -= plan_data_size(plan->ops[i], plan->types[i]);
+
+// skip a string at data, which must end before barrier
+#define PLAN_SKIP_STRING                                        \
+    char *end = (char *) memchr(data, 0, barrier - data);       \
+    if (!end) return O2_FAIL;                                   \
+    data += (end - data + 4) & ~3;
+
+// check the size of a blob at data before skipping it
+#define PLAN_BLOB_SIZE_OK(blob) \
+    ((int32_t) (blob)->size >= 0 && \
+     (int32_t) (blob)->size <= barrier - data - (int) sizeof(uint32_t))
+
+/// build o2_context->argv and argc for msg following plan, which
+/// must not be generic. types points to the type string after ','.
+/// Returns O2_FAIL if msg is malformed or an argument cannot be coerced.
+//
+int o2_decode_plan_extract(o2_decode_plan_ptr plan, o2_msg_data_ptr msg,
+                           const char *types)
+{
+    int argc = plan->argc;
+    char *data = WORD_ALIGN_PTR(types + argc + 4);
+    char *barrier = WORD_ALIGN_PTR(PTR(msg) + MSG_DATA_LENGTH(msg));
+    int data_left = plan->data_len;
+    need_argv(argc, plan->arg_len);
+    o2_arg_ptr *argv = o2_context->argv;
+    char *to_types = plan->ops + argc;
+    for (int i = 0; i < argc; i++) {
+        o2_arg_ptr rslt = (o2_arg_ptr) data;
+        PLAN_CHECK_BOUNDS(i)
+        switch (plan->ops[i]) {
+            case PLAN_NO_DATA: break;
+            case PLAN_32: data += sizeof(int32_t); break;
+            case PLAN_64: data += sizeof(int64_t); break;
+            case PLAN_STRING: {
+                PLAN_SKIP_STRING
+                break;
+            }
+            case PLAN_BLOB:
+                if (!PLAN_BLOB_SIZE_OK(&rslt->b)) return O2_FAIL;
+                data += (sizeof(uint32_t) + rslt->b.size + 3) & ~3;
+                if (data > barrier) return O2_FAIL;
+                break;
+            case PLAN_I_TO_H: PLAN_CONVERT(int32_t, int64_t)
+            case PLAN_I_TO_F: PLAN_CONVERT(int32_t, float)
+            case PLAN_I_TO_D: PLAN_CONVERT(int32_t, double)
+            case PLAN_H_TO_I: PLAN_CONVERT(int64_t, int32_t)
+            case PLAN_H_TO_F: PLAN_CONVERT(int64_t, float)
+            case PLAN_H_TO_D: PLAN_CONVERT(int64_t, double)
+            case PLAN_F_TO_I: PLAN_CONVERT(float, int32_t)
+            case PLAN_F_TO_H: PLAN_CONVERT(float, int64_t)
+            case PLAN_F_TO_D: PLAN_CONVERT(float, double)
+            case PLAN_D_TO_I: PLAN_CONVERT(double, int32_t)
+            case PLAN_D_TO_H: PLAN_CONVERT(double, int64_t)
+            case PLAN_D_TO_F: PLAN_CONVERT(double, float)
+            case PLAN_INT32:
+                rslt = convert_int(to_types[i], *((int32_t *) data),
+                                   sizeof(int32_t));
+                data += sizeof(int32_t);
+                break;
+            case PLAN_INT64:
+                rslt = convert_int(to_types[i], *((int64_t *) data),
+                                   sizeof(int64_t));
+                data += sizeof(int64_t);
+                break;
+            case PLAN_FLOAT:
+                rslt = convert_float(to_types[i], *((float *) data),
+                                     sizeof(float));
+                data += sizeof(float);
+                break;
+            case PLAN_DOUBLE:
+                rslt = convert_float(to_types[i], *((double *) data),
+                                     sizeof(double));
+                data += sizeof(double);
+                break;
+            case PLAN_TRUE:
+                rslt = convert_int(to_types[i], 1, sizeof(int32_t));
+                break;
+            case PLAN_FALSE:
+                rslt = convert_int(to_types[i], 0, sizeof(int32_t));
+                break;
+        }
+        if (!rslt) return O2_FAIL; // e.g. 0 cannot be coerced to T
+        argv[i] = rslt;
+    }
+    o2_context->argv_data.length = argc;
+    o2_context->argc = argc;
+    return O2_SUCCESS;
+}
+
+
+/// size of the struct field that o2_decode_plan_to_struct() writes for
+/// type, or -1 if type cannot be decoded into a struct
+//
+int o2_struct_field_size(o2_type type)
+{
+    switch (type) {
+        case O2_INT32: case O2_FLOAT: case O2_CHAR: case O2_MIDI:
+        case O2_BOOL:
+            return sizeof(int32_t);
+        case O2_INT64: case O2_DOUBLE: case O2_TIME:
+            return sizeof(int64_t);
+        case O2_STRING: case O2_SYMBOL:
+            return sizeof(char *);
+        case O2_BLOB:
+            return sizeof(o2_blob_ptr);
+        case O2_TRUE: case O2_FALSE: case O2_NIL: case O2_INFINITUM:
+            return 0; // the type code is the value
+        default: // arrays and vectors
+            return -1;
+    }
+}
+
+
+// write the conversion of a from_type in the message to a to_type field
+#define STRUCT_CONVERT(from_type, to_type)                      \
+    *((to_type *) field) = (to_type) *((from_type *) data);     \
+    data += sizeof(from_type);                                  \
+    break;
+
+/// decode msg into a struct following plan, which must not be generic.
+/// Argument i is written at offsets[i] in buffer: numbers are stored as
+/// the handler types, strings as char * and blobs as o2_blob_ptr (both
+/// pointing into msg). types points to the type string after ','.
+/// Returns O2_FAIL if msg is malformed or an argument cannot be coerced.
+//
+int o2_decode_plan_to_struct(o2_decode_plan_ptr plan, o2_msg_data_ptr msg,
+                             const char *types, const int *offsets,
+                             char *buffer)
+{
+    int argc = plan->argc;
+    char *data = WORD_ALIGN_PTR(types + argc + 4);
+    char *barrier = WORD_ALIGN_PTR(PTR(msg) + MSG_DATA_LENGTH(msg));
+    int data_left = plan->data_len;
+    char *to_types = plan->ops + argc;
+    for (int i = 0; i < argc; i++) {
+        char *field = buffer + offsets[i];
+        o2_arg_ptr rslt;
+        PLAN_CHECK_BOUNDS(i)
+        switch (plan->ops[i]) {
+            case PLAN_NO_DATA: break;
+            case PLAN_32:
+                memcpy(field, data, sizeof(int32_t));
+                data += sizeof(int32_t);
+                break;
+            case PLAN_64:
+                memcpy(field, data, sizeof(int64_t));
+                data += sizeof(int64_t);
+                break;
+            case PLAN_STRING: {
+                *((char **) field) = data;
+                PLAN_SKIP_STRING
+                break;
+            }
+            case PLAN_BLOB:
+                if (!PLAN_BLOB_SIZE_OK((o2_blob_ptr) data)) return O2_FAIL;
+                *((o2_blob_ptr *) field) = (o2_blob_ptr) data;
+                data += (sizeof(uint32_t) + ((o2_blob_ptr) data)->size + 3) & ~3;
+                if (data > barrier) return O2_FAIL;
+                break;
+            case PLAN_I_TO_H: STRUCT_CONVERT(int32_t, int64_t)
+            case PLAN_I_TO_F: STRUCT_CONVERT(int32_t, float)
+            case PLAN_I_TO_D: STRUCT_CONVERT(int32_t, double)
+            case PLAN_H_TO_I: STRUCT_CONVERT(int64_t, int32_t)
+            case PLAN_H_TO_F: STRUCT_CONVERT(int64_t, float)
+            case PLAN_H_TO_D: STRUCT_CONVERT(int64_t, double)
+            case PLAN_F_TO_I: STRUCT_CONVERT(float, int32_t)
+            case PLAN_F_TO_H: STRUCT_CONVERT(float, int64_t)
+            case PLAN_F_TO_D: STRUCT_CONVERT(float, double)
+            case PLAN_D_TO_I: STRUCT_CONVERT(double, int32_t)
+            case PLAN_D_TO_H: STRUCT_CONVERT(double, int64_t)
+            case PLAN_D_TO_F: STRUCT_CONVERT(double, float)
+            default: // conversions involving B, T or F are rare, so
+                // convert into arg_data and copy the result
+                need_argv(0, sizeof(int64_t));
+                switch (plan->ops[i]) {
+                    case PLAN_INT32:
+                        rslt = convert_int(to_types[i], *((int32_t *) data),
+                                           sizeof(int32_t));
+                        data += sizeof(int32_t);
+                        break;
+                    case PLAN_INT64:
+                        rslt = convert_int(to_types[i], *((int64_t *) data),
+                                           sizeof(int64_t));
+                        data += sizeof(int64_t);
+                        break;
+                    case PLAN_FLOAT:
+                        rslt = convert_float(to_types[i], *((float *) data),
+                                             sizeof(float));
+                        data += sizeof(float);
+                        break;
+                    case PLAN_DOUBLE:
+                        rslt = convert_float(to_types[i], *((double *) data),
+                                             sizeof(double));
+                        data += sizeof(double);
+                        break;
+                    default: // PLAN_TRUE or PLAN_FALSE
+                        rslt = convert_int(to_types[i],
+                                           plan->ops[i] == PLAN_TRUE,
+                                           sizeof(int32_t));
+                        break;
+                }
+                if (!rslt) return O2_FAIL; // e.g. 0 cannot be coerced to T
+                memcpy(field, rslt, o2_struct_field_size(to_types[i]));
+                break;
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
 // o2_msg_data_print_2 - print message as text to stdout
 //
 // It would be most convenient to use o2_extract_start() and o2_get_next()
@@ -1559,10 +2764,14 @@ int o2_message_deliver(o2n_info_ptr info)
         case INFO_UDP_SOCKET:
         case INFO_TCP_NOCLOCK:
         case INFO_TCP_SOCKET:
-            // make sure endian is compatible
+            // make sure endian is compatible: the message is in network
+            // byte order unless the sender knew we have its byte order
 #if IS_LITTLE_ENDIAN
-            o2_msg_swap_endian(&(info->in_message->data), FALSE);
+            if (!(info->in_message->flags & O2_MSG_HOST_ORDER)) {
+                o2_msg_swap_endian(&(info->in_message->data), FALSE);
+            }
 #endif
+            info->in_message->flags &= ~O2_MSG_HOST_ORDER;
 
             O2_DBr(if (info->in_message->data.address[1] != '_' &&
                        !isdigit(info->in_message->data.address[1]))
@@ -1573,13 +2782,19 @@ int o2_message_deliver(o2n_info_ptr info)
                         o2_dbg_msg("msg received", &info->in_message->data,
                                    "type", o2_tag_to_string(info->tag)));
             o2_message_source = info;
-            o2_message_send_sched(info->in_message, TRUE);
+            { // the message is no longer info's: a handler may remove info
+                o2_message_ptr msg = info->in_message;
+                info->in_message = NULL;
+                o2_message_send_sched(msg, TRUE);
+            }
             break;
         case INFO_OSC_TCP_CLIENT:
         case INFO_OSC_UDP_SERVER:
             return o2_deliver_osc(info);
         case INFO_OSC_TCP_SERVER: // should be impossible for a server
         case INFO_TCP_SERVER:     // socket to receive a message
+        case INFO_UNIX_SERVER:
+        case INFO_SHM_DOORBELL:
         default: // bad tag indicates internal error
             assert(FALSE);
         case INFO_OSC_TCP_CONNECTING:
@@ -22,6 +22,8 @@ void o2_argv_initialize(void);
 
 void o2_argv_finish(void);
 
+void o2_message_pool_finish(void);
+
 /* MESSAGE CONSTRUCTION */
 int o2_add_bundle_head(int64_t time);
 
@@ -59,6 +61,37 @@ o2_message_ptr o2_alloc_size_message(int size);
 
 int o2_message_deliver(o2n_info_ptr info);
 
+/* flags in o2_message */
+#define O2_MSG_VIEW 1 // data holds only timestamp and address (see below)
+#define O2_MSG_NET_ORDER 2 // built in network byte order by o2_send()
+#define O2_MSG_HOST_ORDER 4 // sent or received in host byte order because
+                            // the remote process has the same byte order
+#define O2_MSG_POOLED 8 // allocated from a message pool
+
+/* a view holds a reference to the message containing the rest of its
+ * data: tail_len bytes at tail (the type string and data) */
+typedef struct o2_view_info {
+    o2_message_ptr base;
+    char *tail;
+    int32_t tail_len;
+} o2_view_info, *o2_view_info_ptr;
+
+o2_view_info_ptr o2_get_view_info(o2_message_ptr view);
+
+/* make a view of an element of a bundle: base is the bundle message */
+o2_message_ptr o2_view_new(o2_message_ptr base, o2_msg_data_ptr embedded,
+                           int tcp_flag);
+
+/* return a private copy of msg if it is shared or a view, otherwise msg */
+o2_message_ptr o2_message_unshare(o2_message_ptr msg);
+
+/* prepare a view to be sent by TCP in network byte order */
+void o2_view_to_network(o2_message_ptr view);
+
+/* get the message that contains an o2_msg_data */
+#define MSG_CONTAINER(msg) \
+    ((o2_message_ptr) (PTR(msg) - offsetof(o2_message, data)))
+
 
 /* free a message and all the messages it links to */
 void o2_message_list_free(o2_message_ptr msg);
@@ -77,10 +110,61 @@ int o2_strsize(const char *s);
  */
 int o2_msg_swap_endian(o2_msg_data_ptr msg, int is_host_order);
 
+/* swap the byte order of n 32-bit or 64-bit values in place */
+void o2_swap32_array(void *data, int n);
+
+void o2_swap64_array(void *data, int n);
+
 int o2_message_build(o2_message_ptr *msg, o2_time timestamp,
                      const char *service_name,
                      const char *path, const char *typestring,
-                     int tcp_flag, va_list ap);
+                     int tcp_flag, int net_order, va_list ap);
+
+/* a template for o2_template_send(): header holds the address and type
+ * string exactly as they appear in the message. The service found for
+ * the address is valid while generation == o2_services_generation. */
+typedef struct o2_template {
+    int tcp_flag;
+    int header_size; // size of padded address and padded type string
+    int types_offset; // where the type string (after ',') is in header
+    int data_len;    // size of the data, not counting strings and blobs
+    int varsize;     // TRUE if the type string contains strings or blobs
+    int generation;
+    o2_node_ptr service;
+    services_entry_ptr services;
+    char header[4];  // actual size is header_size
+} o2_template;
+
+int o2_template_build(o2_message_ptr *msg, o2_template_ptr tpl,
+                      o2_time timestamp, int net_order, va_list ap);
+
+/* a decode plan says how to build argv for a handler from messages
+ * with a given type string. Each handler keeps a few plans (see
+ * handler_entry in o2_search.h). */
+typedef struct o2_decode_plan {
+    int argc;     // number of arguments, or -1 if types cannot be coerced
+    int generic;  // TRUE if there are arrays or vectors: use o2_get_next()
+    int data_len; // minimum size of the message data (strings and blobs
+                  //   count as 4 bytes)
+    int arg_len;  // space needed in arg_data for coerced values
+    char *types;  // the message type string (points into ops)
+    char ops[4];  // actual size is 3 * argc + 1: argc op codes, argc
+                  // handler types, then the message type string
+} o2_decode_plan;
+
+o2_decode_plan_ptr o2_decode_plan_new(const char *msg_types,
+                                      const char *handler_types);
+
+void o2_decode_plan_free(o2_decode_plan_ptr plan);
+
+int o2_decode_plan_extract(o2_decode_plan_ptr plan, o2_msg_data_ptr msg,
+                           const char *types);
+
+int o2_struct_field_size(o2_type type);
+
+int o2_decode_plan_to_struct(o2_decode_plan_ptr plan, o2_msg_data_ptr msg,
+                             const char *types, const int *offsets,
+                             char *buffer);
 
 /**
  * Print o2_msg_data to stdout
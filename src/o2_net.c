@@ -3,6 +3,9 @@
 // Roger B. Dannenberg, 2019
 //
 
+#ifdef __linux__
+#define _GNU_SOURCE // for recvmmsg() and sendmmsg()
+#endif
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <ctype.h>
@@ -39,10 +42,131 @@ typedef struct ifaddrs
 #else
 #include "sys/ioctl.h"
 #include <ifaddrs.h>
+#ifdef __linux__
+#include <stddef.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#endif
 #define TERMINATING_SOCKET_ERROR \
     (errno != EAGAIN && errno != EINTR)
 #endif
 
+#ifdef O2_EPOLL
+#include <sys/epoll.h>
+// how many events to retrieve with each call to epoll_wait(). If more
+// sockets are ready, they are reported by the next call.
+#define O2N_EPOLL_MAX_EVENTS 64
+static int o2n_epoll_fd = -1;
+// events returned by the most recent epoll_wait(); entries are
+// cleared by o2_socket_remove() so that we never dispatch to a freed info
+static struct epoll_event o2n_epoll_events[O2N_EPOLL_MAX_EVENTS];
+static int o2n_epoll_count = 0;
+#endif
+
+#ifdef O2_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// TRUE if the io_uring backend was set up by o2n_initialize(); if the
+// kernel does not support it, we use epoll() or poll() instead
+static int o2n_use_uring = FALSE;
+struct uring_handle;
+static void uring_socket_new(o2n_info_ptr info);
+static void uring_socket_remove(o2n_info_ptr info, SOCKET sock);
+static void uring_pollout(o2n_info_ptr info);
+static void uring_initialize();
+static void uring_finish();
+static void uring_flush();
+static void uring_wait(int msec);
+static int recv_by_uring();
+#endif
+
+#ifdef __linux__
+// receive UDP messages in batches with recvmmsg(). Each datagram is
+// received directly into one of udp_recv_msgs, preallocated messages
+// from the message pool, so most datagrams are never copied. Bytes that
+// do not fit go to the datagram's slot in udp_batch_buffer (up to
+// O2_MAX_MSG_SIZE in all), and only then is the datagram copied into a
+// bigger message. Both are allocated on first use and freed by
+// o2n_finish(). At most O2N_UDP_MAX_BATCHES batches are received per
+// readiness event so that a UDP flood cannot starve other sockets; the
+// next poll picks up the rest.
+#define O2N_UDP_BATCH 16
+#define O2N_UDP_MAX_BATCHES 4
+#define O2N_UDP_RECV_SIZE 1500 // typical datagrams fit in one message
+static o2_message_ptr udp_recv_msgs[O2N_UDP_BATCH];
+static char *udp_batch_buffer = NULL;
+#endif
+
+// maximum number of messages gathered into one sendmsg() by o2n_send()
+#define O2N_SEND_IOV 64
+#ifdef WIN32
+typedef WSABUF o2n_iovec;
+#define IOV_BASE buf
+#define IOV_LEN len
+#else
+typedef struct iovec o2n_iovec;
+#define IOV_BASE iov_base
+#define IOV_LEN iov_len
+#endif
+
+#ifdef __linux__
+// shared memory rings to processes on this host (see below)
+struct o2n_shm;
+// eventfd that peers write to wake us, or INVALID_SOCKET if this process
+// does not use shared memory
+static SOCKET o2n_shm_doorbell = INVALID_SOCKET;
+static void shm_initialize();
+static void shm_free(o2n_info_ptr info);
+static int shm_write(o2n_info_ptr info, o2n_iovec *iov, int n_iov, int n,
+                     int block, int *full);
+static int shm_read(o2n_info_ptr info);
+static int shm_poll();
+static int shm_idle_begin();
+static void shm_idle_end();
+static int unix_recv(SOCKET sock, o2n_info_ptr info, char *buf, int len);
+#endif
+
+// if TRUE, messages from o2n_enqueue() are sent by o2n_tcp_flush()
+// at the end of o2_poll() rather than immediately
+int o2n_tcp_deferred = FALSE;
+
+// high and low watermarks (in bytes) for o2n_info.out_bytes; when
+// o2n_queue_high is zero, queues are not limited and nobody is notified
+int o2n_queue_high = 0;
+static int o2n_queue_low = 0;
+static o2_queue_callback o2n_queue_callback = NULL;
+static void *o2n_queue_user_data = NULL;
+
+// size of the per-connection TCP receive buffer (o2n_info.in_buffer)
+#define O2N_IN_BUFFER_SIZE 4096
+
+// set in the length that precedes a message in a stream if the message
+// is in the byte order of the sender rather than network byte order.
+// This is only done when the receiver has the same byte order (see
+// o2n_enqueue()), so the receiver does not swap the message.
+#define O2N_HOST_ORDER 0x40000000
+
+// the info whose messages are being delivered by read_stream(), or NULL
+// if a handler removed it (see o2_socket_remove())
+static o2n_info_ptr stream_info = NULL;
+
+// returned by stream_parse() and big_message_got() if a handler removed
+// info (or called o2_finish()) so that the caller must stop using info
+#define STREAM_GONE 1
+
+// TRUE if o2n_recv() should use epoll() rather than poll(). Only
+// meaningful if compiled with O2_EPOLL, in which case epoll is the default.
+#ifdef O2_EPOLL
+static int o2n_use_epoll = TRUE;
+// TRUE if epoll_create1() failed: we use poll() and cannot switch back
+static int o2n_epoll_unavailable = FALSE;
+#else
+static int o2n_use_epoll = FALSE;
+#endif
+
 char o2_local_ip[24];
 int o2_local_tcp_port = 0;
 // we have not been able to connect to network
@@ -56,6 +180,7 @@ static struct sockaddr_in o2_serv_addr;
 //static int udp_recv_handler(SOCKET sock, o2n_info_ptr info);
 //static void tcp_message_cleanup(o2n_info_ptr info);
 static int read_event_handler(SOCKET sock, o2n_info_ptr info);
+static void events_set(struct pollfd *pfd, o2n_info_ptr info, short events);
 
 // a socket for sending broadcast messages:
 SOCKET o2n_broadcast_sock = INVALID_SOCKET;
@@ -69,6 +194,15 @@ static struct sockaddr_in local_to_addr;
 
 int o2n_socket_delete_flag = FALSE;
 
+// byte count that forces o2n_udp_flush(); 0 means UDP sends are not batched
+int o2n_udp_batch_limit = 0;
+// maximum number of messages in a UDP batch (one sendmmsg() call)
+#define O2N_UDP_SEND_BATCH 64
+// statistics for batched UDP sends
+static int64_t udp_batch_count = 0;    // number of batches flushed
+static int64_t udp_batch_messages = 0; // number of messages in all batches
+static int udp_batch_largest = 0;      // most messages in one batch
+
 o2n_info_ptr o2_message_source = NULL; ///< socket info for current message
 
 // this indirection is used so that testing code can grab incoming messages
@@ -134,6 +268,27 @@ static int bind_recv_socket(SOCKET sock, int *port, int tcp_recv_flag)
 }
 
 
+#ifdef O2_EPOLL
+// add, modify or delete (op) the epoll registration of sock. events
+// uses poll() bits (POLLIN, POLLOUT), which are translated to epoll bits.
+//
+static void epoll_update(int op, SOCKET sock, o2n_info_ptr info, short events)
+{
+    if (o2n_epoll_fd < 0) return; // epoll is unavailable, we use poll()
+    struct epoll_event ev;
+    ev.events = ((events & POLLIN) ? EPOLLIN : 0) |
+                ((events & POLLOUT) ? EPOLLOUT : 0);
+    if (info->net_tag == NET_EVENT) { // every write is a new edge, so
+        ev.events |= EPOLLET;         // we never have to read to reset it
+    }
+    ev.data.ptr = info;
+    if (epoll_ctl(o2n_epoll_fd, op, sock, &ev) < 0) {
+        perror("epoll_ctl");
+    }
+}
+#endif
+
+
 // add a new socket to the fds and fds_info arrays,
 // on success, o2n_info_ptr descriptor is initialized and
 // the proc.uses_hub is set to O2_NO_HUB
@@ -159,6 +314,12 @@ static o2n_info_ptr socket_info_new(SOCKET sock, int tag, int net_tag)
     pfd->fd = sock;
     pfd->events = POLLIN;
     pfd->revents = 0;
+#ifdef O2_EPOLL
+    epoll_update(EPOLL_CTL_ADD, sock, info, POLLIN);
+#endif
+#ifdef O2_IO_URING
+    if (o2n_use_uring) uring_socket_new(info);
+#endif
     return info;
 }
 
@@ -225,6 +386,122 @@ int o2n_broadcast_socket_new(SOCKET *sock)
 }
 
 
+#ifdef __linux__
+// Processes on the same host communicate through AF_UNIX sockets in the
+// abstract namespace rather than through TCP and UDP over loopback.
+// Addresses are derived from the TCP server port, which is unique on the
+// host: "o2-PORT" accepts stream connections and "o2-PORT-dg" receives
+// datagrams. (UDP receive ports are not unique because processes can
+// share a discovery port.)
+
+// a socket for sending datagrams to processes on this host, or
+// INVALID_SOCKET if this process has no AF_UNIX sockets
+static SOCKET o2n_unix_send_sock = INVALID_SOCKET;
+
+// set *sa to the abstract address for the process with TCP server port
+// port. Returns the length of the address.
+//
+static socklen_t unix_address(struct sockaddr_un *sa, int port, int dgram)
+{
+    memset(sa, 0, sizeof(struct sockaddr_un));
+    sa->sun_family = AF_UNIX;
+    // sun_path[0] is 0 to indicate the abstract namespace
+    int len = snprintf(sa->sun_path + 1, sizeof(sa->sun_path) - 1,
+                       dgram ? "o2-%d-dg" : "o2-%d", port);
+    return (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+
+// create AF_UNIX server, datagram receive and datagram send sockets. If
+// this fails, other processes on this host will use TCP and UDP, so it
+// is not an error.
+//
+static void unix_sockets_new()
+{
+    struct sockaddr_un sa;
+    SOCKET server = socket(AF_UNIX, SOCK_STREAM, 0);
+    SOCKET dgram = socket(AF_UNIX, SOCK_DGRAM, 0);
+    SOCKET send_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (server == INVALID_SOCKET || dgram == INVALID_SOCKET ||
+        send_sock == INVALID_SOCKET ||
+        bind(server, (struct sockaddr *) &sa,
+             unix_address(&sa, o2_local_tcp_port, FALSE)) ||
+        listen(server, 10) ||
+        bind(dgram, (struct sockaddr *) &sa,
+             unix_address(&sa, o2_local_tcp_port, TRUE))) {
+        O2_DBo(perror("creating AF_UNIX sockets"));
+        if (server != INVALID_SOCKET) closesocket(server);
+        if (dgram != INVALID_SOCKET) closesocket(dgram);
+        if (send_sock != INVALID_SOCKET) closesocket(send_sock);
+        return;
+    }
+    fcntl(server, F_SETFL, O_NONBLOCK);
+    socket_info_new(server, INFO_UNIX_SERVER, NET_TCP_SERVER);
+    socket_info_new(dgram, INFO_UDP_SOCKET, NET_UDP_SOCKET);
+    o2n_unix_send_sock = send_sock;
+    O2_DBo(printf("%s created AF_UNIX server socket %ld and datagram "
+                  "socket %ld for port %d\n", o2_debug_prefix, (long) server,
+                  (long) dgram, o2_local_tcp_port));
+}
+
+
+// connect to the AF_UNIX server of the process on this host whose TCP
+// server port is tcp_port. Returns O2_FAIL if that process has no
+// AF_UNIX server or the connection cannot be made immediately.
+//
+static int unix_connect(int tcp_port, int tag)
+{
+    struct sockaddr_un sa;
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return O2_FAIL;
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+    if (connect(sock, (struct sockaddr *) &sa,
+                unix_address(&sa, tcp_port, FALSE)) == -1) {
+        O2_DBo(printf("%s AF_UNIX connect to port %d failed (%s), using "
+                      "TCP\n", o2_debug_prefix, tcp_port, strerror(errno)));
+        closesocket(sock);
+        return O2_FAIL;
+    }
+    // connected already, as a TCP connection to localhost usually is
+    o2n_info_ptr info = socket_info_new(sock, tag, NET_TCP_CLIENT);
+    info->is_unix = TRUE;
+    O2_DBo(printf("%s connected to port %d with AF_UNIX socket %ld index %d\n",
+                  o2_debug_prefix, tcp_port, (long) sock, info->fds_index));
+    return O2_SUCCESS;
+}
+
+
+int o2n_unix_udp_send(o2_message_ptr msg, o2n_info_ptr proc)
+{
+    struct sockaddr_un sa;
+    socklen_t len = unix_address(&sa, proc->unix_port, TRUE);
+    int rslt = (int) sendto(o2n_unix_send_sock, (char *) &(msg->data),
+                            msg->length, MSG_DONTWAIT,
+                            (struct sockaddr *) &sa, len);
+    if (rslt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // an AF_UNIX datagram socket holds only a few messages
+        // (net.unix.max_dgram_qlen, often 10), so when the receiver is
+        // not keeping up, use its UDP socket, which holds many more.
+        // Messages already queued here would be delivered after this
+        // one, so keep using UDP for this process from now on to send
+        // messages in order, as loopback UDP always has.
+        O2_DBn(printf("%s o2n_unix_udp_send: port %d is full, sending by "
+                      "UDP from now on\n", o2_debug_prefix, proc->unix_port));
+        proc->unix_port = 0;
+        return o2n_udp_send(msg, &(proc->proc.udp_sa));
+    }
+    o2_message_free(msg);
+    if (rslt < 0) {
+        O2_DBn(printf("o2n_unix_udp_send error, port %d\n",
+                      proc->unix_port));
+        perror("o2n_unix_udp_send");
+        return O2_FAIL;
+    }
+    return O2_SUCCESS;
+}
+#endif
+
+
 // this is really a higher-level protocol function because the name
 // is only needed by O2, not by low-level communication functions,
 // but since it takes low-level digging around to get the IP address
@@ -303,6 +580,29 @@ int o2n_initialize()
 
     DA_INIT(o2_context->fds, struct pollfd, 5);
     DA_INIT(o2_context->fds_info, o2n_info_ptr, 5);
+    DA_INIT(o2_context->udp_batch, o2n_udp_pending, 0);
+    DA_INIT(o2_context->tcp_flush, o2n_info_ptr, 0);
+    DA_INIT(o2_context->shm_peers, o2n_info_ptr, 0);
+    o2_context->udp_batch_bytes = 0;
+#ifdef O2_IO_URING
+    uring_initialize();
+#endif
+#ifdef O2_EPOLL
+#ifdef O2_IO_URING
+    if (o2n_use_uring) { // sockets are not polled, so do not register
+        o2n_epoll_unavailable = TRUE; // them with epoll either
+        o2n_use_epoll = FALSE;
+    } else
+#endif
+    if ((o2n_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("epoll_create1, using poll() instead");
+        o2n_epoll_unavailable = TRUE;
+        o2n_use_epoll = FALSE;
+    } else {
+        o2n_epoll_unavailable = FALSE;
+    }
+    o2n_epoll_count = 0;
+#endif
 
     RETURN_IF_ERROR(o2n_tcp_server_new(INFO_TCP_SERVER, &o2_local_tcp_port));
     o2_context->info = *DA_LAST(o2_context->fds_info, o2n_info_ptr);
@@ -311,6 +611,10 @@ int o2n_initialize()
     // still use O2 locally without an IP address.
 
     set_local_process_name(o2_context->info);
+#ifdef __linux__
+    unix_sockets_new();
+    shm_initialize();
+#endif
     o2n_send_by_tcp = &o2_message_deliver;
     return O2_SUCCESS;
 }
@@ -324,16 +628,49 @@ void o2n_finish()
     // local process name was removed as part of tcp server removal
     // tcp server socket was removed already by o2_finish
     // udp receive socket was removed already by o2_finish
+    o2n_udp_flush(); // send anything that is batched before we close
+    DA_FINISH(o2_context->udp_batch);
+    DA_FINISH(o2_context->tcp_flush);
+    DA_FINISH(o2_context->shm_peers);
     DA_FINISH(o2_context->fds_info);
     DA_FINISH(o2_context->fds);
     if (o2n_udp_send_sock != INVALID_SOCKET) {
         closesocket(o2n_udp_send_sock);
         o2n_udp_send_sock = INVALID_SOCKET;
     }
+#ifdef __linux__
+    if (o2n_unix_send_sock != INVALID_SOCKET) {
+        closesocket(o2n_unix_send_sock);
+        o2n_unix_send_sock = INVALID_SOCKET;
+    }
+    o2n_shm_doorbell = INVALID_SOCKET; // closed when its info was removed
+#endif
     if (o2n_broadcast_sock != INVALID_SOCKET) {
         closesocket(o2n_broadcast_sock);
         o2n_broadcast_sock = INVALID_SOCKET;
     }
+#ifdef O2_EPOLL
+    if (o2n_epoll_fd >= 0) {
+        close(o2n_epoll_fd);
+        o2n_epoll_fd = -1;
+    }
+    o2n_epoll_count = 0;
+#endif
+#ifdef O2_IO_URING
+    uring_finish();
+#endif
+#ifdef __linux__
+    if (udp_batch_buffer) {
+        O2_FREE(udp_batch_buffer);
+        udp_batch_buffer = NULL;
+    }
+    for (int i = 0; i < O2N_UDP_BATCH; i++) {
+        if (udp_recv_msgs[i]) {
+            o2_message_free(udp_recv_msgs[i]);
+            udp_recv_msgs[i] = NULL;
+        }
+    }
+#endif
 #ifdef WIN32
     WSACleanup();    
 #endif
@@ -373,6 +710,44 @@ void o2n_info_mark_to_free(o2n_info_ptr info)
 }
 
 
+// change the events we are waiting for on a socket; pfd is the element
+// of o2_context->fds that corresponds to info
+//
+static void events_set(struct pollfd *pfd, o2n_info_ptr info, short events)
+{
+    if (pfd->events == events) return;
+    pfd->events = events;
+#ifdef O2_EPOLL
+    epoll_update(EPOLL_CTL_MOD, pfd->fd, info, events);
+#endif
+#ifdef O2_IO_URING
+    if (o2n_use_uring && (events & POLLOUT)) uring_pollout(info);
+#endif
+}
+
+
+int o2_use_epoll(int flag)
+{
+    int old = o2n_use_epoll;
+#ifndef O2_EPOLL
+    if (flag) return O2_FAIL;
+#else
+    if (flag && o2n_epoll_unavailable) return O2_FAIL;
+#endif
+    o2n_use_epoll = flag;
+    return old;
+}
+
+
+const char *o2_poll_backend()
+{
+#ifdef O2_IO_URING
+    if (o2n_use_uring) return "io_uring";
+#endif
+    return o2n_use_epoll ? "epoll" : "poll";
+}
+
+
 // remove a socket from o2_context->fds and o2_context->fds_info
 //
 void o2_socket_remove(o2n_info_ptr info)
@@ -384,8 +759,34 @@ void o2_socket_remove(o2n_info_ptr info)
                   o2_debug_prefix, GET_PROCESS(index)->tag, GET_PROCESS(index)->port,
                   (long long) pfd->fd, index));
     SOCKET sock = pfd->fd;
+#ifdef O2_EPOLL
+    epoll_update(EPOLL_CTL_DEL, sock, info, 0);
+    // info may be removed while o2n_recv() is dispatching a batch of
+    // events, so forget any events that are still pending for it
+    for (int i = 0; i < o2n_epoll_count; i++) {
+        if (o2n_epoll_events[i].data.ptr == info) {
+            o2n_epoll_events[i].data.ptr = NULL;
+        }
+    }
+#endif
+#ifdef O2_IO_URING
+    if (o2n_use_uring) uring_socket_remove(info, sock);
+#endif
 #ifdef SHUT_WR
     shutdown(sock, SHUT_WR);
+#endif
+    if (info == stream_info) stream_info = NULL;
+    if (info->flush_pending) { // forget about sending info's messages
+        for (int i = 0; i < o2_context->tcp_flush.length; i++) {
+            if (*DA_GET(o2_context->tcp_flush, o2n_info_ptr, i) == info) {
+                DA_REMOVE(o2_context->tcp_flush, o2n_info_ptr, i);
+                break;
+            }
+        }
+    }
+    if (info->in_buffer) O2_FREE(info->in_buffer);
+#ifdef __linux__
+    if (info->shm) shm_free(info);
 #endif
     O2_DBo(printf("calling closesocket(%lld).\n", (int64_t) (pfd->fd)));
     if (closesocket(pfd->fd)) perror("closing socket");
@@ -424,12 +825,21 @@ void o2n_free_deleted_sockets()
 //
 int o2n_connect(const char *ip, int tcp_port, int tag)
 {
+#ifdef __linux__
+    // O2 processes on this host are reached with AF_UNIX sockets if
+    // possible (OSC servers do not have them)
+    if (tag == INFO_TCP_NOCLOCK && o2n_unix_send_sock != INVALID_SOCKET &&
+        (streql(ip, o2_local_ip) || streql(ip, "127.0.0.1")) &&
+        unix_connect(tcp_port, tag) == O2_SUCCESS) {
+        return O2_SUCCESS;
+    }
+#endif
     struct sockaddr_in remote_addr;
     //set up the sockaddr_in
 #ifndef WIN32
     bzero(&remote_addr, sizeof(remote_addr));
 #endif
-    RETURN_IF_ERROR(o2n_tcp_socket_new(INFO_TCP_NOCLOCK, NET_TCP_CONNECTING, 0));
+    RETURN_IF_ERROR(o2n_tcp_socket_new(tag, NET_TCP_CONNECTING, 0));
     // set up the connection
     remote_addr.sin_family = AF_INET;      //AF_INET means using IPv4
     inet_pton(AF_INET, ip, &(remote_addr.sin_addr));
@@ -446,12 +856,23 @@ int o2n_connect(const char *ip, int tcp_port, int tag)
                 sizeof(remote_addr)) == -1) {
         if (errno != EINPROGRESS) {
             perror("Connect Error!\n");
+#ifdef O2_EPOLL
+            epoll_update(EPOLL_CTL_DEL, sock,
+                         *DA_LAST(o2_context->fds_info, o2n_info_ptr), 0);
+#endif
+#ifdef O2_IO_URING
+            if (o2n_use_uring) {
+                uring_socket_remove(*DA_LAST(o2_context->fds_info,
+                                             o2n_info_ptr), sock);
+            }
+#endif
             o2_context->fds_info.length--;   // restore socket arrays
             o2_context->fds.length--;
             return O2_FAIL;
         }
         // detect when we're connected by polling for writable
-        pfd->events |= POLLOUT;
+        events_set(pfd, *DA_LAST(o2_context->fds_info, o2n_info_ptr),
+                   pfd->events | POLLOUT);
     } else { // wow, we're already connected, not sure this is possible
         (*DA_LAST(o2_context->fds_info, o2n_info_ptr))->net_tag = NET_TCP_CLIENT;
         o2_disable_sigpipe(sock);
@@ -462,6 +883,138 @@ int o2n_connect(const char *ip, int tcp_port, int tag)
 }
 
 
+// change the congested state of info and tell the application
+//
+static void queue_congested(o2n_info_ptr info, int congested)
+{
+    info->congested = congested;
+    O2_DBs(printf("%s TCP send queue index %d %s with %d messages, "
+                  "%d bytes\n", o2_debug_prefix, info->fds_index,
+                  congested ? "congested" : "drained",
+                  info->out_count, info->out_bytes));
+    if (o2n_queue_callback) {
+        (*o2n_queue_callback)(TAG_IS_REMOTE(info->tag) ? info->proc.name :
+                              NULL, congested, o2n_queue_user_data);
+    }
+}
+
+
+// Gather the length and data of as many queued messages as will fit
+// in iov so that they can be sent with one call. The length field
+// immediately precedes the data, so each message needs only one iovec,
+// except that a view needs a second iovec for the part that is in its
+// base message. The first message may be partly sent already. Lengths
+// are converted to network byte order until out_messages_restore() is
+// called. Returns the number of iovecs, sets *n to the total byte count
+// and *n_msgs to the number of messages.
+//
+static int out_messages_gather(o2n_info_ptr info, o2n_iovec *iov, int *n,
+                               int *n_msgs)
+{
+    int n_iov = 0;
+    *n = 0;
+    *n_msgs = 0;
+    for (o2_message_ptr msg = info->out_message;
+         msg && n_iov < O2N_SEND_IOV - 1; msg = msg->next) {
+        int skip = (n_iov == 0 ? info->out_msg_sent : 0);
+        int len = msg->length + sizeof(int32_t);
+        *n += len - skip;
+        if (msg->flags & O2_MSG_VIEW) {
+            o2_view_info_ptr view = o2_get_view_info(msg);
+            int header_len = len - view->tail_len;
+            if (skip < header_len) {
+                iov[n_iov].IOV_BASE = ((char *) &(msg->length)) + skip;
+                iov[n_iov].IOV_LEN = header_len - skip;
+                n_iov++;
+                skip = 0;
+            } else {
+                skip -= header_len;
+            }
+            iov[n_iov].IOV_BASE = view->tail + skip;
+            iov[n_iov].IOV_LEN = view->tail_len - skip;
+        } else {
+            iov[n_iov].IOV_BASE = ((char *) &(msg->length)) + skip;
+            iov[n_iov].IOV_LEN = len - skip;
+        }
+        msg->length = htonl(msg->flags & O2_MSG_HOST_ORDER ?
+                            msg->length | O2N_HOST_ORDER : msg->length);
+        n_iov++;
+        (*n_msgs)++;
+    }
+    return n_iov;
+}
+
+
+// restore byte-swapped lengths of the first n_msgs queued messages
+//
+static void out_messages_restore(o2n_info_ptr info, int n_msgs)
+{
+    o2_message_ptr msg = info->out_message;
+    for (int i = 0; i < n_msgs; i++) {
+        msg->length = ntohl(msg->length) & ~O2N_HOST_ORDER;
+        msg = msg->next;
+    }
+}
+
+
+// account for the result (err) of sending n bytes gathered by
+// out_messages_gather(): free the messages that were completely sent,
+// or handle the error. Returns O2_SUCCESS if the caller should try to
+// send more, O2_BLOCKED if the socket is full and POLLOUT is requested,
+// or O2_FAIL if the connection is broken and info is marked to free.
+//
+static int out_messages_sent(o2n_info_ptr info, int err, int n, int block)
+{
+    struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd,
+                                info->fds_index);
+    if (err < 0) {
+        if (!block && !TERMINATING_SOCKET_ERROR) {
+            printf("setting POLLOUT on %d\n", info->fds_index);
+            // request event when it unblocks:
+            events_set(pfd, info, pfd->events | POLLOUT);
+            return O2_BLOCKED;
+        } else if (errno != EINTR && errno != EAGAIN) {
+            O2_DBo(printf("%s removing remote process after send error "
+                          "%d to socket %ld index %d\n", o2_debug_prefix,
+                          errno, (long) (pfd->fd), info->fds_index));
+            // queued messages are freed when info is removed
+            o2n_info_mark_to_free(info);
+            return O2_FAIL;
+        } // else EINTR or EAGAIN, so try again
+        return O2_SUCCESS;
+    }
+    // err >= 0, free the messages that were completely sent
+    int sent = err;
+    while (sent > 0) {
+        o2_message_ptr msg = info->out_message;
+        int rest = msg->length + sizeof(int32_t) - info->out_msg_sent;
+        if (sent < rest) { // partial message
+            info->out_msg_sent += sent;
+            break;
+        }
+        sent -= rest;
+        info->out_msg_sent = 0;
+        info->out_message = msg->next;
+        if (!info->out_message) info->out_tail = NULL;
+        info->out_count--;
+        info->out_bytes -= msg->length + sizeof(int32_t);
+        o2_message_free(msg);
+    }
+    if (info->congested && info->out_bytes <= o2n_queue_low) {
+        queue_congested(info, FALSE);
+        // callback may have added sockets, so fds may have moved:
+        pfd = DA_GET(o2_context->fds, struct pollfd, info->fds_index);
+    }
+    if (err < n && !block) { // next send call would probably block
+        printf("setting POLLOUT on %d\n", info->fds_index);
+        // request event when writable:
+        events_set(pfd, info, pfd->events | POLLOUT);
+        return O2_BLOCKED;
+    }
+    return O2_SUCCESS;
+}
+
+
 // Take next step to send a message. If block is true, this call will 
 //     block until all queued messages are sent or an error or closed
 //     socket breaks the connection. If block is false, sending is 
@@ -487,56 +1040,50 @@ int o2n_send(o2n_info_ptr info, int block)
     if (!block) {
         flags |= MSG_DONTWAIT;
     }
-    struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd, 
-                                info->fds_index);
-    o2_message_ptr msg;
-    while ((msg = info->out_message)) { // more messages to send
-        // Send the length of the message followed by the message.
-        // We want to do this in one send; otherwise, we'll send 2
-        // network packets due to the NODELAY socket option.
-        int32_t len = msg->length;
-        msg->length = htonl(len);
-        char *from = ((char *) &(msg->length)) + info->out_msg_sent;
-        int n = len + sizeof(int32_t) - info->out_msg_sent;
-        printf("***** o2n_send calls send(index %d, %s)\n", info->fds_index, msg->data.address);
-        err = send(pfd->fd, from, n, flags);
-        msg->length = len; // restore byte-swapped len
-
-        if (err < 0) {
-            if (!block && !TERMINATING_SOCKET_ERROR) {
-                printf("setting POLLOUT on %d\n", info->fds_index);
-                pfd->events |= POLLOUT; // request event when it unblocks
-                return O2_BLOCKED;
-            } else if (errno != EINTR && errno != EAGAIN) {
-                O2_DBo(printf("%s removing remote process after send error "
-                           "%d to socket %ld index %d\n", o2_debug_prefix,
-                            errno, (long) (pfd->fd), info->fds_index));
-                o2_message_free(msg);
-                o2n_info_mark_to_free(info);
-                return O2_FAIL;
-            } // else EINTR or EAGAIN, so try again
-        } else {
-            // err >= 0, update how much we have sent
-            info->out_msg_sent += err;
-            if (err >= n) { // finished sending message
-                assert(info->out_msg_sent == len + sizeof(int32_t));
-                info->out_msg_sent = 0;
-                o2_message_ptr next = msg->next;
-                o2_message_free(msg);
-                info->out_message = next;
-                // now, while loop will send the next message if any
-            } else if (!block) { // next send call would probably block
-                printf("setting POLLOUT on %d\n", info->fds_index);
-                pfd->events |= POLLOUT; // request event when writable
+    while (info->out_message) { // more messages to send
+        o2n_iovec iov[O2N_SEND_IOV];
+        int n; // total bytes to send
+        int n_msgs;
+        int n_iov = out_messages_gather(info, iov, &n, &n_msgs);
+#ifdef __linux__
+        if (o2n_shm_ready(info)) {
+            // the reader rings our doorbell when it makes room, so never
+            // ask for POLLOUT (see shm_write())
+            int full;
+            err = shm_write(info, iov, n_iov, n, block, &full);
+            out_messages_restore(info, n_msgs);
+            int rslt = out_messages_sent(info, err, n, TRUE);
+            if (rslt != O2_SUCCESS) {
+                return rslt;
+            } else if (full && !block) {
                 return O2_BLOCKED;
-            } // else, we're blocking, so loop and send more data
+            }
+            continue;
         }
+#endif
+        SOCKET sock = DA_GET(o2_context->fds, struct pollfd,
+                             info->fds_index)->fd;
+#ifdef WIN32
+        DWORD sent_bytes;
+        err = WSASend(sock, iov, n_iov, &sent_bytes, 0, NULL, NULL);
+        if (err == 0) err = (int) sent_bytes;
+#else
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = n_iov;
+        err = (int) sendmsg(sock, &mh, flags);
+#endif
+        out_messages_restore(info, n_msgs);
+        int rslt = out_messages_sent(info, err, n, block);
+        if (rslt != O2_SUCCESS) {
+            return rslt;
+        } // else, loop and send more data
     }
     return O2_SUCCESS;
 }
 
 
-
 // Send a message. Named "enqueue" to emphasize that this is asynchronous.
 // Follow this call with o2_net_send(info, msg, TRUE) to force a blocking
 // (synchronous) send.
@@ -546,50 +1093,235 @@ int o2n_enqueue(o2n_info_ptr info, o2_message_ptr msg)
     // if nothing pending yet, no send in progress;
     //    set up to send this message
     o2_msg_data_ptr mdp = &(msg->data);
+    assert(!msg->refs); // shared messages are sent as views
     msg->next = NULL; // make sure this will be the end of list
-    if (!info->out_message) {
+    int was_empty = !info->out_message;
+    if (was_empty) {
         O2_DBs(if (mdp->address[1] != '_' && !isdigit(mdp->address[1]))
                    o2_dbg_msg("sending TCP", mdp, "to", info->proc.name));
         O2_DBS(if (mdp->address[1] == '_' || isdigit(mdp->address[1]))
                    o2_dbg_msg("sending TCP", mdp, "to", info->proc.name));
-#if IS_LITTLE_ENDIAN
-        o2_msg_swap_endian(mdp, TRUE);
-#endif
         info->out_message = msg;
         info->out_msg_sent = 0;
-        o2n_send(info, FALSE);
     } else {
         // insert message at end of queue; normally queue is empty
-        o2_message_ptr *pending = &(info->out_message);
-        while (*pending) pending = &((*pending)->next);
-        // now *pending is where to put the new message
         O2_DBs(if (mdp->address[1] != '_' && !isdigit(mdp->address[1]))
                    o2_dbg_msg("queueing TCP", mdp, "to", info->proc.name));
         O2_DBS(if (mdp->address[1] == '_' || isdigit(mdp->address[1]))
                    o2_dbg_msg("queueing TCP", mdp, "to", info->proc.name));
+        info->out_tail->next = msg;
+    }
+    info->out_tail = msg;
+    info->out_count++;
+    info->out_bytes += msg->length + sizeof(int32_t);
 #if IS_LITTLE_ENDIAN
+    if (info->proc.byte_order == 'l' && !(msg->flags & O2_MSG_NET_ORDER)) {
+        msg->flags |= O2_MSG_HOST_ORDER; // receiver will not swap either
+    } else if (msg->flags & O2_MSG_VIEW) {
+        o2_view_to_network(msg);
+    } else if (!(msg->flags & O2_MSG_NET_ORDER)) {
         o2_msg_swap_endian(mdp, TRUE);
+    }
 #endif
-        *pending = msg;
+    if (o2n_queue_high && !info->congested &&
+        info->out_bytes >= o2n_queue_high) {
+        queue_congested(info, TRUE);
+    }
+    if (!was_empty) {
+        ; // a send is in progress; o2n_send() will get to msg
+    } else if (!o2n_tcp_deferred) {
+        o2n_send(info, FALSE);
+    } else if (!info->flush_pending) { // send by o2n_tcp_flush()
+        info->flush_pending = TRUE;
+        DA_APPEND(o2_context->tcp_flush, o2n_info_ptr, info);
     }
     return O2_SUCCESS;
 }
 
 
-void o2n_close_socket(o2n_info_ptr info)
+void o2n_free_out_messages(o2n_info_ptr info)
 {
-    // (*info->close_handler)(info);
-    if (info->in_message) O2_FREE(info->in_message);
     while (info->out_message) {
         o2_message_ptr p = info->out_message;
         info->out_message = p->next;
-        O2_FREE(p);
+        o2_message_free(p);
+    }
+    info->out_tail = NULL;
+    info->out_count = 0;
+    info->out_bytes = 0;
+    info->out_msg_sent = 0;
+}
+
+
+int o2_send_queue_limits(int high, int low, o2_queue_callback callback,
+                         void *user_data)
+{
+    if (high < 0 || low < 0 || (high && low > high)) {
+        return O2_BAD_ARGS;
+    }
+    o2n_queue_high = high;
+    o2n_queue_low = low;
+    o2n_queue_callback = callback;
+    o2n_queue_user_data = user_data;
+    if (!o2_context) return O2_SUCCESS;
+    // connections that reach the new high watermark become congested;
+    // congested connections stay congested until they are at or below
+    // the new low watermark (or there is no limit), as in o2n_send()
+    for (int i = 0; i < o2_context->fds_info.length; i++) {
+        o2n_info_ptr info = *DA_GET(o2_context->fds_info, o2n_info_ptr, i);
+        int congested = high && (info->congested ? info->out_bytes > low :
+                                                   info->out_bytes >= high);
+        if (congested != info->congested) {
+            queue_congested(info, congested);
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
+void o2n_tcp_flush()
+{
+#ifdef O2_IO_URING
+    if (o2n_use_uring) {
+        uring_flush();
+        return;
+    }
+#endif
+    // o2n_send() can call the queue callback, which can o2_send() to
+    // another connection and append it to tcp_flush (possibly moving
+    // the array), so re-read the length and element on every pass
+    for (int i = 0; i < o2_context->tcp_flush.length; i++) {
+        o2n_info_ptr info = *DA_GET(o2_context->tcp_flush, o2n_info_ptr, i);
+        info->flush_pending = FALSE;
+        if (!info->delete_me) {
+            o2n_send(info, FALSE);
+        }
     }
+    o2_context->tcp_flush.length = 0;
+}
+
+
+int o2_tcp_deferred_send(int flag)
+{
+    int old = o2n_tcp_deferred;
+    o2n_tcp_deferred = flag;
+    if (!flag && o2_context) {
+        o2n_tcp_flush();
+    }
+    return old;
+}
+
+
+void o2n_close_socket(o2n_info_ptr info)
+{
+    // (*info->close_handler)(info);
+    if (info->in_message) o2_message_free(info->in_message);
+    info->in_message = NULL;
+    o2n_free_out_messages(info);
     info->delete_me = TRUE;
     o2n_socket_delete_flag = TRUE;
 }
 
 
+int o2n_udp_send(o2_message_ptr msg, struct sockaddr_in *to)
+{
+    if (!o2n_udp_batch_limit) {
+        int rslt = (int) sendto(o2n_udp_send_sock, (char *) &(msg->data),
+                                msg->length, 0, (struct sockaddr *) to,
+                                sizeof(*to));
+        o2_message_free(msg);
+        if (rslt < 0) {
+            O2_DBn(printf("o2n_udp_send error, port %d\n", ntohs(to->sin_port)));
+            perror("o2n_udp_send");
+            return O2_FAIL;
+        }
+        return O2_SUCCESS;
+    }
+    DA_EXPAND(o2_context->udp_batch, o2n_udp_pending);
+    o2n_udp_pending_ptr pending = DA_LAST(o2_context->udp_batch,
+                                          o2n_udp_pending);
+    pending->msg = msg;
+    memcpy(&pending->to, to, sizeof(pending->to));
+    o2_context->udp_batch_bytes += msg->length;
+    if (o2_context->udp_batch.length >= O2N_UDP_SEND_BATCH ||
+        o2_context->udp_batch_bytes >= o2n_udp_batch_limit) {
+        o2n_udp_flush();
+    }
+    return O2_SUCCESS;
+}
+
+
+void o2n_udp_flush()
+{
+    int n = o2_context->udp_batch.length;
+    if (n == 0) return;
+#ifdef __linux__
+    struct mmsghdr msgs[O2N_UDP_SEND_BATCH];
+    struct iovec iovecs[O2N_UDP_SEND_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    assert(n <= O2N_UDP_SEND_BATCH);
+    for (int i = 0; i < n; i++) {
+        o2n_udp_pending_ptr pending = DA_GET(o2_context->udp_batch,
+                                             o2n_udp_pending, i);
+        iovecs[i].iov_base = &(pending->msg->data);
+        iovecs[i].iov_len = pending->msg->length;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &(pending->to);
+        msgs[i].msg_hdr.msg_namelen = sizeof(pending->to);
+    }
+    int sent = 0;
+    while (sent < n) {
+        int rslt = sendmmsg(o2n_udp_send_sock, msgs + sent, n - sent, 0);
+        if (rslt < 0) { // the message at sent failed, skip it
+            perror("o2n_udp_flush");
+            rslt = 1;
+        }
+        sent += rslt;
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        o2n_udp_pending_ptr pending = DA_GET(o2_context->udp_batch,
+                                             o2n_udp_pending, i);
+        if (sendto(o2n_udp_send_sock, (char *) &(pending->msg->data),
+                   pending->msg->length, 0, (struct sockaddr *) &(pending->to),
+                   sizeof(pending->to)) < 0) {
+            perror("o2n_udp_flush");
+        }
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        o2_message_free(DA_GET(o2_context->udp_batch, o2n_udp_pending, i)->msg);
+    }
+    udp_batch_count++;
+    udp_batch_messages += n;
+    if (n > udp_batch_largest) udp_batch_largest = n;
+    o2_context->udp_batch.length = 0;
+    o2_context->udp_batch_bytes = 0;
+}
+
+
+int o2_udp_batch(int max_bytes)
+{
+    int old = o2n_udp_batch_limit;
+    if (max_bytes < 0) max_bytes = 0;
+    o2n_udp_batch_limit = max_bytes;
+    if (o2_context && (max_bytes == 0 ||
+                       o2_context->udp_batch_bytes >= max_bytes)) {
+        o2n_udp_flush();
+    }
+    return old;
+}
+
+
+void o2_udp_batch_stats(int64_t *batches, int64_t *messages, int *largest)
+{
+    if (batches) *batches = udp_batch_count;
+    if (messages) *messages = udp_batch_messages;
+    if (largest) *largest = udp_batch_largest;
+}
+
+
 void o2n_local_udp_send(char *msg, int len, int port)
 {
     local_to_addr.sin_port = port; // copy port number
@@ -668,65 +1400,193 @@ int o2n_recv()
     return O2_SUCCESS;
 }
 
-#else  // Use poll function to receive messages.
 
-int o2n_recv()
+void o2n_wait(o2_time timeout)
 {
-    int i;
-        
-    // if there are any bad socket descriptions, remove them now
-    if (o2n_socket_delete_flag) o2n_free_deleted_sockets();
+    struct timeval tv;
+    FD_ZERO(&o2_read_set);
+    for (int i = 0; i < o2_context->fds.length; i++) {
+        struct pollfd *d = DA_GET(o2_context->fds, struct pollfd, i);
+        FD_SET(d->fd, &o2_read_set);
+    }
+    if (timeout >= 0) {
+        tv.tv_sec = (long) timeout;
+        tv.tv_usec = (long) ((timeout - tv.tv_sec) * 1000000);
+    }
+    select(0, &o2_read_set, NULL, NULL, (timeout < 0 ? NULL : &tv));
+}
 
-    poll((struct pollfd *) o2_context->fds.array, o2_context->fds.length, 0);
-    int len = o2_context->fds.length; // length can grow while we're looping!
-    for (i = 0; i < len; i++) {
-        o2n_info_ptr info;
-        struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd, i);
-        // if (d->revents) printf("%d:%p:%x ", i, d, d->revents);
-        if (pfd->revents & POLLERR) {
-        } else if (pfd->revents & POLLHUP) {
-            info = GET_PROCESS(i);
-            O2_DBo(printf("%s removing remote process after POLLHUP to "
-                          "socket %ld index %d\n", o2_debug_prefix, (long) (pfd->fd),
-                          i));
-            o2n_close_socket(info);
-        // do this first so we can change PROCESS_CONNECTING to PROCESS_CONNECTED
-        // when socket becomes writable
-        } else if (pfd->revents & POLLOUT) {
-            info = GET_PROCESS(i); // find the process info
-            printf("pollout for process %d %s\n", i, info->proc.name);
-            if (info->net_tag == NET_TCP_CONNECTING) { // connect() completed
-                info->net_tag = NET_TCP_CLIENT;
+#else  // Use poll (or epoll) function to receive messages.
+
+// handle the events (revents, using poll() bits) reported for info's socket
+// returns O2_FAIL if a handler called o2_finish(), otherwise O2_SUCCESS
+//
+static int socket_event(o2n_info_ptr info, int revents)
+{
+    struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd,
+                                info->fds_index);
+    if (revents & POLLERR) {
+    } else if (revents & POLLHUP) {
+#ifdef __linux__
+        // the peer may have written to shared memory just before it
+        // closed the connection, so deliver that first
+        if (info->shm && shm_read(info) == STREAM_GONE) {
+            return o2_ensemble_name ? O2_SUCCESS : O2_FAIL;
+        }
+#endif
+        O2_DBo(printf("%s removing remote process after POLLHUP to "
+                      "socket %ld index %d\n", o2_debug_prefix, (long) (pfd->fd),
+                      info->fds_index));
+        o2n_close_socket(info);
+    // do this first so we can change PROCESS_CONNECTING to PROCESS_CONNECTED
+    // when socket becomes writable
+    } else if (revents & POLLOUT) {
+        printf("pollout for process %d %s\n", info->fds_index, info->proc.name);
+        if (info->net_tag == NET_TCP_CONNECTING) { // connect() completed
+            info->net_tag = NET_TCP_CLIENT;
+            if (info->tag == INFO_OSC_TCP_CONNECTING) {
+                // OSC servers are not O2 processes: nothing to report
+                info->tag = INFO_OSC_TCP_CLIENT;
+            } else if (info->proc.name) { // (no name if connected only
+                //     to send a callback, see o2_discovered_a_remote_process)
                 // Reporting is suppressed until this connection completes
                 o2_send_cmd("!_o2/si", 0.0, "sis", info->proc.name,
                             O2_REMOTE_NOTIME, info->proc.name);
             }
-            // now we have a completed connection and events has POLLOUT
-            if (info->out_message) {
-                int rslt = o2n_send(info, FALSE);
-                if (rslt == O2_SUCCESS) {
-                    printf("clearing POLLOUT on %d no more messages\n", info->fds_index);
-                    pfd->events &= ~POLLOUT;
-                }
-            } else { // no message to send, clear polling
-                printf("clearing POLLOUT because nothing to send %d?\n", i);
-                pfd->events &= ~POLLOUT;
-            }
-        } else if (pfd->revents & POLLIN) {
-            info = GET_PROCESS(i);
-            assert(info->in_length_got < 5);
-            if (read_event_handler(pfd->fd, info)) {
-                O2_DBo(printf("%s removing remote process after handler "
-                              "reported error on socket %ld", o2_debug_prefix, 
-                              (long) (pfd->fd)));
-                o2n_close_socket(info);
+            // handlers may have added sockets, so fds may have moved:
+            pfd = DA_GET(o2_context->fds, struct pollfd, info->fds_index);
+        }
+        // now we have a completed connection and events has POLLOUT
+        if (info->out_message) {
+            int rslt = o2n_send(info, FALSE);
+            if (rslt == O2_SUCCESS) {
+                printf("clearing POLLOUT on %d no more messages\n", info->fds_index);
+                events_set(pfd, info, pfd->events & ~POLLOUT);
             }
+        } else { // no message to send, clear polling
+            printf("clearing POLLOUT because nothing to send %d?\n",
+                   info->fds_index);
+            events_set(pfd, info, pfd->events & ~POLLOUT);
         }
-        if (!o2_ensemble_name) { // handler called o2_finish()
-            // o2_context->fds are all free and gone now
+    } else if (revents & POLLIN) {
+        if (read_event_handler(pfd->fd, info)) {
+            O2_DBo(printf("%s removing remote process after handler "
+                          "reported error on socket %ld", o2_debug_prefix, 
+                          (long) (pfd->fd)));
+            o2n_close_socket(info);
+        }
+    }
+    if (!o2_ensemble_name) { // handler called o2_finish()
+        // o2_context->fds are all free and gone now
+        return O2_FAIL;
+    }
+    return O2_SUCCESS;
+}
+
+
+// check every socket with poll(): cost is proportional to the number
+// of sockets, whether they are active or not
+//
+static int recv_by_poll()
+{
+    poll((struct pollfd *) o2_context->fds.array, o2_context->fds.length, 0);
+    int len = o2_context->fds.length; // length can grow while we're looping!
+    for (int i = 0; i < len; i++) {
+        struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd, i);
+        // if (d->revents) printf("%d:%p:%x ", i, d, d->revents);
+        if (pfd->revents &&
+            socket_event(GET_PROCESS(i), pfd->revents) != O2_SUCCESS) {
+            return O2_FAIL;
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
+#ifdef O2_EPOLL
+// ask epoll() for ready sockets only: cost is proportional to activity
+//
+static int recv_by_epoll()
+{
+    o2n_epoll_count = epoll_wait(o2n_epoll_fd, o2n_epoll_events,
+                                 O2N_EPOLL_MAX_EVENTS, 0);
+    if (o2n_epoll_count < 0) {
+        if (errno != EINTR) perror("epoll_wait");
+        o2n_epoll_count = 0;
+        return O2_SUCCESS;
+    }
+    for (int i = 0; i < o2n_epoll_count; i++) {
+        o2n_info_ptr info = (o2n_info_ptr) o2n_epoll_events[i].data.ptr;
+        if (!info) continue; // socket was removed by an earlier handler
+        uint32_t ev = o2n_epoll_events[i].events;
+        int revents = ((ev & EPOLLIN) ? POLLIN : 0) |
+                      ((ev & EPOLLOUT) ? POLLOUT : 0) |
+                      ((ev & EPOLLERR) ? POLLERR : 0) |
+                      ((ev & EPOLLHUP) ? POLLHUP : 0);
+        if (socket_event(info, revents) != O2_SUCCESS) {
+            o2n_epoll_count = 0;
             return O2_FAIL;
         }
     }
+    o2n_epoll_count = 0;
+    return O2_SUCCESS;
+}
+#endif
+
+
+void o2n_wait(o2_time timeout)
+{
+    int msec = -1; // wait forever
+    if (timeout >= 0) {
+        // round up so we do not wake up before a scheduled deadline
+        msec = (timeout > 1000000 ? 1000000000 : (int) (timeout * 1000 + 0.999));
+    }
+#ifdef O2_IO_URING
+    if (o2n_use_uring) {
+        uring_wait(msec);
+        return;
+    }
+#endif
+#ifdef __linux__
+    // peers ring our doorbell after writing to shared memory only if we
+    // are idle, so say that we are, then make sure nothing came already
+    if (!shm_idle_begin()) return;
+#endif
+#ifdef O2_EPOLL
+    if (o2n_use_epoll) {
+        // sockets are level-triggered, so o2n_recv() will get this event again
+        struct epoll_event event;
+        epoll_wait(o2n_epoll_fd, &event, 1, msec);
+    } else
+#endif
+    poll((struct pollfd *) o2_context->fds.array, o2_context->fds.length, msec);
+#ifdef __linux__
+    shm_idle_end();
+#endif
+}
+
+
+int o2n_recv()
+{
+    // if there are any bad socket descriptions, remove them now
+    if (o2n_socket_delete_flag) o2n_free_deleted_sockets();
+
+#ifdef O2_IO_URING
+    if (o2n_use_uring) {
+        RETURN_IF_ERROR(recv_by_uring());
+    } else
+#endif
+#ifdef O2_EPOLL
+    if (o2n_use_epoll) {
+        RETURN_IF_ERROR(recv_by_epoll());
+    } else
+#endif
+    RETURN_IF_ERROR(recv_by_poll());
+#ifdef __linux__
+    // shared memory has no descriptor to poll, so always look at it
+    RETURN_IF_ERROR(shm_poll());
+#endif
+
     // clean up any dead sockets before user has a chance to do anything
     // (actually, user handlers could have done a lot, so maybe this is
     // not strictly necessary.)
@@ -745,86 +1605,308 @@ static void info_message_cleanup(o2n_info_ptr info)
     info->in_message = NULL;
     info->in_msg_got = 0;
     info->in_length = 0;
-    info->in_length_got = 0;
 }
 
 
-// returns O2_SUCCESS if whole message is read.
-//         O2_FAIL if whole message is not read yet.
-//         O2_TCP_HUP if socket is closed
+// deliver info->in_message, which is passed to the handler. The handler
+// takes the message and clears in_message before dispatching it, so
+// the message is not freed again if info is removed during delivery.
+//
+static void deliver_in_message(o2n_info_ptr info)
+{
+    // endian corrections are done in handler
+    int rslt = (*o2n_send_by_tcp)(info);
+    if (!o2_ensemble_name) return; // handler called o2_finish(): info is gone
+    if (rslt != O2_SUCCESS &&
+        (info->net_tag == NET_TCP_CONNECTING || info->net_tag == NET_TCP_CLIENT ||
+         info->net_tag == NET_TCP_CONNECTION)) {
+        o2n_info_mark_to_free(info);
+    }
+    info_message_cleanup(info);
+}
+
+
+// deliver a list of messages that arrived on info. A handler may remove
+// info or even call o2_finish(), so stop if that happens. Returns TRUE
+// if info still exists.
+//
+static int deliver_message_list(o2n_info_ptr info, o2_message_ptr msgs)
+{
+    stream_info = info;
+    while (msgs) {
+        info->in_message = msgs;
+        msgs = msgs->next;
+        info->in_message->next = NULL;
+        deliver_in_message(info);
+        if (!o2_ensemble_name || stream_info != info) {
+            o2_message_list_free(msgs);
+            stream_info = NULL;
+            return FALSE;
+        }
+    }
+    stream_info = NULL;
+    return TRUE;
+}
+
+// info->in_msg_got has grown by n bytes: deliver the big message if it
+// is complete. Returns O2_SUCCESS or STREAM_GONE.
+//
+static int big_message_got(o2n_info_ptr info, int n)
+{
+    info->in_msg_got += n;
+    if (info->in_msg_got == info->in_length) { // big message complete
+        info->in_message->length = info->in_length;
+        info->in_message->next = NULL;
+        if (!deliver_message_list(info, info->in_message)) {
+            return STREAM_GONE;
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
+// split complete messages out of in_buffer and deliver them in order.
+// Only a message that is split across reads stays in in_buffer (to be
+// completed by the next read). A message too big for in_buffer gets
+// its own in_message, and later data goes directly into it.
+//
+// Each message is copied into an o2_message of its own because the
+// receiver owns it: it may be scheduled, queued as pending, or
+// forwarded, long after in_buffer is reused. The copy is a memcpy()
+// of data that was just read, which costs much less than the two
+// recvfrom() calls per message that reading one message at a time
+// needs.
+//
+// returns O2_SUCCESS, O2_TCP_HUP if the stream is garbage, O2_FAIL if
+// out of memory, or STREAM_GONE
 //
-static int read_whole_message(SOCKET sock, o2n_info_ptr info)
-{
-    assert(info->in_length_got < 5);
-    /* first read length if it has not been read yet */
-    if (info->in_length_got < 4) {
-        // coerce to int to avoid compiler warning; requested length is
-        // int, so int is ok for n
-        int n = (int) recvfrom(sock, PTR(&(info->in_length)) + info->in_length_got,
-                               4 - info->in_length_got, 0, NULL, NULL);
-        if (n == 0) { /* socket was gracefully closed */
-            O2_DBo(printf("recvfrom returned 0: deleting socket\n"));
-            info_message_cleanup(info);
+static int stream_parse(o2n_info_ptr info)
+{
+    char *next = info->in_buffer;
+    char *end = info->in_buffer + info->in_buffer_len;
+    o2_message_ptr first = NULL;
+    o2_message_ptr *last = &first;
+    o2_message_ptr big = NULL; // a partial message too big for in_buffer
+    int32_t big_length = 0;
+    int big_got = 0;
+    while (end - next >= (int) sizeof(int32_t)) {
+        int32_t len;
+        memcpy(&len, next, sizeof(int32_t)); // may not be aligned
+        len = ntohl(len);
+        if (len < 0) { // garbage in stream: give up on the connection
+            o2_message_list_free(first);
             return O2_TCP_HUP;
-        } else if (n < 0) { /* error: close the socket */
-            if (TERMINATING_SOCKET_ERROR) {
-                perror("recvfrom in read_whole_message getting length");
-                info_message_cleanup(info);
-                return O2_TCP_HUP;
-            }
-            return O2_FAIL; // not finished reading
-        }
-        info->in_length_got += n;
-        assert(info->in_length_got < 5);
-        if (info->in_length_got < 4) {
-            return O2_FAIL; // length is not received yet, get more later
-        }
-        // done receiving length bytes
-        info->in_length = htonl(info->in_length);
-        info->in_message = o2_alloc_size_message(info->in_length);
-        info->in_msg_got = 0; // just to make sure
-    }
-
-    /* read the full message */
-    if (info->in_msg_got < info->in_length) {
-        // coerce to int to avoid compiler warning; message length is int, so n can be int
-        int n = (int) recvfrom(sock,
-                               PTR(&(info->in_message->data)) + info->in_msg_got,
-                               info->in_length - info->in_msg_got, 0, NULL, NULL);
-        if (n == 0) { /* socket was gracefully closed */
-            O2_DBo(printf("recvfrom returned 0: deleting socket\n"));
-            info_message_cleanup(info);
+        }
+        int host_order = len & O2N_HOST_ORDER;
+        len &= ~O2N_HOST_ORDER;
+        int avail = (int) (end - next - sizeof(int32_t));
+        if (avail < len && len + sizeof(int32_t) <= O2N_IN_BUFFER_SIZE) {
+            break; // wait for the rest of the message in in_buffer
+        }
+        o2_message_ptr msg = o2_alloc_size_message(len);
+        if (!msg) {
+            o2_message_list_free(first);
+            return O2_FAIL;
+        }
+        if (host_order) msg->flags |= O2_MSG_HOST_ORDER;
+        if (avail < len) { // start of a big message, read the rest later
+            memcpy(&(msg->data), next + sizeof(int32_t), avail);
+            big = msg;
+            big_length = len;
+            big_got = avail;
+            next = end;
+            break;
+        }
+        memcpy(&(msg->data), next + sizeof(int32_t), len);
+        msg->length = len;
+        msg->next = NULL;
+        *last = msg;
+        last = &(msg->next);
+        next += sizeof(int32_t) + len;
+    }
+    // keep the partial message, if any, at the start of in_buffer
+    info->in_buffer_len = (int) (end - next);
+    if (info->in_buffer_len > 0 && next != info->in_buffer) {
+        memmove(info->in_buffer, next, info->in_buffer_len);
+    }
+    if (!deliver_message_list(info, first)) {
+        if (big) o2_message_free(big);
+        return STREAM_GONE;
+    } else if (big) {
+        info->in_message = big;
+        info->in_length = big_length;
+        info->in_msg_got = big_got;
+    }
+    return O2_SUCCESS;
+}
+
+
+// read from a TCP stream into info->in_buffer (or into in_message if a
+// big message is in progress) and deliver every complete message.
+//
+// returns O2_SUCCESS if no error (even if no message is complete yet),
+//         O2_TCP_HUP if socket is closed
+//
+static int read_stream(SOCKET sock, o2n_info_ptr info)
+{
+    int n;
+    char *dst;
+    int len;
+    if (info->in_message) { // continue reading a big message
+        dst = PTR(&(info->in_message->data)) + info->in_msg_got;
+        len = info->in_length - info->in_msg_got;
+    } else {
+        if (!info->in_buffer) {
+            info->in_buffer = O2_MALLOC(O2N_IN_BUFFER_SIZE);
+            if (!info->in_buffer) return O2_FAIL;
+        }
+        dst = info->in_buffer + info->in_buffer_len;
+        len = O2N_IN_BUFFER_SIZE - info->in_buffer_len;
+    }
+    // coerce to int to avoid compiler warning; message length is int, so n can be int
+#ifdef __linux__
+    if (info->is_unix) { // may carry descriptors for !_o2/sh
+        n = unix_recv(sock, info, dst, len);
+    } else
+#endif
+    n = (int) recvfrom(sock, dst, len, 0, NULL, NULL);
+    if (n == 0) { /* socket was gracefully closed */
+        O2_DBo(printf("recvfrom returned 0: deleting socket\n"));
+        return O2_TCP_HUP;
+    } else if (n < 0) { /* error: close the socket */
+        if (TERMINATING_SOCKET_ERROR) {
+            perror("recvfrom in read_stream");
             return O2_TCP_HUP;
-        } else if (n <= 0) {
-            if (TERMINATING_SOCKET_ERROR) {
-                perror("recvfrom in read_whole_message getting data");
-                o2_message_free(info->in_message);
-                info_message_cleanup(info);
-                return O2_TCP_HUP;
+        }
+        return O2_SUCCESS; // nothing to read after all
+    }
+    int rslt;
+    if (info->in_message) {
+        rslt = big_message_got(info, n);
+    } else {
+        info->in_buffer_len += n;
+        rslt = stream_parse(info);
+    }
+    return (rslt == STREAM_GONE ? O2_SUCCESS : rslt);
+}
+
+
+#ifdef __linux__
+// receive datagrams O2N_UDP_BATCH at a time with recvmmsg(), delivering
+// each batch in the order received, until the socket has no more or
+// O2N_UDP_MAX_BATCHES batches have been received. The
+// messages of a batch are taken from udp_recv_msgs before any are
+// delivered, so handlers may do anything, including calling o2_finish().
+//
+static int udp_recv_batch(SOCKET sock, o2n_info_ptr info)
+{
+    struct mmsghdr msgs[O2N_UDP_BATCH];
+    struct iovec iovecs[O2N_UDP_BATCH][2];
+    if (!udp_batch_buffer) {
+        udp_batch_buffer = O2_MALLOC(O2N_UDP_BATCH * O2_MAX_MSG_SIZE);
+        if (!udp_batch_buffer) return O2_FAIL;
+    }
+    int n = O2N_UDP_BATCH;
+    // a short batch means the socket is empty
+    for (int b = 0; b < O2N_UDP_MAX_BATCHES && n == O2N_UDP_BATCH; b++) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < O2N_UDP_BATCH; i++) {
+            if (!udp_recv_msgs[i]) {
+                udp_recv_msgs[i] = o2_alloc_size_message(O2N_UDP_RECV_SIZE);
+                if (!udp_recv_msgs[i]) return O2_FAIL;
             }
-            return O2_FAIL; // not finished reading
+            int size = udp_recv_msgs[i]->allocated;
+            iovecs[i][0].iov_base = &(udp_recv_msgs[i]->data);
+            iovecs[i][0].iov_len = size;
+            iovecs[i][1].iov_base = udp_batch_buffer + i * O2_MAX_MSG_SIZE;
+            iovecs[i][1].iov_len = O2_MAX_MSG_SIZE - size;
+            msgs[i].msg_hdr.msg_iov = iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 2;
         }
-        info->in_msg_got += n;
-        if (info->in_msg_got < info->in_length) {
-            return O2_FAIL; // whole message is not read in yet, get more later
+        n = recvmmsg(sock, msgs, O2N_UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (!TERMINATING_SOCKET_ERROR) return O2_SUCCESS; // nothing to read
+            // I think udp errors should be ignored. UDP is not reliable
+            // anyway. For now, though, let's at least print errors.
+            perror("recvmmsg in udp_recv_batch");
+            return O2_FAIL;
+        }
+        // take the messages, keeping them in order on a list
+        o2_message_ptr first = NULL;
+        o2_message_ptr *last = &first;
+        for (int i = 0; i < n; i++) {
+            int len = msgs[i].msg_len;
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                O2_DBo(printf("%s dropping UDP message longer than %d bytes\n",
+                              o2_debug_prefix, O2_MAX_MSG_SIZE));
+                continue;
+            }
+            o2_message_ptr msg = udp_recv_msgs[i];
+            if (len <= msg->allocated) { // the usual case: no copy
+                udp_recv_msgs[i] = NULL;
+            } else { // join the message and the overflow in a bigger one
+                o2_message_ptr big = o2_alloc_size_message(len);
+                if (!big) {
+                    O2_DBo(printf("%s dropping UDP message of %d bytes: "
+                                  "out of memory\n", o2_debug_prefix, len));
+                    continue;
+                }
+                memcpy(&(big->data), &(msg->data), msg->allocated);
+                memcpy(((char *) &(big->data)) + msg->allocated,
+                       iovecs[i][1].iov_base, len - msg->allocated);
+                msg = big;
+            }
+            msg->length = len;
+            msg->next = NULL;
+            *last = msg;
+            last = &(msg->next);
+        }
+        while (first) {
+            info->in_message = first;
+            first = first->next;
+            info->in_message->next = NULL;
+            deliver_in_message(info);
+            if (!o2_ensemble_name) { // handler called o2_finish()
+                o2_message_list_free(first);
+                return O2_SUCCESS;
+            }
         }
     }
-    info->in_message->length = info->in_length;
-    return O2_SUCCESS; // we have a full message now
+    return O2_SUCCESS;
+}
+#endif
+
+
+// add a socket accepted by the TCP server socket described by info
+//
+static void connection_accepted(SOCKET connection, o2n_info_ptr info)
+{
+#ifdef __APPLE__
+    int set = 1;
+    setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE,
+               (void *) &set, sizeof(int));
+#endif
+    int tag = (info->tag == INFO_TCP_SERVER || info->tag == INFO_UNIX_SERVER ?
+               INFO_TCP_NOCLOCK : INFO_OSC_TCP_CLIENT);
+    o2n_info_ptr conn = socket_info_new(connection, tag, NET_TCP_CONNECTION);
+    conn->is_unix = (info->tag == INFO_UNIX_SERVER);
+    O2_DBdo(printf("%s O2 server socket %ld accepts client as socket %ld index %d\n",
+                   o2_debug_prefix,
+                   (long) DA_GET(o2_context->fds, struct pollfd,
+                                 info->fds_index)->fd,
+                   (long) connection, conn->fds_index));
+    assert(conn);
 }
 
 
 static int read_event_handler(SOCKET sock, o2n_info_ptr info)
 {
     if (info->net_tag == NET_TCP_CONNECTION || info->net_tag == NET_TCP_CLIENT) {
-        int n = read_whole_message(sock, info);
-        if (n == O2_FAIL) { // not ready to process message yet
-            return O2_SUCCESS; // not a problem, but we're done for now
-        } else if (n != O2_SUCCESS) {
-            return n; // some other error, i.e. O2_TCP_HUP
-        }
-        // fall through and send message
+        return read_stream(sock, info);
     } else if (info->net_tag == NET_UDP_SOCKET) {
+#ifdef __linux__
+        return udp_recv_batch(sock, info);
+#else
         int len;
         if (ioctlsocket(sock, FIONREAD, &len) == -1) {
             perror("udp_recv_handler");
@@ -845,37 +1927,1223 @@ static int read_event_handler(SOCKET sock, o2n_info_ptr info)
         }
         info->in_message->length = n;
         // fall through and send message
+#endif
     } else if (info->net_tag == NET_TCP_SERVER) {
-        // note that this handler does not call read_whole_message()
+        // note that this handler does not call read_stream()
         SOCKET connection = accept(sock, NULL, NULL);
         if (connection == INVALID_SOCKET) {
             O2_DBg(printf("%s tcp_accept_handler failed to accept\n",
                           o2_debug_prefix));
             return O2_FAIL;
         }
-        int set = 1;
-#ifdef __APPLE__
-        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE,
-                   (void *) &set, sizeof(int));
-#endif
-        int tag = (info->tag == INFO_TCP_SERVER ? INFO_TCP_NOCLOCK :
-                                                  INFO_OSC_TCP_CLIENT);
-        o2n_info_ptr conn = socket_info_new(connection, tag, NET_TCP_CONNECTION);
-        O2_DBdo(printf("%s O2 server socket %ld accepts client as socket %ld index %d\n",
-                       o2_debug_prefix, (long) sock, (long) connection, conn->fds_index));
-        assert(conn);
+        connection_accepted(connection, info);
+        return O2_SUCCESS;
+#ifdef __linux__
+    } else if (info->net_tag == NET_EVENT) {
+        // o2n_recv() will read the rings; with epoll(), the eventfd is
+        // edge-triggered, so there is no need to reset it
+        uint64_t count;
+        if (!o2n_use_epoll && read(sock, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+            perror("reading eventfd");
+        }
         return O2_SUCCESS;
+#endif
     } else {
         assert(FALSE);
     }
-    // COMMON CODE for TCP and UDP receive message:
-    // endian corrections are done in handler
-    if ((*o2n_send_by_tcp)(info) == O2_SUCCESS) {
-        info_message_cleanup(info);
-    } else if (info->net_tag == NET_TCP_CONNECTING || info->net_tag == NET_TCP_CLIENT ||
-               info->net_tag == NET_TCP_CONNECTION) {
-        o2n_info_mark_to_free(info);
+#ifndef __linux__
+    // UDP receive message:
+    deliver_in_message(info);
+#endif
+    return O2_SUCCESS;
+}
+
+
+
+#ifdef __linux__
+/******* shared memory between processes on the same host *********/
+
+// After discovery, the client of an AF_UNIX connection (see unix_connect())
+// creates a memfd segment with one ring for each direction and offers it
+// with a !_o2/sh message. The segment and the client's doorbell (an
+// eventfd) are passed with SCM_RIGHTS. The protocol is:
+//     client                              server
+//     O2N_SHM_OFFER (segment, doorbell) ->
+//                                      <- O2N_SHM_ACCEPT (doorbell)
+//     O2N_SHM_SWITCH                    ->
+// or the server replies O2N_SHM_REFUSE and nothing changes. ACCEPT and
+// SWITCH are the last messages on the stream from each side, so the
+// receiver starts reading the ring when it gets one of them, and the
+// sender writes only to the ring after sending it. The socket stays
+// open so that we notice when the peer goes away.
+//
+// A ring carries exactly what the socket would: each message is a
+// length followed by the message data, all in network byte order, so
+// messages are parsed just like TCP. The writer rings the reader's
+// doorbell only if the reader has set reader_idle because it is about
+// to sleep (see o2n_wait()), so a busy process makes no system calls to
+// send or receive.
+#define O2N_SHM_OFFER  0
+#define O2N_SHM_ACCEPT 1
+#define O2N_SHM_REFUSE 2
+#define O2N_SHM_SWITCH 3
+
+#define O2N_SHM_MAGIC 0x4f32534d // "O2SM"
+#define O2N_SHM_RING_SIZE (1 << 18) // must be a power of 2
+#define O2N_SHM_HEADER 4096 // space for o2n_ring before the data
+#define O2N_SHM_SEGMENT (2 * (O2N_SHM_HEADER + O2N_SHM_RING_SIZE))
+// most descriptors passed with one !_o2/sh message
+#define O2N_SHM_MAX_FDS 2
+
+// header of one direction of a segment. head is changed only by the
+// reader and tail only by the writer. Both count bytes from the start
+// and wrap around; the data offset is the count modulo the ring size.
+// Fields written by different processes are in different cache lines.
+// The peer can write anything into the segment, so each side keeps its
+// own copy of the count it writes (see o2n_shm) and treats a count from
+// the peer that is more than the ring size away from it as a hangup.
+typedef struct o2n_ring {
+    uint32_t magic;
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t reader_idle __attribute__((aligned(64))); // ring the reader
+    uint32_t writer_waiting; // ring is full: ring the writer when read
+} o2n_ring, *o2n_ring_ptr;
+
+#define RING_DATA(ring) (((char *) (ring)) + O2N_SHM_HEADER)
+
+typedef struct o2n_shm {
+    char *base;         // the mapped segment, or NULL if not mapped yet
+    o2n_ring_ptr in;    // the ring we read
+    o2n_ring_ptr out;   // the ring we write
+    uint32_t in_head;   // our copy of in->head
+    uint32_t out_tail;  // our copy of out->tail
+    int peer_doorbell;  // eventfd to wake the peer, or -1
+    int in_ready;       // TRUE when the peer writes only to in
+    int out_ready;      // TRUE when we write only to out
+    int fds[O2N_SHM_MAX_FDS]; // descriptors received, not yet used
+    int n_fds;
+} o2n_shm, *o2n_shm_ptr;
+
+
+static o2n_shm_ptr shm_new(o2n_info_ptr info)
+{
+    if (!info->shm) {
+        info->shm = O2_CALLOC(1, sizeof(o2n_shm));
+        info->shm->peer_doorbell = -1;
+    }
+    return info->shm;
+}
+
+
+// unmap info's segment, close its descriptors, and forget it
+//
+static void shm_free(o2n_info_ptr info)
+{
+    o2n_shm_ptr shm = info->shm;
+    for (int i = 0; i < shm->n_fds; i++) {
+        close(shm->fds[i]);
+    }
+    if (shm->peer_doorbell >= 0) close(shm->peer_doorbell);
+    if (shm->base) {
+        munmap(shm->base, O2N_SHM_SEGMENT);
+        for (int i = 0; i < o2_context->shm_peers.length; i++) {
+            if (*DA_GET(o2_context->shm_peers, o2n_info_ptr, i) == info) {
+                DA_REMOVE(o2_context->shm_peers, o2n_info_ptr, i);
+                break;
+            }
+        }
+    }
+    O2_FREE(shm);
+    info->shm = NULL;
+}
+
+
+// create the doorbell that peers use to wake us. Without it, we do not
+// use shared memory, which is not an error.
+//
+static void shm_initialize()
+{
+#ifdef O2_IO_URING
+    // io_uring receives stream data with recv(), which drops descriptors
+    if (o2n_use_uring) return;
+#endif
+    if (o2n_unix_send_sock == INVALID_SOCKET) return;
+    SOCKET fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        O2_DBo(perror("creating shared memory doorbell"));
+        return;
+    }
+    socket_info_new(fd, INFO_SHM_DOORBELL, NET_EVENT);
+    o2n_shm_doorbell = fd;
+}
+
+
+static void shm_ring_doorbell(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("ringing shared memory doorbell");
+    }
+}
+
+
+// map the segment fd for info. The process that creates the segment
+// writes ring 0 and reads ring 1; the other process does the opposite.
+//
+static int shm_attach(o2n_info_ptr info, int fd, int create)
+{
+    struct stat st;
+    if (!create && (fstat(fd, &st) < 0 || st.st_size != O2N_SHM_SEGMENT)) {
+        return O2_FAIL;
+    }
+    char *base = mmap(NULL, O2N_SHM_SEGMENT, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return O2_FAIL;
+    o2n_ring_ptr ring0 = (o2n_ring_ptr) base;
+    o2n_ring_ptr ring1 = (o2n_ring_ptr)
+            (base + O2N_SHM_HEADER + O2N_SHM_RING_SIZE);
+    if (create) { // a new memfd is all zero
+        ring0->magic = ring1->magic = O2N_SHM_MAGIC;
+    } else if (ring0->magic != O2N_SHM_MAGIC ||
+               ring1->magic != O2N_SHM_MAGIC) {
+        munmap(base, O2N_SHM_SEGMENT);
+        return O2_FAIL;
+    }
+    o2n_shm_ptr shm = shm_new(info);
+    shm->base = base;
+    shm->out = (create ? ring0 : ring1);
+    shm->in = (create ? ring1 : ring0);
+    DA_APPEND(o2_context->shm_peers, o2n_info_ptr, info);
+    return O2_SUCCESS;
+}
+
+
+// send a !_o2/sh message of the given kind to info with n_fds (maybe 0)
+// descriptors. Anything already queued is sent first, and this blocks
+// until the message is written, so that the caller can switch to the
+// ring afterward.
+//
+static int shm_send(o2n_info_ptr info, int kind, int *fds, int n_fds)
+{
+    if (o2n_send(info, TRUE) != O2_SUCCESS) return O2_FAIL;
+    o2_send_start();
+    o2_add_int32(kind);
+    o2_message_ptr msg = o2_message_finish(0.0, "!_o2/sh", TRUE);
+    if (!msg) return O2_FAIL;
+    int len = msg->length;
+#if IS_LITTLE_ENDIAN
+    o2_msg_swap_endian(&(msg->data), TRUE);
+#endif
+    msg->length = htonl(len);
+    // the length field immediately precedes the data (see o2n_send())
+    struct iovec iov;
+    iov.iov_base = &(msg->length);
+    iov.iov_len = len + sizeof(int32_t);
+    union {
+        char buf[CMSG_SPACE(O2N_SHM_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (n_fds > 0) {
+        mh.msg_control = control.buf;
+        mh.msg_controllen = CMSG_SPACE(n_fds * sizeof(int));
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(n_fds * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, n_fds * sizeof(int));
+    }
+    SOCKET sock = DA_GET(o2_context->fds, struct pollfd, info->fds_index)->fd;
+    int rslt = O2_SUCCESS;
+    while (iov.iov_len > 0) {
+        int n = (int) sendmsg(sock, &mh, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                rslt = O2_FAIL;
+                break;
+            }
+            struct pollfd pfd = { sock, POLLOUT, 0 };
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        iov.iov_base = ((char *) iov.iov_base) + n;
+        iov.iov_len -= n;
+        mh.msg_control = NULL; // descriptors went with the first byte
+        mh.msg_controllen = 0;
+    }
+    o2_message_free(msg);
+    return rslt;
+}
+
+
+void o2n_shm_offer(o2n_info_ptr info)
+{
+    if (o2n_shm_doorbell == INVALID_SOCKET || !info->is_unix) return;
+    int fd = memfd_create("o2-shm", MFD_CLOEXEC);
+    if (fd < 0) return;
+    int fds[2] = { fd, o2n_shm_doorbell };
+    if (ftruncate(fd, O2N_SHM_SEGMENT) < 0 ||
+        shm_attach(info, fd, TRUE) != O2_SUCCESS) {
+        O2_DBo(perror("creating shared memory segment"));
+    } else if (shm_send(info, O2N_SHM_OFFER, fds, 2) != O2_SUCCESS) {
+        shm_free(info);
+    } else {
+        O2_DBo(printf("%s offered shared memory to %s\n", o2_debug_prefix,
+                      info->proc.name));
+    }
+    close(fd); // the mapping remains
+}
+
+
+void o2n_shm_message(o2n_info_ptr info, int kind)
+{
+    o2n_shm_ptr shm = info->shm;
+    if (kind == O2N_SHM_OFFER) { // we are the server
+        if (shm && shm->n_fds == 2 && o2n_shm_doorbell != INVALID_SOCKET &&
+            shm_attach(info, shm->fds[0], FALSE) == O2_SUCCESS) {
+            close(shm->fds[0]);
+            shm->peer_doorbell = shm->fds[1];
+            shm->n_fds = 0;
+            if (shm_send(info, O2N_SHM_ACCEPT, &o2n_shm_doorbell, 1) !=
+                O2_SUCCESS) {
+                o2n_info_mark_to_free(info);
+                return;
+            }
+            shm->out_ready = TRUE;
+            O2_DBo(printf("%s accepted shared memory from %s\n",
+                          o2_debug_prefix, info->proc.name));
+        } else {
+            if (shm) shm_free(info);
+            shm_send(info, O2N_SHM_REFUSE, NULL, 0);
+        }
+    } else if (kind == O2N_SHM_ACCEPT) { // we are the client
+        if (!shm || !shm->base || shm->n_fds != 1) {
+            // the server now writes to a ring that we cannot use
+            o2n_info_mark_to_free(info);
+            return;
+        }
+        shm->peer_doorbell = shm->fds[0];
+        shm->n_fds = 0;
+        shm->in_ready = TRUE;
+        if (shm_send(info, O2N_SHM_SWITCH, NULL, 0) != O2_SUCCESS) {
+            o2n_info_mark_to_free(info);
+            return;
+        }
+        shm->out_ready = TRUE;
+    } else if (kind == O2N_SHM_REFUSE) {
+        if (shm) shm_free(info);
+    } else if (kind == O2N_SHM_SWITCH) {
+        if (shm && shm->base) shm->in_ready = TRUE;
+    }
+}
+
+
+int o2n_shm_ready(o2n_info_ptr info)
+{
+    return info->shm && info->shm->out_ready;
+}
+
+
+// receive up to len bytes from an AF_UNIX stream into buf. Descriptors
+// sent with !_o2/sh are kept in info->shm until the handler uses them.
+//
+static int unix_recv(SOCKET sock, o2n_info_ptr info, char *buf, int len)
+{
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    union {
+        char buf[CMSG_SPACE(O2N_SHM_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    int n = (int) recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return n;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm;
+         cm = CMSG_NXTHDR(&mh, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int count = (int) ((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *fds = (int *) CMSG_DATA(cm);
+        o2n_shm_ptr shm = shm_new(info);
+        for (int i = 0; i < count; i++) {
+            if (shm->n_fds < O2N_SHM_MAX_FDS) {
+                shm->fds[shm->n_fds++] = fds[i];
+            } else { // not expected
+                close(fds[i]);
+            }
+        }
     }
+    return n;
+}
+
+
+// copy n bytes at position pos (a byte count, see o2n_ring) of ring
+//
+static void ring_get(o2n_ring_ptr ring, uint32_t pos, char *dst, uint32_t n)
+{
+    uint32_t offset = pos & (O2N_SHM_RING_SIZE - 1);
+    uint32_t first = O2N_SHM_RING_SIZE - offset;
+    if (first > n) first = n;
+    memcpy(dst, RING_DATA(ring) + offset, first);
+    memcpy(dst + first, RING_DATA(ring), n - first);
+}
+
+
+static void ring_put(o2n_ring_ptr ring, uint32_t pos, const char *src,
+                     uint32_t n)
+{
+    uint32_t offset = pos & (O2N_SHM_RING_SIZE - 1);
+    uint32_t first = O2N_SHM_RING_SIZE - offset;
+    if (first > n) first = n;
+    memcpy(RING_DATA(ring) + offset, src, first);
+    memcpy(RING_DATA(ring), src + first, n - first);
+}
+
+
+// Write as much of iov (n bytes in n_iov pieces) as fits into info's
+// out ring, waking the reader if it is idle. If the ring fills up, set
+// writer_waiting so that the reader will wake us, and set *full. If
+// nothing fits and block is TRUE, wait for room. Returns the number of
+// bytes written, or -1 if the peer closed the connection or wrote a bad
+// head.
+//
+static int shm_write(o2n_info_ptr info, o2n_iovec *iov, int n_iov, int n,
+                     int block, int *full)
+{
+    o2n_shm_ptr shm = info->shm;
+    o2n_ring_ptr ring = shm->out;
+    *full = FALSE;
+    while (TRUE) {
+        uint32_t tail = shm->out_tail;
+        uint32_t used = tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (used > O2N_SHM_RING_SIZE) { // the peer wrote a bad head
+            errno = EPIPE;
+            return -1;
+        }
+        uint32_t room = O2N_SHM_RING_SIZE - used;
+        int written = 0;
+        for (int i = 0; i < n_iov && room > 0; i++) {
+            uint32_t m = (uint32_t) iov[i].IOV_LEN;
+            if (m > room) m = room;
+            ring_put(ring, tail, iov[i].IOV_BASE, m);
+            tail += m;
+            room -= m;
+            written += m;
+        }
+        if (written > 0) {
+            shm->out_tail = tail;
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&ring->reader_idle, __ATOMIC_SEQ_CST) &&
+                __atomic_exchange_n(&ring->reader_idle, 0, __ATOMIC_SEQ_CST)) {
+                shm_ring_doorbell(shm->peer_doorbell);
+            }
+        }
+        if (written == n) return written;
+        // the ring is full: ask the reader to wake us, then look again in
+        // case it made room before it could see writer_waiting
+        __atomic_store_n(&ring->writer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) !=
+            tail - O2N_SHM_RING_SIZE) {
+            return written; // there is room; caller will call again
+        }
+        if (written > 0 || !block) {
+            *full = TRUE;
+            return written;
+        }
+        struct pollfd pfds[2];
+        pfds[0].fd = o2n_shm_doorbell;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = DA_GET(o2_context->fds, struct pollfd,
+                            info->fds_index)->fd;
+        pfds[1].events = 0; // only POLLHUP and POLLERR
+        // the reader sees writer_waiting after it makes room (both are
+        // SEQ_CST), so the doorbell will ring: no need for a timeout
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (pfds[1].revents & (POLLHUP | POLLERR)) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (pfds[0].revents & POLLIN) {
+            // reset the doorbell; o2n_wait() looks at every ring before it
+            // sleeps, so no other peer is missed
+            uint64_t count;
+            if (read(o2n_shm_doorbell, &count, sizeof(count)) < 0) {
+                perror("reading eventfd");
+            }
+        }
+    }
+}
+
+
+// we have read the in ring up to head: tell the writer, and wake it if
+// it is waiting for room
+//
+static void ring_consumed(o2n_shm_ptr shm, uint32_t head)
+{
+    o2n_ring_ptr ring = shm->in;
+    shm->in_head = head;
+    __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->writer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&ring->writer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        shm_ring_doorbell(shm->peer_doorbell);
+    }
+}
+
+
+// deliver everything in info's in ring. Complete messages are copied
+// directly from the ring into new messages; otherwise, data goes
+// through in_buffer or in_message as in read_stream(). Returns
+// O2_SUCCESS, O2_TCP_HUP if the stream or the ring's tail is garbage,
+// O2_FAIL if out of memory, or STREAM_GONE
+//
+static int shm_read(o2n_info_ptr info)
+{
+    o2n_shm_ptr shm = info->shm;
+    if (!shm->in_ready) return O2_SUCCESS;
+    o2n_ring_ptr ring = shm->in;
+    uint32_t head = shm->in_head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (tail - head > O2N_SHM_RING_SIZE) { // the peer wrote a bad tail
+        return O2_TCP_HUP;
+    }
+    while (head != tail) {
+        o2_message_ptr first = NULL;
+        o2_message_ptr *last = &first;
+        while (!info->in_message && info->in_buffer_len == 0 &&
+               tail - head >= sizeof(int32_t)) {
+            int32_t len;
+            ring_get(ring, head, (char *) &len, sizeof(int32_t));
+            len = ntohl(len);
+            int host_order = len & O2N_HOST_ORDER;
+            if (len >= 0) len &= ~O2N_HOST_ORDER;
+            if (len < 0 || len > tail - head - sizeof(int32_t)) {
+                break; // handle below
+            }
+            o2_message_ptr msg = o2_alloc_size_message(len);
+            if (!msg) {
+                o2_message_list_free(first);
+                return O2_FAIL;
+            }
+            if (host_order) msg->flags |= O2_MSG_HOST_ORDER;
+            ring_get(ring, head + sizeof(int32_t), (char *) &(msg->data), len);
+            msg->length = len;
+            msg->next = NULL;
+            *last = msg;
+            last = &(msg->next);
+            head += sizeof(int32_t) + len;
+        }
+        if (first) {
+            // info and shm may be freed by handlers: finish with them first
+            ring_consumed(shm, head);
+            if (!deliver_message_list(info, first)) return STREAM_GONE;
+            continue;
+        }
+        // a partial or big message: copy what we can, as read_stream() does
+        char *dst;
+        uint32_t n = tail - head;
+        int rslt;
+        if (info->in_message) {
+            dst = PTR(&(info->in_message->data)) + info->in_msg_got;
+            if (n > (uint32_t) (info->in_length - info->in_msg_got)) {
+                n = info->in_length - info->in_msg_got;
+            }
+        } else {
+            if (!info->in_buffer) {
+                info->in_buffer = O2_MALLOC(O2N_IN_BUFFER_SIZE);
+                if (!info->in_buffer) return O2_FAIL;
+            }
+            dst = info->in_buffer + info->in_buffer_len;
+            if (n > (uint32_t) (O2N_IN_BUFFER_SIZE - info->in_buffer_len)) {
+                n = O2N_IN_BUFFER_SIZE - info->in_buffer_len;
+            }
+        }
+        ring_get(ring, head, dst, n);
+        head += n;
+        ring_consumed(shm, head);
+        if (info->in_message) {
+            rslt = big_message_got(info, n);
+        } else {
+            info->in_buffer_len += n;
+            rslt = stream_parse(info);
+        }
+        if (rslt != O2_SUCCESS) return rslt;
+    }
+    return O2_SUCCESS;
+}
+
+
+// read every ring, and continue sending to any peer whose ring was full.
+// Returns O2_FAIL if a handler called o2_finish(), otherwise O2_SUCCESS
+//
+static int shm_poll()
+{
+    for (int i = 0; i < o2_context->shm_peers.length; i++) {
+        o2n_info_ptr info = *DA_GET(o2_context->shm_peers, o2n_info_ptr, i);
+        if (info->delete_me) continue;
+        int rslt = shm_read(info);
+        if (!o2_ensemble_name) return O2_FAIL;
+        if (rslt == STREAM_GONE) { // info may be gone from shm_peers
+            if (i >= o2_context->shm_peers.length ||
+                *DA_GET(o2_context->shm_peers, o2n_info_ptr, i) != info) {
+                i--;
+            }
+            continue;
+        } else if (rslt != O2_SUCCESS) {
+            O2_DBo(printf("%s removing remote process after bad data in "
+                          "shared memory, index %d\n", o2_debug_prefix,
+                          info->fds_index));
+            o2n_close_socket(info);
+            continue;
+        }
+        if (info->shm->out_ready && info->out_message &&
+            !info->flush_pending) {
+            o2n_send(info, FALSE);
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
+// we are about to sleep: ask writers to ring our doorbell. Returns FALSE
+// (and clears the requests) if a ring has data already, in which case
+// the caller should not sleep.
+//
+static int shm_idle_begin()
+{
+    int idle = TRUE;
+    for (int i = 0; i < o2_context->shm_peers.length; i++) {
+        o2n_shm_ptr shm = (*DA_GET(o2_context->shm_peers,
+                                   o2n_info_ptr, i))->shm;
+        if (!shm->in_ready) continue;
+        __atomic_store_n(&shm->in->reader_idle, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shm->in->tail, __ATOMIC_SEQ_CST) !=
+            shm->in_head) {
+            idle = FALSE;
+        }
+    }
+    if (!idle) shm_idle_end();
+    return idle;
+}
+
+
+static void shm_idle_end()
+{
+    for (int i = 0; i < o2_context->shm_peers.length; i++) {
+        o2n_shm_ptr shm = (*DA_GET(o2_context->shm_peers,
+                                   o2n_info_ptr, i))->shm;
+        if (shm->in_ready) {
+            __atomic_store_n(&shm->in->reader_idle, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+#endif
+
+
+#ifdef O2_IO_URING
+/******* io_uring backend *********/
+
+// With io_uring, sockets are not polled. Instead, each socket always has
+// a "multishot" request in the kernel: an accept for a TCP server socket
+// and a recv for every other socket. The kernel posts a completion for
+// each accepted connection or each chunk of received data, which is put
+// in a buffer taken from a ring of buffers that we provide. o2n_recv()
+// reads completions from memory shared with the kernel, so at steady
+// state, receiving makes no system calls. A one-shot poll request
+// reports POLLOUT when events_set() asks for it. Sockets are not
+// registered with epoll. With deferred TCP sends (o2_tcp_deferred_send()),
+// o2n_tcp_flush() submits the queued messages of all connections with
+// one system call, using a second ring so that send completions are not
+// mixed with receives. Otherwise, o2n_send() writes each message
+// directly, as with poll() or epoll().
+//
+// This uses the kernel interface directly rather than liburing, and it
+// needs Linux 6.0 or newer (multishot recv with provided buffer rings).
+
+#define O2N_URING_ENTRIES 256      // submission queue size
+#define O2N_URING_CQ_ENTRIES 4096  // completion queue size
+#define O2N_URING_TCP_BUFS 256     // provided buffers for TCP data
+#define O2N_URING_TCP_BUF_SIZE 4096
+#define O2N_URING_UDP_BUFS 32      // provided buffers for UDP datagrams
+// a UDP buffer is bigger than O2_MAX_MSG_SIZE, so that a datagram that
+// is too big to receive completely can be detected and dropped
+#define O2N_URING_UDP_BUF_SIZE (O2_MAX_MSG_SIZE + 4)
+#define O2N_URING_TCP_GROUP 0      // buffer group IDs
+#define O2N_URING_UDP_GROUP 1
+#define O2N_URING_SEND_BATCH 32    // maximum sends per submission
+
+// request types, stored in the low bits of user_data with the handle
+#define URING_RECV 0
+#define URING_ACCEPT 1
+#define URING_POLL 2
+#define URING_TYPE_MASK 3
+
+typedef struct uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, *sq_flags;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *rings;        // shared memory for submission and completion queues
+    size_t rings_size;
+    size_t sqes_size;
+    unsigned to_submit; // requests added since the last io_uring_enter()
+} uring, *uring_ptr;
+
+typedef struct uring_bufs {
+    struct io_uring_buf_ring *ring; // shared with the kernel
+    size_t ring_size;
+    char *data; // count buffers of size bytes each
+    int size;
+    int count;  // must be a power of 2
+    unsigned short tail;
+} uring_bufs, *uring_bufs_ptr;
+
+// io_uring state for a socket. The kernel may complete requests after
+// the socket is removed, so this can outlive the o2n_info
+typedef struct uring_handle {
+    o2n_info_ptr info;  // NULL after the socket is removed
+    uring_bufs_ptr bufs; // where received data is put
+    int pending;        // number of requests that will complete later
+    int pollout;        // TRUE if a POLLOUT request is pending
+    struct uring_handle *next; // list of handles whose info was removed
+} uring_handle, *uring_handle_ptr;
+
+static uring recv_ring = { -1 };
+static uring send_ring = { -1 };
+static uring_bufs tcp_bufs;
+static uring_bufs udp_bufs;
+static uring_handle_ptr uring_retired = NULL;
+
+
+static int uring_ring_open(uring_ptr r, unsigned entries, unsigned cq_entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (cq_entries) {
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries;
+    }
+    r->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        return O2_FAIL;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(p.features & IORING_FEAT_EXT_ARG)) {
+        close(r->fd);
+        r->fd = -1;
+        return O2_FAIL;
+    }
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes +
+                     p.cq_entries * sizeof(struct io_uring_cqe);
+    r->rings_size = (sq_size > cq_size ? sq_size : cq_size);
+    r->rings = mmap(NULL, r->rings_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->rings == MAP_FAILED || r->sqes == MAP_FAILED) {
+        perror("mmap in uring_ring_open");
+        return O2_FAIL; // uring_ring_close() will clean up
+    }
+    char *m = (char *) r->rings;
+    r->sq_head = (unsigned *) (m + p.sq_off.head);
+    r->sq_tail = (unsigned *) (m + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (m + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (m + p.sq_off.array);
+    r->sq_flags = (unsigned *) (m + p.sq_off.flags);
+    r->cq_head = (unsigned *) (m + p.cq_off.head);
+    r->cq_tail = (unsigned *) (m + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (m + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (m + p.cq_off.cqes);
+    r->entries = p.sq_entries;
+    r->to_submit = 0;
     return O2_SUCCESS;
 }
 
+
+static void uring_ring_close(uring_ptr r)
+{
+    if (r->fd < 0) return;
+    if (r->rings && r->rings != MAP_FAILED) munmap(r->rings, r->rings_size);
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    close(r->fd);
+    memset(r, 0, sizeof(uring));
+    r->fd = -1;
+}
+
+
+// submit requests, and if wait_nr > 0, wait up to msec (or forever if
+// msec < 0) for wait_nr completions. Returns the io_uring_enter() result.
+//
+static int uring_enter(uring_ptr r, unsigned wait_nr, int msec)
+{
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr || (*r->sq_flags & IORING_SQ_CQ_OVERFLOW)) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (wait_nr && msec >= 0) {
+        ts.tv_sec = msec / 1000;
+        ts.tv_nsec = (msec % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+    int n = (int) syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait_nr,
+                          flags, &arg, sizeof(arg));
+    if (n >= 0) {
+        r->to_submit -= n;
+    } else if (errno != EINTR && errno != ETIME && errno != EBUSY &&
+               errno != EAGAIN) {
+        perror("io_uring_enter");
+    }
+    return n;
+}
+
+
+// get a zeroed submission queue entry. It is submitted by the next
+// uring_enter(). (The kernel only reads entries in io_uring_enter(),
+// so it is safe to make the entry visible before it is filled in.)
+//
+static struct io_uring_sqe *uring_sqe(uring_ptr r)
+{
+    unsigned tail = *r->sq_tail;
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->entries) {
+        uring_enter(r, 0, -1); // queue is full; submit to make room
+    }
+    unsigned i = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[i];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    r->sq_array[i] = i;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return sqe;
+}
+
+
+// give buffer bid back to the kernel
+//
+static void uring_buf_recycle(uring_bufs_ptr b, int bid)
+{
+    struct io_uring_buf *buf = &b->ring->bufs[b->tail & (b->count - 1)];
+    buf->addr = (uint64_t) (uintptr_t) (b->data + bid * b->size);
+    buf->len = b->size;
+    buf->bid = bid;
+    b->tail++;
+    __atomic_store_n(&b->ring->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+
+static int uring_bufs_open(uring_bufs_ptr b, int group, int count, int size)
+{
+    b->ring_size = count * sizeof(struct io_uring_buf);
+    b->ring = mmap(NULL, b->ring_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->ring == MAP_FAILED) {
+        b->ring = NULL;
+        return O2_FAIL;
+    }
+    b->data = O2_MALLOC(count * size);
+    if (!b->data) return O2_FAIL;
+    b->size = size;
+    b->count = count;
+    b->tail = 0;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) b->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, recv_ring.fd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return O2_FAIL;
+    }
+    for (int i = 0; i < count; i++) {
+        uring_buf_recycle(b, i);
+    }
+    return O2_SUCCESS;
+}
+
+
+static void uring_bufs_close(uring_bufs_ptr b)
+{
+    // the ring is unregistered when recv_ring is closed
+    if (b->ring) munmap(b->ring, b->ring_size);
+    if (b->data) O2_FREE(b->data);
+    memset(b, 0, sizeof(uring_bufs));
+}
+
+
+static void uring_initialize()
+{
+    if (uring_ring_open(&recv_ring, O2N_URING_ENTRIES, O2N_URING_CQ_ENTRIES) ||
+        uring_ring_open(&send_ring, O2N_URING_SEND_BATCH, 0) ||
+        uring_bufs_open(&tcp_bufs, O2N_URING_TCP_GROUP, O2N_URING_TCP_BUFS,
+                        O2N_URING_TCP_BUF_SIZE) ||
+        uring_bufs_open(&udp_bufs, O2N_URING_UDP_GROUP, O2N_URING_UDP_BUFS,
+                        O2N_URING_UDP_BUF_SIZE)) {
+        O2_DBo(printf("%s io_uring is not available, using %s\n",
+                      o2_debug_prefix, o2n_use_epoll ? "epoll" : "poll"));
+        uring_finish();
+        return;
+    }
+    o2n_use_uring = TRUE;
+}
+
+
+static void uring_finish()
+{
+    // closing the rings cancels any requests that are still pending
+    uring_ring_close(&recv_ring);
+    uring_ring_close(&send_ring);
+    uring_bufs_close(&tcp_bufs);
+    uring_bufs_close(&udp_bufs);
+    while (uring_retired) {
+        uring_handle_ptr h = uring_retired;
+        uring_retired = h->next;
+        O2_FREE(h);
+    }
+    o2n_use_uring = FALSE;
+}
+
+
+// queue a request of the given type for info's socket
+//
+static void uring_request(o2n_info_ptr info, int type)
+{
+    uring_handle_ptr h = info->uring;
+    struct io_uring_sqe *sqe = uring_sqe(&recv_ring);
+    sqe->fd = DA_GET(o2_context->fds, struct pollfd, info->fds_index)->fd;
+    sqe->user_data = (uint64_t) (uintptr_t) h | type;
+    if (type == URING_ACCEPT) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    } else if (type == URING_RECV) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = (h->bufs == &udp_bufs ? O2N_URING_UDP_GROUP :
+                                                 O2N_URING_TCP_GROUP);
+    } else { // URING_POLL
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLOUT;
+        h->pollout = TRUE;
+    }
+    h->pending++;
+}
+
+
+// start accepting or receiving on the new socket described by info
+//
+static void uring_socket_new(o2n_info_ptr info)
+{
+    uring_handle_ptr h = O2_CALLOC(1, sizeof(uring_handle));
+    h->info = info;
+    h->bufs = (info->net_tag == NET_UDP_SOCKET ? &udp_bufs : &tcp_bufs);
+    info->uring = h;
+    uring_request(info, info->net_tag == NET_TCP_SERVER ? URING_ACCEPT :
+                                                          URING_RECV);
+}
+
+
+static void uring_handle_free(uring_handle_ptr h)
+{
+    uring_handle_ptr *ptr = &uring_retired;
+    while (*ptr) {
+        if (*ptr == h) {
+            *ptr = h->next;
+            break;
+        }
+        ptr = &((*ptr)->next);
+    }
+    O2_FREE(h);
+}
+
+
+// cancel requests for info's socket, which is about to be closed
+//
+static void uring_socket_remove(o2n_info_ptr info, SOCKET sock)
+{
+    uring_handle_ptr h = info->uring;
+    if (!h) return;
+    info->uring = NULL;
+    h->info = NULL;
+    struct io_uring_sqe *sqe = uring_sqe(&recv_ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = sock;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0; // the completion is ignored
+    uring_enter(&recv_ring, 0, -1); // the socket must be open to cancel
+    if (h->pending == 0) {
+        O2_FREE(h);
+    } else { // free when the last request completes
+        h->next = uring_retired;
+        uring_retired = h;
+    }
+}
+
+
+// events_set() asked for POLLOUT
+//
+static void uring_pollout(o2n_info_ptr info)
+{
+    if (info->uring && !info->uring->pollout) {
+        uring_request(info, URING_POLL);
+    }
+}
+
+
+// process data from a TCP stream in a provided buffer. Data is copied
+// into info's in_buffer or in_message, then handled as in read_stream().
+//
+// returns O2_SUCCESS, STREAM_GONE, or an error code
+//
+static int uring_stream_data(o2n_info_ptr info, char *data, int n)
+{
+    while (n > 0) {
+        int m;
+        int rslt;
+        if (info->in_message) { // continue receiving a big message
+            m = info->in_length - info->in_msg_got;
+            if (m > n) m = n;
+            memcpy(PTR(&(info->in_message->data)) + info->in_msg_got,
+                   data, m);
+            rslt = big_message_got(info, m);
+        } else {
+            if (!info->in_buffer) {
+                info->in_buffer = O2_MALLOC(O2N_IN_BUFFER_SIZE);
+                if (!info->in_buffer) return O2_FAIL;
+            }
+            m = O2N_IN_BUFFER_SIZE - info->in_buffer_len;
+            if (m > n) m = n;
+            memcpy(info->in_buffer + info->in_buffer_len, data, m);
+            info->in_buffer_len += m;
+            rslt = stream_parse(info);
+        }
+        if (rslt != O2_SUCCESS) return rslt;
+        data += m;
+        n -= m;
+    }
+    return O2_SUCCESS;
+}
+
+
+// handle a completion from recv_ring. Returns O2_FAIL if a handler
+// called o2_finish(), otherwise O2_SUCCESS
+//
+static int uring_completion(struct io_uring_cqe *cqe)
+{
+    if (cqe->user_data == 0) return O2_SUCCESS; // a cancel request
+    int type = (int) (cqe->user_data & URING_TYPE_MASK);
+    uring_handle_ptr h = (uring_handle_ptr) (uintptr_t)
+            (cqe->user_data & ~(uint64_t) URING_TYPE_MASK);
+    int res = cqe->res;
+    int more = (cqe->flags & IORING_CQE_F_MORE);
+    char *data = NULL;
+    int bid = 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        data = h->bufs->data + bid * h->bufs->size;
+    }
+    if (type == URING_POLL) h->pollout = FALSE;
+    // the request that completed is not pending if !more, but keep h
+    // until we are done in case a handler removes the socket
+    if (more) h->pending++;
+    o2n_info_ptr info = h->info;
+    int close_it = FALSE;
+    if (!info) {
+        ; // socket was removed; just recycle the buffer
+    } else if (type == URING_ACCEPT) {
+        if (res >= 0) {
+            connection_accepted(res, info);
+        } else if (res != -ECANCELED) {
+            O2_DBg(printf("%s io_uring accept failed: %s\n",
+                          o2_debug_prefix, strerror(-res)));
+        }
+    } else if (type == URING_POLL) {
+        struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd,
+                                    info->fds_index);
+        if (res > 0 && (pfd->events & POLLOUT)) {
+            if (socket_event(info, res & (POLLOUT | POLLERR | POLLHUP))) {
+                return O2_FAIL;
+            }
+        }
+    } else if (info->net_tag == NET_UDP_SOCKET) {
+        if (res > O2_MAX_MSG_SIZE) {
+            O2_DBo(printf("%s dropping UDP message longer than %d bytes\n",
+                          o2_debug_prefix, O2_MAX_MSG_SIZE));
+        } else if (data) {
+            info->in_message = o2_alloc_size_message(res);
+            if (info->in_message) {
+                memcpy(&(info->in_message->data), data, res);
+                info->in_message->length = res;
+                deliver_in_message(info);
+            }
+        } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+            errno = -res;
+            perror("io_uring recv of UDP message");
+        }
+    } else { // TCP stream
+        if (data && res > 0) {
+            int rslt = uring_stream_data(info, data, res);
+            close_it = (rslt != O2_SUCCESS && rslt != STREAM_GONE);
+        } else if (res == 0) { // socket was gracefully closed
+            O2_DBo(printf("io_uring recv returned 0: deleting socket\n"));
+            close_it = TRUE;
+        } else if (res != -ENOBUFS && res != -ECANCELED) {
+            errno = -res;
+            perror("io_uring recv in TCP stream");
+            close_it = TRUE;
+        }
+    }
+    if (!o2_ensemble_name) { // handler called o2_finish()
+        return O2_FAIL;      // h and buffers are all freed now
+    }
+    if (data) uring_buf_recycle(h->bufs, bid);
+    h->pending--; // release the reference taken above, or the request is done
+    if (!h->info) { // socket was removed
+        if (h->pending == 0) uring_handle_free(h);
+        return O2_SUCCESS;
+    }
+    info = h->info; // still valid
+    if (close_it) {
+        O2_DBo(printf("%s removing remote process after io_uring receive "
+                      "error on index %d\n", o2_debug_prefix,
+                      info->fds_index));
+        o2n_close_socket(info);
+    } else if (!info->delete_me) {
+        if (!more && type != URING_POLL) {
+            uring_request(info, type); // request ended, so restart it
+        }
+        struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd,
+                                    info->fds_index);
+        if ((pfd->events & POLLOUT) && !h->pollout) {
+            uring_request(info, URING_POLL); // still waiting for POLLOUT
+        }
+    }
+    return O2_SUCCESS;
+}
+
+
+static int recv_by_uring()
+{
+    if (recv_ring.to_submit || (*recv_ring.sq_flags & IORING_SQ_CQ_OVERFLOW)) {
+        uring_enter(&recv_ring, 0, -1);
+    }
+    unsigned head = *recv_ring.cq_head;
+    unsigned tail = __atomic_load_n(recv_ring.cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe cqe = recv_ring.cqes[head & *recv_ring.cq_mask];
+        head++; // consume the completion before handlers run
+        __atomic_store_n(recv_ring.cq_head, head, __ATOMIC_RELEASE);
+        RETURN_IF_ERROR(uring_completion(&cqe));
+    }
+    if (recv_ring.to_submit) { // restart requests and add new ones
+        uring_enter(&recv_ring, 0, -1);
+    }
+    return O2_SUCCESS;
+}
+
+
+static void uring_wait(int msec)
+{
+    if (*recv_ring.cq_head != __atomic_load_n(recv_ring.cq_tail,
+                                              __ATOMIC_ACQUIRE)) {
+        return; // there are completions already
+    }
+    uring_enter(&recv_ring, 1, msec);
+}
+
+
+// send queued messages of every connection on o2_context->tcp_flush,
+// submitting a sendmsg request for each connection (up to
+// O2N_URING_SEND_BATCH at a time) with one system call
+//
+static void uring_flush()
+{
+    static o2n_iovec iov[O2N_URING_SEND_BATCH][O2N_SEND_IOV];
+    struct msghdr hdr[O2N_URING_SEND_BATCH];
+    o2n_info_ptr batch[O2N_URING_SEND_BATCH];
+    int n_iov[O2N_URING_SEND_BATCH];
+    int n[O2N_URING_SEND_BATCH];
+    int n_msgs[O2N_URING_SEND_BATCH];
+    int result[O2N_URING_SEND_BATCH];
+    // a handler called by out_messages_sent() can append to tcp_flush,
+    // so length is checked on each iteration
+    int i = 0;
+    while (i < o2_context->tcp_flush.length) {
+        int count = 0;
+        while (count < O2N_URING_SEND_BATCH &&
+               i < o2_context->tcp_flush.length) {
+            o2n_info_ptr info = *DA_GET(o2_context->tcp_flush,
+                                        o2n_info_ptr, i++);
+            info->flush_pending = FALSE;
+            struct pollfd *pfd = DA_GET(o2_context->fds, struct pollfd,
+                                        info->fds_index);
+            // if connecting or waiting for POLLOUT, POLLOUT sends
+            if (info->delete_me || !info->out_message ||
+                info->net_tag == NET_TCP_CONNECTING ||
+                (pfd->events & POLLOUT)) {
+                continue;
+            }
+            n_iov[count] = out_messages_gather(info, iov[count], &n[count],
+                                               &n_msgs[count]);
+            memset(&hdr[count], 0, sizeof(struct msghdr));
+            hdr[count].msg_iov = iov[count];
+            hdr[count].msg_iovlen = n_iov[count];
+            struct io_uring_sqe *sqe = uring_sqe(&send_ring);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = pfd->fd;
+            sqe->addr = (uint64_t) (uintptr_t) &hdr[count];
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+            sqe->user_data = count;
+            batch[count++] = info;
+        }
+        // submit and wait for all completions
+        int done = 0;
+        while (done < count) {
+            uring_enter(&send_ring, count - done, -1);
+            unsigned head = *send_ring.cq_head;
+            unsigned tail = __atomic_load_n(send_ring.cq_tail,
+                                            __ATOMIC_ACQUIRE);
+            while (head != tail) {
+                struct io_uring_cqe *cqe =
+                        &send_ring.cqes[head & *send_ring.cq_mask];
+                result[cqe->user_data] = cqe->res;
+                head++;
+                done++;
+            }
+            __atomic_store_n(send_ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+        for (int j = 0; j < count; j++) {
+            out_messages_restore(batch[j], n_msgs[j]);
+        }
+        for (int j = 0; j < count; j++) {
+            int err = result[j];
+            if (err < 0) {
+                errno = -err;
+                err = -1;
+            }
+            out_messages_sent(batch[j], err, n[j], FALSE);
+            if (!o2_ensemble_name) return; // handler called o2_finish()
+        }
+    }
+    o2_context->tcp_flush.length = 0;
+}
+#endif
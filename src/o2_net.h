@@ -23,6 +23,10 @@
 // - one TCP server socket to receive connections, asynchronous
 // - one pre-allocated UDP broadcast socket, sends are synchronous
 // - one pre-allocated UDP send socket, sends are synchronous
+// - on Linux, an AF_UNIX server socket, datagram receive socket and
+//   datagram send socket for processes on the same host
+// - on Linux, an eventfd "doorbell" that peers write to wake us when
+//   they put messages in a shared memory ring
 
 /**
  *  TCP and UDP head for different system
@@ -72,7 +76,9 @@ struct o2n_info;
  */
 
 // tag values:
+#define INFO_SHM_DOORBELL       19 // wakes us for shared memory (Linux)
 #define INFO_TCP_SERVER         20 // the local process
+#define INFO_UNIX_SERVER        21 // accepts AF_UNIX connections (Linux)
 #define INFO_TCP_NOCLOCK        22 // not-synced client or server remote proc
 #define INFO_TCP_SOCKET         23 // clock-synced client or server remote proc
 #define INFO_UDP_SOCKET         24 // UDP receive socket for this process
@@ -93,6 +99,7 @@ struct o2n_info;
 #define NET_TCP_CLIENT     33   // client side of a TCP connection
 #define NET_TCP_CONNECTION 34   // server side accepted TCP connection
 #define NET_INFO_REMOVED   35   // o2_info_remove() has been called on this
+#define NET_EVENT          36   // an eventfd, read to reset it
 
 /* Here are all the types of o2n_info structures and their life-cycles:
 
@@ -103,6 +110,20 @@ UDP Send Socket (another socket for UDP, there is no o2n_info structure)
 UDP Receive Socket (tag = UDP_SOCKET, net_tag = UDP_SOCKET)
     Socket is created initially and only closed by o2n_finish, used for both
     discovery messages and incoming O2 UDP messages.
+Local AF_UNIX Server (tag = UNIX_SERVER, net_tag = TCP_SERVER) and
+AF_UNIX Datagram Socket (tag = UDP_SOCKET, net_tag = UDP_SOCKET)
+    Linux only. Created after the TCP server and only closed by o2n_finish.
+    A remote process on the same host is connected through the AF_UNIX
+    server, and its is_unix flag is set. Otherwise, it is just like a TCP
+    connection, and the life-cycle below applies. UDP messages to it are
+    sent to its AF_UNIX datagram socket.
+Shared Memory Doorbell (tag = SHM_DOORBELL, net_tag = EVENT)
+    Linux only. Created after the AF_UNIX sockets and only closed by
+    o2n_finish. After discovery, the client of an AF_UNIX connection
+    offers a shared memory segment with a ring for each direction
+    (see !_o2/sh in o2_net.c). If the server accepts, both processes
+    write messages to the rings instead of the socket, setting
+    info->shm, and the socket only detects when the connection closes.
 Remote Process (tag = INFO_TCP_SOCKET, net_tag = NET_TCP_CLIENT or NET_TCP_CONNECTION)
     1. Upon discovery, if we are the client, issue a connect request.
        tag                   net_tag               notes
@@ -144,16 +165,36 @@ typedef struct o2n_info {
     int delete_me;  // set to TRUE when socket should be removed (note that
                     //   removing array elements while scanning for events would
                     // be very tricky, so we make a second cleanup pass).
+    char *in_buffer;               // bytes from TCP stream not yet parsed
+                                   //     into messages (allocated on first
+                                   //     read, O2N_IN_BUFFER_SIZE bytes)
+    int in_buffer_len;             // how many bytes are in in_buffer?
     int32_t in_length;             // incoming message length
-    o2_message_ptr in_message;     // message data from TCP stream goes here
-    int in_length_got;             // how many bytes of length have been read?
+    o2_message_ptr in_message;     // message data goes here; for TCP, only
+                                   //     used for messages too big for
+                                   //     in_buffer, which are read directly
     int in_msg_got;                // how many bytes of message have been read?
     
     o2_message_ptr out_message;    // list of pending output messages with
-                                   //      data in network byte order
+                                   //      data in network byte order, or in
+                                   //      host order if O2_MSG_HOST_ORDER
+    o2_message_ptr out_tail;       // last message in out_message list
     int out_msg_sent;              // how many bytes of message have been sent?
+    int out_count;                 // number of messages in out_message
+    int out_bytes;                 // total length of messages in out_message
+    int congested;                 // TRUE after out_bytes reaches the high
+                                   // watermark until it drains to the low one
+    int flush_pending;             // TRUE if info is in o2_context->tcp_flush
+    struct uring_handle *uring;    // io_uring requests (see o2_net.c) or NULL
+    struct o2n_shm *shm;           // shared memory rings (see o2_net.c) or NULL
     int port;       // used to save port number if this is a UDP receive socket,
                     // or the server port if this is a process
+    int is_unix;    // TRUE if this is an AF_UNIX connection to a process
+                    //     on the same host
+    int unix_port;  // if is_unix, the TCP server port of the remote
+                    //     process, which names its AF_UNIX datagram socket
+                    //     (0 until known, or after falling back to UDP;
+                    //     see o2n_unix_udp_send())
     union {
         struct {
             // process name, e.g. "128.2.1.100:55765". This is used so that
@@ -178,6 +219,9 @@ typedef struct o2n_info {
             dyn_array taps;
             SOCKET udp_port; // the incoming UDP port associated with process
             struct sockaddr_in udp_sa;  // address for sending UDP messages
+            // byte order of the process, 'l' or 'b', from its !_o2/bo
+            // message, or 0 if not known (yet)
+            char byte_order;
         } proc;
         struct {                   // in the case of TCP, this name is created
             o2string service_name; // for the OSC_TCP_SERVER and is shared
@@ -199,6 +243,13 @@ typedef struct proc_tap_data {
 } proc_tap_data, *proc_tap_data_ptr;
 
 
+// a UDP message waiting in o2_context->udp_batch
+typedef struct o2n_udp_pending {
+    o2_message_ptr msg;     // message data is in network byte order
+    struct sockaddr_in to;  // destination address
+} o2n_udp_pending, *o2n_udp_pending_ptr;
+
+
 extern struct sockaddr_in o2n_broadcast_to_addr;
 extern SOCKET o2n_broadcast_sock;
 extern SOCKET o2n_udp_send_sock;
@@ -209,6 +260,9 @@ extern int o2_found_network; // true if we have an IP address, which implies a
 
 extern int (*o2n_send_by_tcp)(o2n_info_ptr info);
 extern int o2n_socket_delete_flag;
+extern int o2n_udp_batch_limit; // if non-zero, UDP sends are batched
+extern int o2n_tcp_deferred; // if TRUE, TCP sends wait for o2n_tcp_flush()
+extern int o2n_queue_high; // if non-zero, limit on bytes queued for TCP
 extern o2n_info_ptr o2_message_source; ///< socket info for current message
 
 // initialize this module
@@ -237,6 +291,11 @@ void o2n_free_deleted_sockets();
 // poll for messages
 int o2n_recv();
 
+// block until some socket is ready or timeout (in seconds) has elapsed.
+// A negative timeout means wait indefinitely. Nothing is read here:
+// follow this with o2n_recv() to handle the events.
+void o2n_wait(o2_time timeout);
+
 // create a socket for UDP broadcasting messages
 int o2n_broadcast_socket_new(SOCKET *sock);
 
@@ -274,5 +333,38 @@ int o2n_send(o2n_info_ptr info, int block);
 //
 int o2n_enqueue(o2n_info_ptr info, o2_message_ptr msg);
 
+// Send a UDP message (in network byte order) to address to. Frees msg.
+// If batching is enabled (o2n_udp_batch_limit), the message is queued and
+// sent by o2n_udp_flush().
+int o2n_udp_send(o2_message_ptr msg, struct sockaddr_in *to);
+
+// send all batched UDP messages
+void o2n_udp_flush();
+
+#ifdef __linux__
+// Send a UDP message (in network byte order) to the AF_UNIX datagram
+// socket of proc, a process on this host. If that socket is full, send
+// by UDP instead, and clear proc->unix_port so that later messages also
+// go by UDP and arrive in order. Frees msg. These messages are not
+// batched unless they are sent by UDP.
+int o2n_unix_udp_send(o2_message_ptr msg, o2n_info_ptr proc);
+
+// offer shared memory to a newly connected process on this host
+void o2n_shm_offer(o2n_info_ptr info);
+
+// handle a !_o2/sh message of the given kind from info
+void o2n_shm_message(o2n_info_ptr info, int kind);
+
+// TRUE if messages to info are written to a shared memory ring
+int o2n_shm_ready(o2n_info_ptr info);
+#endif
+
+// free all queued output messages of info and reset the queue counts
+void o2n_free_out_messages(o2n_info_ptr info);
+
+// send queued TCP messages for every connection in o2_context->tcp_flush
+// (only used if o2n_tcp_deferred is set)
+void o2n_tcp_flush();
+
 // send a UDP message to localhost
 void o2n_local_udp_send(char *msg, int len, int port);
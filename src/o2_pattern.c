@@ -0,0 +1,603 @@
+// o2_pattern.c -- compiled address patterns
+//
+// A pattern is compiled into a list of alternatives, one for each
+// combination of strings in {brace lists}, e.g. "v{1,2}*" has the
+// alternatives "v1*" and "v2*". An alternative is a sequence of items
+// that match one character (a literal, '?' or a [set]) or any number of
+// characters ('*'). An alternative without '*' only matches names of
+// its own length, and a literal prefix followed by '*' only needs a
+// prefix comparison. Otherwise, the alternative is matched by a loop
+// that backtracks only to the most recent '*', so matching takes
+// O(n * m) time, where the recursive o2_pattern_match() (below) can
+// take exponential time.
+//
+// Compiled patterns are cached in o2_context->pattern_cache, a small
+// direct-mapped table indexed by a hash of the pattern text.
+
+#include "o2_internal.h"
+#include "o2_pattern.h"
+
+#ifndef NEGATE
+#define NEGATE  '!'
+#endif
+
+// a pattern with more alternatives than this is not expanded, and is
+// matched by o2_pattern_match()
+#define MAX_ALTERNATIVES 64
+
+#define ITEM_LITERAL 0 // matches c
+#define ITEM_ANY 1     // '?' matches any character
+#define ITEM_SET 2     // [set] matches characters in sets[set]
+#define ITEM_STAR 3    // '*' matches zero or more characters
+
+typedef struct pattern_item {
+    char op;   // ITEM_LITERAL, ITEM_ANY, ITEM_SET or ITEM_STAR
+    char c;    // the character for ITEM_LITERAL
+    short set; // index of the set for ITEM_SET
+} pattern_item, *pattern_item_ptr;
+
+typedef struct pattern_set {
+    uint32_t bits[8]; // one bit for each (unsigned) character
+} pattern_set, *pattern_set_ptr;
+
+typedef struct pattern_alt {
+    int first;  // index of the first item in items
+    int count;  // number of items
+    int prefix; // number of literal items before any other item
+    int suffix; // number of items after the last ITEM_STAR
+    int stars;  // number of ITEM_STAR items
+    int min_len; // length of the shortest string that can match
+} pattern_alt, *pattern_alt_ptr;
+
+typedef struct o2_pattern {
+    char *text;      // the pattern, not including the slash if any
+    int len;         // length of text
+    int refs;        // number of o2_pattern_find() results not released
+    int cached;      // TRUE while the pattern is in o2_context->pattern_cache
+    int direct;      // TRUE if matched by o2_pattern_match(str, text)
+    dyn_array alts;  // the alternatives (pattern_alt)
+    dyn_array items; // items of all alternatives (pattern_item)
+    dyn_array sets;  // character sets of all alternatives (pattern_set)
+} o2_pattern;
+
+// while compiling, a pattern is a sequence of units: an item, or a
+// {brace list} of literal strings
+typedef struct pattern_unit {
+    pattern_item item;
+    const char *choices; // the first string of a brace list, or NULL
+    int n_choices;
+} pattern_unit, *pattern_unit_ptr;
+
+
+static void set_add(pattern_set_ptr set, char c)
+{
+    unsigned char u = (unsigned char) c;
+    set->bits[u >> 5] |= (uint32_t) 1 << (u & 31);
+}
+
+
+// parse a [set] the way o2_pattern_match() does: c-d is a range (and
+// d may also start another range), c-] is c and '-', and a set ending
+// at the first character, as in "[]", is empty. *p points after '['
+// and is advanced past ']'. Returns the index of the set in pat->sets,
+// or -1 if there is no ']'.
+//
+static int parse_set(o2_pattern_ptr pat, const char **p)
+{
+    pattern_set set;
+    memset(&set, 0, sizeof(set));
+    const char *s = *p;
+    int negate = (*s == NEGATE);
+    if (negate) s++;
+    char c;
+    while ((c = *s++) != ']') {
+        if (!c || !*s) {
+            return -1;
+        } else if (*s == '-') {
+            s++;
+            if (!*s) {
+                return -1;
+            } else if (*s != ']') { // range from c to *s
+                for (int i = c; i <= *s; i++) {
+                    set_add(&set, (char) i);
+                }
+                set_add(&set, c);
+                set_add(&set, *s);
+            } else { // c-] means c or '-'
+                set_add(&set, c);
+                set_add(&set, '-');
+            }
+        } else {
+            set_add(&set, c);
+        }
+    }
+    if (negate) {
+        for (int i = 0; i < 8; i++) {
+            set.bits[i] = ~set.bits[i];
+        }
+    }
+    *p = s;
+    DA_APPEND(pat->sets, pattern_set, set);
+    return pat->sets.length - 1;
+}
+
+
+// expand units into alternatives, one for each combination of brace
+// list strings
+//
+static void expand_units(o2_pattern_ptr pat, dyn_array_ptr units, int n_alts)
+{
+    for (int a = 0; a < n_alts; a++) {
+        pattern_alt alt;
+        alt.first = pat->items.length;
+        alt.stars = 0;
+        int k = a; // selects a string from each brace list
+        for (int u = 0; u < units->length; u++) {
+            pattern_unit_ptr unit = DA_GET(*units, pattern_unit, u);
+            if (unit->choices) {
+                const char *s = unit->choices;
+                for (int j = k % unit->n_choices; j > 0; j--) {
+                    while (*s++ != ',') ;
+                }
+                k /= unit->n_choices;
+                pattern_item item;
+                item.op = ITEM_LITERAL;
+                item.set = 0;
+                while (*s != ',' && *s != '}') {
+                    item.c = *s++;
+                    DA_APPEND(pat->items, pattern_item, item);
+                }
+            } else {
+                if (unit->item.op == ITEM_STAR) alt.stars++;
+                DA_APPEND(pat->items, pattern_item, unit->item);
+            }
+        }
+        alt.count = pat->items.length - alt.first;
+        pattern_item_ptr items = DA_GET(pat->items, pattern_item, alt.first);
+        alt.prefix = 0;
+        while (alt.prefix < alt.count &&
+               items[alt.prefix].op == ITEM_LITERAL) {
+            alt.prefix++;
+        }
+        alt.suffix = 0;
+        alt.min_len = 0;
+        for (int i = 0; i < alt.count; i++) {
+            if (items[i].op == ITEM_STAR) {
+                alt.suffix = 0;
+            } else {
+                alt.suffix++;
+                alt.min_len++;
+            }
+        }
+        DA_APPEND(pat->alts, pattern_alt, alt);
+    }
+}
+
+
+o2_pattern_ptr o2_pattern_compile(const char *pattern)
+{
+    int len = 0;
+    while (pattern[len] && pattern[len] != '/') len++;
+    o2_pattern_ptr pat = (o2_pattern_ptr) O2_MALLOC(sizeof(o2_pattern));
+    pat->text = (char *) O2_MALLOC(len + 1);
+    memcpy(pat->text, pattern, len);
+    pat->text[len] = 0;
+    pat->len = len;
+    pat->refs = 0;
+    pat->cached = FALSE;
+    pat->direct = FALSE;
+    DA_INIT(pat->alts, pattern_alt, 1);
+    DA_INIT(pat->items, pattern_item, len);
+    DA_INIT(pat->sets, pattern_set, 0);
+
+    dyn_array units;
+    DA_INIT(units, pattern_unit, len);
+    int n_alts = 1;
+    const char *p = pat->text;
+    while (*p) {
+        pattern_unit unit;
+        unit.item.c = 0;
+        unit.item.set = 0;
+        unit.choices = NULL;
+        unit.n_choices = 1;
+        char c = *p++;
+        if (c == '*') {
+            while (*p == '*') p++; // "**" is equivalent to "*"
+            unit.item.op = ITEM_STAR;
+        } else if (c == '?') {
+            unit.item.op = ITEM_ANY;
+        } else if (c == '[') {
+            int set = parse_set(pat, &p);
+            if (set < 0) goto no_match;
+            unit.item.op = ITEM_SET;
+            unit.item.set = set;
+        } else if (c == '{') {
+            unit.choices = p;
+            while (*p != '}') {
+                if (!*p) goto no_match;
+                if (*p++ == ',') unit.n_choices++;
+            }
+            p++; // skip the '}'
+            n_alts *= unit.n_choices;
+            if (n_alts > MAX_ALTERNATIVES) {
+                pat->direct = TRUE;
+                goto done;
+            }
+        } else {
+            unit.item.op = ITEM_LITERAL;
+            unit.item.c = c;
+        }
+        DA_APPEND(units, pattern_unit, unit);
+    }
+    expand_units(pat, &units, n_alts);
+    goto done;
+  no_match: // a malformed pattern has no alternatives and matches nothing
+    pat->alts.length = 0;
+  done:
+    DA_FINISH(units);
+    return pat;
+}
+
+
+void o2_pattern_free(o2_pattern_ptr pat)
+{
+    DA_FINISH(pat->alts);
+    DA_FINISH(pat->items);
+    DA_FINISH(pat->sets);
+    O2_FREE(pat->text);
+    O2_FREE(pat);
+}
+
+
+static int item_matches(pattern_item_ptr item, char c, pattern_set_ptr sets)
+{
+    if (item->op == ITEM_LITERAL) {
+        return item->c == c;
+    } else if (item->op == ITEM_SET) {
+        unsigned char u = (unsigned char) c;
+        return (sets[item->set].bits[u >> 5] >> (u & 31)) & 1;
+    }
+    return TRUE; // ITEM_ANY
+}
+
+
+static int alt_matches(o2_pattern_ptr pat, pattern_alt_ptr alt,
+                       const char *str)
+{
+    pattern_item_ptr items = DA_GET(pat->items, pattern_item, alt->first);
+    pattern_set_ptr sets = DA_GET(pat->sets, pattern_set, 0);
+    int n = alt->count;
+    int i;
+    // the literal prefix (this also stops at the end of str)
+    for (i = 0; i < alt->prefix; i++) {
+        if (str[i] != items[i].c) return FALSE;
+    }
+    if (!alt->stars) { // only strings of length n can match
+        for (; i < n; i++) {
+            if (!str[i] || !item_matches(items + i, str[i], sets)) {
+                return FALSE;
+            }
+        }
+        return str[n] == 0;
+    }
+    if (alt->suffix == 0 && i == n - 1) { // literal prefix and '*'
+        return TRUE;
+    }
+    // the items after the last '*' can only match the end of str
+    int len = i + (int) strlen(str + i);
+    if (len < alt->min_len) {
+        return FALSE;
+    }
+    const char *end = str + len - alt->suffix;
+    n -= alt->suffix;
+    for (int j = 0; j < alt->suffix; j++) {
+        if (!item_matches(items + n + j, end[j], sets)) {
+            return FALSE;
+        }
+    }
+    if (i == n - 1) { // only a '*' between the prefix and suffix
+        return TRUE;
+    }
+    // general case: on a mismatch, let the most recent '*' match one
+    // more character and continue from there
+    str += i;
+    int star = -1; // index of the item after the most recent '*'
+    const char *star_str = NULL; // where str was when '*' was matched
+    while (str < end) {
+        if (i < n && items[i].op == ITEM_STAR) {
+            star = ++i;
+            star_str = str;
+        } else if (i < n && item_matches(items + i, *str, sets)) {
+            i++;
+            str++;
+        } else if (star >= 0) {
+            i = star;
+            str = ++star_str;
+        } else {
+            return FALSE;
+        }
+    }
+    while (i < n && items[i].op == ITEM_STAR) i++;
+    return i == n;
+}
+
+
+int o2_pattern_matches(o2_pattern_ptr pat, const char *str)
+{
+    if (pat->direct) {
+        return o2_pattern_match(str, pat->text);
+    }
+    for (int i = 0; i < pat->alts.length; i++) {
+        if (alt_matches(pat, DA_GET(pat->alts, pattern_alt, i), str)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+// remove pat from the cache, and free it unless it is in use
+//
+static void pattern_uncache(o2_pattern_ptr pat)
+{
+    pat->cached = FALSE;
+    if (pat->refs == 0) {
+        o2_pattern_free(pat);
+    }
+}
+
+
+o2_pattern_ptr o2_pattern_find(const char *pattern)
+{
+    uint32_t hash = 2166136261u; // FNV-1a hash of the pattern
+    int len = 0;
+    while (pattern[len] && pattern[len] != '/') {
+        hash = (hash ^ (unsigned char) pattern[len++]) * 16777619u;
+    }
+    o2_pattern_ptr *slot = &o2_context->pattern_cache[hash %
+                                                      PATTERN_CACHE_SIZE];
+    o2_pattern_ptr pat = *slot;
+    if (!pat || pat->len != len || memcmp(pat->text, pattern, len) != 0) {
+        if (pat) pattern_uncache(pat);
+        pat = o2_pattern_compile(pattern);
+        pat->cached = TRUE;
+        *slot = pat;
+    }
+    pat->refs++;
+    return pat;
+}
+
+
+void o2_pattern_release(o2_pattern_ptr pat)
+{
+    if (--pat->refs == 0 && !pat->cached) {
+        o2_pattern_free(pat);
+    }
+}
+
+
+void o2_pattern_cache_initialize()
+{
+    memset(o2_context->pattern_cache, 0, sizeof(o2_context->pattern_cache));
+}
+
+
+void o2_pattern_cache_finish()
+{
+    for (int i = 0; i < PATTERN_CACHE_SIZE; i++) {
+        o2_pattern_ptr pat = o2_context->pattern_cache[i];
+        if (pat) {
+            pattern_uncache(pat);
+            o2_context->pattern_cache[i] = NULL;
+        }
+    }
+}
+
+
+/**
+ * robust glob pattern matcher
+ *
+ *  @param str oringinal string, a node name terminated by zero (eos)
+ *  @param p   the string with pattern, p can be the remainder of a whole
+ *             address pattern, so it is terminated by either zero (eos)
+ *             or slash (/)
+ *
+ *  @return Iff match, return TRUE.
+ *
+ * glob patterns:
+ *  *   matches zero or more characters
+ *  ?   matches any single character
+ *  [set]   matches any character in the set
+ *  [^set]  matches any character NOT in the set
+ *      where a set is a group of characters or ranges. a range
+ *      is written as two characters seperated with a hyphen: a-z denotes
+ *      all characters between a to z inclusive.
+ *  [-set]  set matches a literal hypen and any character in the set
+ *  []set]  matches a literal close bracket and any character in the set
+ *
+ *  char    matches itself except where char is '*' or '?' or '['
+ *  \char   matches char, including any pattern character
+ *
+ * examples:
+ *  a*c     ac abc abbc ...
+ *  a?c     acc abc aXc ...
+ *  a[a-z]c     aac abc acc ...
+ *  a[-a-z]c    a-c aac abc ...
+ */
+int o2_pattern_match(const char *str, const char *p)
+{
+    int negate; // the ! is used before a character or range of characters
+    int match;  // a boolean used to exit a loop looking for a match
+    char c;     // a character from the pattern
+    
+    // match each character of the pattern p with string str up to
+    //   pattern end marked by zero (end of string) or '/'
+    while (*p && *p != '/') {
+        // fast exit: if we have exhausted str and there is more
+        //   pattern to match, give up (unless *p is '*' or '{', which
+        //   can match zero characters)
+        // also, [!...] processing assumes a character to match in str
+        //   without checking, so the case of !*str is handled here
+        if (!*str && *p != '*' && *p != '{') {
+            return FALSE;
+        }
+        
+        // process the next character(s) of the pattern
+        switch ((c = *p++)) {
+            case '*': // matches 0 or more characters
+                while (*p == '*') p++; // "*...*" is equivalent to "*" so
+                                       // skip over a run of '*'s
+                
+                // if there are no more pattern characters, we can match
+                //   '*' to the rest of str, so we have a match. This is an
+                //   optimization that tests for a special case:
+                if (!*p || *p == '/') return TRUE;
+                
+                // if the next pattern character is not a meta character,
+                //   we can skip over all the characters in str that
+                //   do not match: at least these skipped characters must
+                //   match the '*'. This is an optimization:
+                if (*p != '?' && *p != '[' && *p != '{')
+                    while (*str && *p != *str) str++;
+                
+                // we do not know if '*' should match more characters or
+                //   not, so we have to try every possibility. This is
+                //   done recursively. There are more special cases and
+                //   possible optimizations, but at this point we give up
+                //   looking for special cases and just try everything
+                //   (including matching all of str, since "{,x}" can
+                //   match an empty string):
+                while (!o2_pattern_match(str, p)) {
+                    if (!*str++) {
+                        return FALSE;
+                    }
+                }
+                return TRUE;
+                
+            case '?': // matches exactly 1 character in str
+                if (*str) break; // success
+                return FALSE;
+            /*
+             * set specification is inclusive, that is [a-z] is a, z and
+             * everything in between. this means [z-a] may be interpreted
+             * as a set that contains z, a and nothing in between.
+             */
+            case '[':
+                if (*p != NEGATE) {
+                    negate = 1;
+                } else {
+                    negate = 0; // note that negate == 0 if '!' found
+                    p++;        //   so in this case, 0 means "true"
+                }
+                
+                match = 0; // no match found yet
+                // search in set for a match until it is found
+                // if/when you exit the loop, p is pointing to ']' or
+                //   before it, or c == ']' and p points to the
+                //   next character
+                while (!match) {
+                    c = *p++;
+                    if (!c || c == '/') { // no matching ']', e.g. "[!"
+                        return FALSE;
+                    } else if (c == ']') {
+                        p--; // because we search forward for ']' below
+                        break;
+                    } else if (!*p || *p == '/') { // no matching ']'
+                        return FALSE;
+                    } else if (*p == '-') {  // expected syntax is c-c
+                        p++;
+                        if (!*p || *p == '/')
+                            return FALSE; // expected to find at least ']'
+                        if (*p != ']') {  // found end of range
+                            match = (*str == c || *str == *p ||
+                                     (*str > c && *str < *p));
+                        } else {  //  c-] means ok to match c or '-'
+                            match = (*str == c || *str == '-');
+                        }
+                    } else {   // no dash, so see if we match 'c'
+                        match = (c == *str);
+                    }
+                }
+                
+                if (negate != match) { // negate is 0 for "[!...]"
+                    return FALSE;
+                }
+                // if there is a match, skip past the cset and continue on
+                while ((c = *p++) != ']') {
+                    if (!c || c == '/') { // no matching ']' in pattern
+                        return FALSE;
+                    }
+                }
+                break;
+                
+            /*
+             * {astring,bstring,cstring}: This is tricky because astring
+             *   could be a prefix of bstring, so even if astring matches
+             *   the beginning of str, we may have to backtrack and match
+             *   bstring in order to get an overall match
+             */
+            case '{': {
+                // *p is now first character in the {brace list}
+                const char *place = str;        // to backtrack
+                const char *remainder = p;      // to forwardtrack
+                
+                // find the end of the brace list (or end of pattern)
+                c = *remainder;
+                while (c != '}') {
+                    if (!c || c == '/') {  // unexpected end of pattern
+                        return FALSE;
+                    }
+                    c = *remainder++;
+                }
+                c = *p++;
+                
+                // test each string in the {brace list}. At the top of
+                //   the loop:
+                //     c is a character of a {brace list} string
+                //     p points to the next character after c
+                //     str points to the so-far unmatched remainder of
+                //         the address
+                //     place points to the location in str that must
+                //         be matched with this {brace list}
+                while (c && c != '/') {
+                    if (c == ',') {
+                        // recursively see if we can complete the match
+                        if (o2_pattern_match(str, remainder)) {
+                            return TRUE;
+                        } else {
+                            str = place; // backtrack on test string
+                            // continue testing with the next string
+                            if (!*p || *p == '/') { // unexpected end
+                                return FALSE;
+                            }
+                        }
+                    } else if (c == '}') {
+                        str--;  // str is incremented again below
+                        break;
+                    } else if (c == *str) { // match a character
+                        str++;
+                    } else {    // skip to next comma
+                        str = place;
+                        while ((c = *p++) != ',') {
+                            if (!c || c == '/' || c == '}') {
+                                return FALSE; // no more choices, so no match
+                            }
+                        }
+                    }
+                    c = *p++;
+                }
+                break;
+            }
+                
+            default:
+                if (c != *str) {
+                    return FALSE;
+                }
+                break;
+        }
+        str++;
+    }
+    // since we have reached the end of the pattern, we match iff we are
+    //   also at the end of the string:
+    return (*str == 0);
+}
@@ -0,0 +1,62 @@
+// o2_pattern.h -- compiled address patterns
+//
+// A pattern is one node name of an address, e.g. "voice*" in
+// "/synth/voice*/gain". Patterns are compiled once and cached (see
+// o2_pattern_find()), so messages sent repeatedly to the same pattern
+// address do not parse the pattern again for every node they are
+// matched against.
+
+#ifndef o2_pattern_h
+#define o2_pattern_h
+
+typedef struct o2_pattern *o2_pattern_ptr;
+
+/**
+ * compile a pattern
+ *
+ * @param pattern the pattern, terminated by zero (eos) or slash (/)
+ *
+ * @return the compiled pattern. Free it with o2_pattern_free().
+ */
+o2_pattern_ptr o2_pattern_compile(const char *pattern);
+
+void o2_pattern_free(o2_pattern_ptr pat);
+
+/**
+ * match a node name with a compiled pattern
+ *
+ * @param pat the pattern returned by o2_pattern_compile()
+ * @param str the node name, terminated by zero (eos)
+ *
+ * @return TRUE iff str matches pat, with the same result as
+ *         o2_pattern_match(str, pattern)
+ */
+int o2_pattern_matches(o2_pattern_ptr pat, const char *str);
+
+/**
+ * get a compiled pattern from the cache in o2_context, compiling it
+ * if needed. Call o2_pattern_release() when done with the result: a
+ * pattern that is replaced in the cache while it is still in use (e.g.
+ * by a recursive search for the next node name) is freed on release.
+ *
+ * @param pattern the pattern, terminated by zero (eos) or slash (/)
+ */
+o2_pattern_ptr o2_pattern_find(const char *pattern);
+
+void o2_pattern_release(o2_pattern_ptr pat);
+
+void o2_pattern_cache_initialize(void);
+
+void o2_pattern_cache_finish(void);
+
+/**
+ * glob pattern matcher that interprets the pattern directly
+ *
+ * @param str a node name terminated by zero (eos)
+ * @param p the pattern, terminated by zero (eos) or slash (/)
+ *
+ * @return TRUE iff str matches p
+ */
+int o2_pattern_match(const char *str, const char *p);
+
+#endif /* o2_pattern_h */
@@ -121,6 +121,7 @@ DEBUG*/
 //
 int o2_schedule(o2_sched_ptr s, o2_message_ptr m)
 {
+    m = o2_message_unshare(m); // the table links messages with m->next
     o2_time mt = m->data.timestamp;
     if (mt <= 0 || mt < s->last_time) {
         // it was probably a mistake to schedule the message when the timestamp
@@ -149,6 +150,23 @@ int o2_schedule(o2_sched_ptr s, o2_message_ptr m)
 }
 
 
+// Find the earliest timestamp of any message scheduled on s, or -1 if
+// nothing is scheduled. Each list is sorted, so we only need to look at
+// the head of each bin.
+//
+o2_time o2_sched_earliest(o2_sched_ptr s)
+{
+    o2_time earliest = -1;
+    for (int i = 0; i < O2_SCHED_TABLE_LEN; i++) {
+        o2_message_ptr m = s->table[i];
+        if (m && (earliest < 0 || m->data.timestamp < earliest)) {
+            earliest = m->data.timestamp;
+        }
+    }
+    return earliest;
+}
+
+
 // This looks for messages <= now and delivers them
 //
 static void sched_dispatch(o2_sched_ptr s, o2_time run_until_time)
@@ -8,3 +8,5 @@ void o2_sched_initialize(void);
 
 void o2_sched_poll(void);
 
+o2_time o2_sched_earliest(o2_sched_ptr s);
+
@@ -36,11 +36,16 @@
 //                     o2_node_ptr service)
 //         delivers a message or bundle locally. Calls
 //         o2_embedded_msgs_deliver() if this is a bundle.
-//         Otherwise, uses find_and_call_handlers_rec().
+//         Otherwise, looks up the whole address in full_path_table, or
+//         for pattern addresses, uses call_pattern_handlers(), which
+//         caches the handlers that find_and_call_handlers_rec() finds.
 // o2_embedded_msgs_deliver(o2_msg_data_ptr msg, int tcp_flag)
 //         Deliver or schedule messages in a bundle (recursively).
-//         Calls o2_msg_data_send() to deliver each embedded message
-//         message, which copies the element into an o2_message if needed.
+//         Elements that are due now for a local service without taps
+//         are delivered in place with o2_msg_data_deliver() unless
+//         messages are pending, which must be delivered first. Others
+//         are passed to o2_message_send_sched() as views of the bundle,
+//         which are copied into an o2_message if needed.
 //
 // Message parsing and forming o2_argv with message parameters is not
 // reentrant since there is a global buffer used to store coerced
@@ -56,6 +61,7 @@
 #include "o2_message.h"
 #include "o2_discovery.h"
 #include "o2_send.h"
+#include "o2_pattern.h"
 #include "o2_sched.h"
 
 #ifdef WIN32
@@ -65,8 +71,15 @@
 
 thread_local o2_context_ptr o2_context = NULL;
 
+// incremented whenever the provider of any service may have changed, so
+// that templates (see o2_template_new()) know to look up services again
+int o2_services_generation = 0;
+
+// incremented whenever a handler may have been added or removed, so that
+// dispatch caches (see dispatch_cache_find()) know to search again
+int o2_handlers_generation = 0;
+
 static void entry_free(o2_node_ptr entry);
-static int o2_pattern_match(const char *str, const char *p);
 static int entry_remove(hash_node_ptr node, o2_node_ptr *child, int resize);
 static int remove_method_from_tree(char *remaining, char *name,
                                    hash_node_ptr node);
@@ -75,6 +88,8 @@ static int remove_remote_services(o2n_info_ptr info);
 static int remove_taps_by(o2n_info_ptr info);
 static int resize_table(hash_node_ptr node, int new_locs);
 static hash_node_ptr tree_insert_node(hash_node_ptr node, o2string key);
+static int64_t get_hash(o2string key);
+static void thaw_table(hash_node_ptr node);
 
 
 
@@ -111,41 +126,37 @@ void o2_enumerate_begin(enumerate_ptr enumerator, dyn_array_ptr dict)
 {
     enumerator->dict = dict;
     enumerator->index = 0;
-    enumerator->entry = NULL;
 }
 
 
 // return next entry from table. Entries can be inserted into
 // a new table because enumerate_next does not depend upon the
-// pointers in each entry once the entry is enumerated.
+// pointers in each entry once the entry is enumerated. Removing
+// the entry just returned only marks its slot as deleted, so
+// enumeration continues with the next entry.
 //
 o2_node_ptr o2_enumerate_next(enumerate_ptr enumerator)
 {
-    while (!enumerator->entry) {
-        int i = enumerator->index++;
-        if (i >= enumerator->dict->length) {
-            return NULL; // no more entries
-        }
-        enumerator->entry = *DA_GET(*(enumerator->dict),
-                                    o2_node_ptr, i);
+    while (enumerator->index < enumerator->dict->length) {
+        o2_node_ptr entry = DA_GET(*(enumerator->dict), hash_slot,
+                                   enumerator->index++)->entry;
+        if (entry) return entry;
     }
-    o2_node_ptr ret = enumerator->entry;
-    enumerator->entry = enumerator->entry->next;
-    return ret;
+    return NULL; // no more entries
 }
 
 #ifndef O2_NO_DEBUGGING
 static const char *entry_tags[6] = { "NODE_HASH", "NODE_HANDLER", "NODE_SERVICES", "NODE_TAP",
                                      "NODE_OSC_REMOTE_SERVICE", "NODE_BRIDGE_SERVICE" };
-static const char *info_tags[10] = { "INFO_TCP_SERVER", "INFO_TCP_NOMSGYET", "INFO_TCP_NOCLOCK",
+static const char *info_tags[11] = { "INFO_SHM_DOORBELL", "INFO_TCP_SERVER", "INFO_UNIX_SERVER", "INFO_TCP_NOCLOCK",
                                      "INFO_TCP_SOCKET", "INFO_UDP_SOCKET", "INFO_OSC_UDP_SERVER",
                                      "INFO_OSC_TCP_SERVER", "INFO_OSC_TCP_CONNECTION",
                                      "INFO_OSC_TCP_CONNECTING", "INFO_OSC_TCP_CLIENT" };
 const char *o2_tag_to_string(int tag)
 {
     if (tag <= NODE_BRIDGE_SERVICE) return entry_tags[tag - NODE_HASH];
-    if (tag >= INFO_TCP_SERVER && tag <= INFO_OSC_TCP_CLIENT)
-        return info_tags[tag - INFO_TCP_SERVER];
+    if (tag >= INFO_SHM_DOORBELL && tag <= INFO_OSC_TCP_CLIENT)
+        return info_tags[tag - INFO_SHM_DOORBELL];
     static char unknown[32];
     snprintf(unknown, 32, "Tag-%d", tag);
     return unknown;
@@ -208,18 +219,51 @@ void o2_info_show(o2n_info_ptr info, int indent)
 int o2_add_entry_at(hash_node_ptr node, o2_node_ptr *loc,
                     o2_node_ptr entry)
 {
+    hash_slot_ptr slot = (hash_slot_ptr) loc;
+    assert(!slot->entry);
+    if (node->frozen) thaw_table(node);
+    if (slot->hash == SLOT_DELETED) node->num_deleted--;
     node->num_children++;
-    entry->next = *loc;
-    
-    *loc = entry;
-    // expand table if it is too small
-    if (node->num_children * 3 > node->children.length * 2) {
+    entry->next = NULL;
+    slot->entry = entry;
+    slot->hash = (uint32_t) get_hash(entry->key);
+    // expand table if it is too small (deleted slots count as full
+    // because lookups probe past them)
+    if ((node->num_children + node->num_deleted) * 3 >
+        node->children.length * 2) {
         return resize_table(node, node->num_children * 3);
     }
     return O2_SUCCESS;
 }
 
 
+// find the decode plan for types in handler's plans, making a new one
+// if needed. Returns NULL if types do not match and handler does not
+// coerce. The caller checks that the type strings have the same length.
+//
+static o2_decode_plan_ptr find_plan(handler_entry_ptr handler,
+                                    const char *types)
+{
+    int i;
+    for (i = 0; i < HANDLER_PLANS && handler->plans[i]; i++) {
+        if (streql(handler->plans[i]->types, types)) {
+            return handler->plans[i];
+        }
+    }
+    if (!handler->coerce_flag && !streql(handler->type_string, types)) {
+        return NULL;
+    }
+    o2_decode_plan_ptr plan = o2_decode_plan_new(types, handler->type_string);
+    if (i == HANDLER_PLANS) { // all plans in use: replace them in turn
+        i = handler->next_plan;
+        handler->next_plan = (i + 1) % HANDLER_PLANS;
+        o2_decode_plan_free(handler->plans[i]);
+    }
+    handler->plans[i] = plan;
+    return plan;
+}
+
+
 // call handler for message. Does type coercion, argument vector
 // construction, and type checking. types points to the type string
 // after the initial ','
@@ -241,9 +285,36 @@ static void call_handler(handler_entry_ptr handler, o2_msg_data_ptr msg,
 
     // type checking
     if (handler->type_string && // mismatch detection needs type_string
-        ((handler->types_len != types_len) || // first check if counts are equal
-         !(handler->coerce_flag ||  // need coercion or exact match
-           (streql(handler->type_string, types))))) {
+        handler->types_len != types_len) { // first check if counts are equal
+        return; // type mismatch
+    }
+    if (handler->type_string && handler->parse_args) {
+        // the plan caches the type check as well as how to build argv
+        o2_decode_plan_ptr plan = find_plan(handler, types);
+        if (!plan || plan->argc < 0) {
+            return; // type mismatch
+        }
+        if (handler->struct_info) { // o2_method_new_struct() handler
+            o2_struct_info_ptr info = handler->struct_info;
+            if (plan->generic || o2_decode_plan_to_struct(plan, msg, types,
+                                         info->offsets, info->buffer)) {
+                return; // malformed message or value cannot be coerced
+            }
+            (*((o2_struct_handler) handler->handler))(msg, info->buffer,
+                                                       handler->user_data);
+            return;
+        }
+        if (!plan->generic) {
+            if (o2_decode_plan_extract(plan, msg, types)) {
+                return; // malformed message or value cannot be coerced
+            }
+            (*(handler->handler))(msg, handler->type_string, o2_context->argv,
+                                  o2_context->argc, handler->user_data);
+            return;
+        }
+    } else if (handler->type_string &&
+               !(handler->coerce_flag ||  // need coercion or exact match
+                 (streql(handler->type_string, types)))) {
         // printf("!!! %s: call_handler skipping %s due to type mismatch\n",
         //        o2_debug_prefix, msg->address);
         return; // type mismatch
@@ -298,28 +369,42 @@ hash_node_ptr o2_hash_node_new(const char *key)
 //     for the hash function
 // node is the current node in the tree
 // msg is message to be dispatched
+// found, if not NULL, is a dynamic array of handler_entry_ptr: matching
+//     handlers are appended to it instead of being called
 //
 static void find_and_call_handlers_rec(char *remaining, char *name,
-        o2_node_ptr node, o2_msg_data_ptr msg, char *types)
+        o2_node_ptr node, o2_msg_data_ptr msg, char *types,
+        dyn_array_ptr found)
 {
     char *slash = strchr(remaining, '/');
     if (slash) *slash = 0;
     char *pattern = strpbrk(remaining, "*?[{");
     if (slash) *slash = '/';
     if (pattern) { // this is a pattern 
+        // the compiled pattern is cached, so messages sent repeatedly
+        // to the same pattern address do not compile it again
+        o2_pattern_ptr pat = o2_pattern_find(remaining);
         enumerate enumerator;
         o2_enumerate_begin(&enumerator, &(((hash_node_ptr)node)->children));
         o2_node_ptr entry;
         while ((entry = o2_enumerate_next(&enumerator))) {
             if (slash && (entry->tag == NODE_HASH) &&
-                (o2_pattern_match(entry->key, remaining) == O2_SUCCESS)) {
-                find_and_call_handlers_rec(slash + 1, name, entry, msg, types);
-            } else if (!slash && (entry->tag == NODE_HANDLER)) {
-                char *path_end = remaining + strlen(remaining);
-                path_end = WORD_ALIGN_PTR(path_end);
-                call_handler((handler_entry_ptr) entry, msg, path_end + 5);
+                o2_pattern_matches(pat, entry->key)) {
+                find_and_call_handlers_rec(slash + 1, name, entry, msg, types,
+                                           found);
+            } else if (!slash && (entry->tag == NODE_HANDLER) &&
+                       o2_pattern_matches(pat, entry->key)) {
+                if (found) {
+                    DA_APPEND(*found, handler_entry_ptr,
+                              (handler_entry_ptr) entry);
+                } else {
+                    char *path_end = remaining + strlen(remaining);
+                    path_end = WORD_ALIGN_PTR(path_end);
+                    call_handler((handler_entry_ptr) entry, msg, path_end + 5);
+                }
             }
         }
+        o2_pattern_release(pat);
     } else { // no pattern characters so do hash lookup
         if (slash) *slash = 0;
         o2_string_pad(name, remaining);
@@ -328,21 +413,170 @@ static void find_and_call_handlers_rec(char *remaining, char *name,
         if (entry) {
             if (slash && (entry->tag == NODE_HASH)) {
                 find_and_call_handlers_rec(slash + 1, name, entry,
-                                           msg, types);
+                                           msg, types, found);
             } else if (!slash && (entry->tag == NODE_HANDLER)) {
-                char *path_end = remaining + strlen(remaining);
-                path_end = WORD_ALIGN_PTR(path_end);
-                call_handler((handler_entry_ptr) entry, msg, path_end + 5);
+                if (found) {
+                    DA_APPEND(*found, handler_entry_ptr,
+                              (handler_entry_ptr) entry);
+                } else {
+                    char *path_end = remaining + strlen(remaining);
+                    path_end = WORD_ALIGN_PTR(path_end);
+                    call_handler((handler_entry_ptr) entry, msg, path_end + 5);
+                }
             }
         }
     }
 }
 
 
+static void dispatch_result_free(dispatch_result_ptr result)
+{
+    DA_FINISH(result->handlers);
+    O2_FREE(result->address);
+    O2_FREE(result);
+}
+
+
+// remove result from its cache, and free it unless handlers are
+// being called from it (see call_pattern_handlers())
+//
+static void dispatch_result_uncache(dispatch_result_ptr result)
+{
+    result->cached = FALSE;
+    if (!result->busy) {
+        dispatch_result_free(result);
+    }
+}
+
+
+static void dispatch_cache_free(dispatch_cache_ptr cache)
+{
+    for (int i = 0; i < cache->results.length; i++) {
+        dispatch_result_uncache(*DA_GET(cache->results,
+                                        dispatch_result_ptr, i));
+    }
+    DA_FINISH(cache->results);
+    O2_FREE(cache);
+}
+
+
+// find the handlers for a pattern address in the cache of ss, or
+// search the path tree of service for them and cache the result,
+// replacing the least recently used result if the cache is full.
+// remaining is the address after "/service/".
+//
+static dispatch_result_ptr dispatch_cache_find(services_entry_ptr ss,
+        hash_node_ptr service, char *remaining, char *name,
+        o2_msg_data_ptr msg, char *types)
+{
+    dispatch_cache_ptr cache = ss->dispatch;
+    if (!cache) {
+        cache = (dispatch_cache_ptr) O2_CALLOC(1, sizeof(dispatch_cache));
+        DA_INIT(cache->results, dispatch_result_ptr, DISPATCH_CACHE_SIZE);
+        cache->generation = o2_handlers_generation;
+        ss->dispatch = cache;
+    } else if (cache->generation != o2_handlers_generation) {
+        // handlers were added or removed, so every result may be wrong
+        for (int i = 0; i < cache->results.length; i++) {
+            dispatch_result_uncache(*DA_GET(cache->results,
+                                            dispatch_result_ptr, i));
+        }
+        cache->results.length = 0;
+        cache->generation = o2_handlers_generation;
+    }
+    uint32_t hash = 2166136261u; // FNV-1a hash of remaining
+    for (const char *s = remaining; *s; s++) {
+        hash = (hash ^ (unsigned char) *s) * 16777619u;
+    }
+    cache->clock++;
+    int lru = -1; // least recently used result that can be replaced
+    for (int i = 0; i < cache->results.length; i++) {
+        dispatch_result_ptr result = *DA_GET(cache->results,
+                                             dispatch_result_ptr, i);
+        if (result->hash == hash && streql(result->address, remaining)) {
+            result->last_used = cache->clock;
+            cache->hits++;
+            return result;
+        }
+        if (!result->busy && (lru < 0 || result->last_used <
+                              (*DA_GET(cache->results, dispatch_result_ptr,
+                                       lru))->last_used)) {
+            lru = i;
+        }
+    }
+    cache->misses++;
+    dispatch_result_ptr result = (dispatch_result_ptr)
+            O2_MALLOC(sizeof(dispatch_result));
+    result->address = (char *) o2_heapify(remaining);
+    result->hash = hash;
+    result->cached = TRUE;
+    result->busy = 0;
+    result->last_used = cache->clock;
+    DA_INIT(result->handlers, handler_entry_ptr, 1);
+    find_and_call_handlers_rec(remaining, name, (o2_node_ptr) service,
+                               msg, types, &result->handlers);
+    if (cache->results.length < DISPATCH_CACHE_SIZE) {
+        DA_APPEND(cache->results, dispatch_result_ptr, result);
+    } else if (lru >= 0) {
+        dispatch_result_uncache(*DA_GET(cache->results,
+                                        dispatch_result_ptr, lru));
+        DA_SET(cache->results, dispatch_result_ptr, lru, result);
+    } else { // every result is in use: do not cache this one
+        result->cached = FALSE;
+    }
+    return result;
+}
+
+
+// deliver msg, which has a pattern address, to the local service
+// with path tree service. remaining is the address after "/service/".
+//
+static void call_pattern_handlers(services_entry_ptr ss,
+        hash_node_ptr service, char *remaining, char *name,
+        o2_msg_data_ptr msg, char *types)
+{
+    dispatch_result_ptr result = dispatch_cache_find(ss, service, remaining,
+                                                     name, msg, types);
+    result->busy++;
+    int generation = o2_handlers_generation;
+    // if a handler adds or removes a method, the remaining handlers
+    // may have been freed, so stop
+    for (int i = 0; i < result->handlers.length &&
+                    generation == o2_handlers_generation; i++) {
+        call_handler(*DA_GET(result->handlers, handler_entry_ptr, i),
+                     msg, types);
+    }
+    if (--result->busy == 0 && !result->cached) {
+        dispatch_result_free(result);
+    }
+}
+
+
+int o2_dispatch_cache_stats(const char *service, int64_t *hits,
+                            int64_t *misses)
+{
+    *hits = *misses = 0;
+    if (!o2_ensemble_name) {
+        return O2_NOT_INITIALIZED;
+    }
+    services_entry_ptr ss = *o2_services_find(service);
+    if (!ss) {
+        return O2_NO_SERVICE;
+    }
+    if (ss->dispatch) {
+        *hits = ss->dispatch->hits;
+        *misses = ss->dispatch->misses;
+    }
+    return O2_SUCCESS;
+}
+
+
 void osc_info_free(osc_info_ptr osc)
 {
     if (osc->tcp_socket_info) { // TCP: close the TCP socket
         o2n_info_mark_to_free(osc->tcp_socket_info);
+        // free the name so o2_info_remove() will not look for osc
+        O2_FREE(osc->tcp_socket_info->osc.service_name);
         osc->tcp_socket_info->osc.service_name = NULL;
         osc->tcp_socket_info = NULL;   // just to be safe
         osc->service_name = NULL; // shared pointer with services_entry
@@ -373,6 +607,7 @@ static void entry_free(o2_node_ptr entry)
 {
     // printf("entry_free: freeing %s %s\n",
     //        o2_tag_to_string(entry->tag), entry->key);
+    o2_handlers_generation++; // entry may hold handlers in dispatch caches
     if (entry->tag == NODE_HASH) {
         o2_node_finish((hash_node_ptr) entry);
         O2_FREE(entry);
@@ -390,6 +625,10 @@ static void entry_free(o2_node_ptr entry)
         }
         if (handler->type_string)
             O2_FREE((void *) handler->type_string);
+        for (int i = 0; i < HANDLER_PLANS && handler->plans[i]; i++) {
+            o2_decode_plan_free(handler->plans[i]);
+        }
+        if (handler->struct_info) O2_FREE(handler->struct_info);
     } else if (entry->tag == NODE_SERVICES) {
         // free the service providers here
         services_entry_ptr ss = (services_entry_ptr) entry;
@@ -410,6 +649,7 @@ static void entry_free(o2_node_ptr entry)
             O2_FREE((void *) info->tapper);
         }
         DA_FINISH(ss->taps);
+        if (ss->dispatch) dispatch_cache_free(ss->dispatch);
     } else assert(FALSE); // nothing else should be freed
     O2_FREE((void *) entry->key);
     O2_FREE(entry);
@@ -448,9 +688,12 @@ static int64_t get_hash(o2string key)
 
 static int initialize_table(dyn_array_ptr table, int locations)
 {
-    DA_INIT(*table, o2_node_ptr, locations);
+    int n = 2; // o2_lookup() needs a power of 2
+    while (n < locations) n *= 2;
+    locations = n;
+    DA_INIT(*table, hash_slot, locations);
     if (!table->array) return O2_FAIL;
-    memset(table->array, 0, locations * sizeof(o2_node_ptr));
+    memset(table->array, 0, locations * sizeof(hash_slot)); // SLOT_EMPTY
     table->allocated = locations;
     table->length = locations;
     return O2_SUCCESS;
@@ -475,12 +718,30 @@ int o2_node_add(hash_node_ptr node, o2_node_ptr entry)
 //
 // path is "owned" by caller (so it is copied here)
 //
-int o2_method_new(const char *path, const char *typespec,
-                  o2_method_handler h, void *user_data, int coerce, int parse)
+// make a copy of struct_info (the buffer is not copied)
+//
+static o2_struct_info_ptr struct_info_new(const int *offsets, int argc,
+                                          int struct_size)
+{
+    // align the buffer for any field type
+    int header_size = (offsetof(o2_struct_info, offsets) +
+                       argc * sizeof(int) + 15) & ~15;
+    o2_struct_info_ptr info = (o2_struct_info_ptr) O2_MALLOC(
+            header_size + struct_size);
+    info->buffer = PTR(info) + header_size;
+    info->struct_size = struct_size;
+    memcpy(info->offsets, offsets, argc * sizeof(int));
+    return info;
+}
+
+
+// install a handler: the work of o2_method_new() and
+// o2_method_new_struct(). struct_info is owned by the new handler.
+//
+static int method_new(const char *path, const char *typespec,
+                      o2_method_handler h, void *user_data, int coerce,
+                      int parse, o2_struct_info_ptr struct_info)
 {
-    if (!o2_ensemble_name) {
-        return O2_NOT_INITIALIZED;
-    }
     // o2_heapify result is declared as const, but if we don't share it, there's
     // no reason we can't write into it, so this is a safe cast to (char *):
     char *key = (char *) o2_heapify(path);
@@ -498,6 +759,7 @@ int o2_method_new(const char *path, const char *typespec,
     // slash points to end of the service name in the path.
 
     int ret = O2_NO_SERVICE;
+    handler_entry_ptr handler = NULL;
     if (!services) goto free_key_return; // cleanup and return because it is
         // an error to add a method to a non-existent service
     // find the service offered by this process (o2_context->info) --
@@ -508,8 +770,7 @@ int o2_method_new(const char *path, const char *typespec,
         goto free_key_return;
     }
 
-    handler_entry_ptr handler = (handler_entry_ptr)
-            O2_MALLOC(sizeof(handler_entry));
+    handler = (handler_entry_ptr) O2_MALLOC(sizeof(handler_entry));
     handler->tag = NODE_HANDLER;
     handler->key = NULL; // gets set below with the final node of the address
     handler->handler = h;
@@ -528,6 +789,10 @@ int o2_method_new(const char *path, const char *typespec,
     handler->types_len = types_len;
     handler->coerce_flag = coerce;
     handler->parse_args = parse;
+    memset(handler->plans, 0, sizeof(handler->plans));
+    handler->next_plan = 0;
+    handler->struct_info = struct_info;
+    o2_handlers_generation++; // the new handler may match cached patterns
     
     // case 1: method is global handler for entire service replacing a
     //         NODE_HASH with specific handlers: remove the NODE_HASH
@@ -588,20 +853,62 @@ int o2_method_new(const char *path, const char *typespec,
     mhandler->full_path = NULL; // only leaf nodes have full_path pointer
     if (types_copy) types_copy = o2_heapify(typespec);
     mhandler->type_string = types_copy;
+    if (struct_info) {
+        mhandler->struct_info = struct_info_new(struct_info->offsets,
+                types_len, struct_info->struct_size);
+    }
     // put the entry in the master table
     ret = o2_node_add(&o2_context->full_path_table, (o2_node_ptr) mhandler);
     goto just_return;
   error_return_3:
     if (types_copy) O2_FREE((void *) types_copy);
   error_return_2:
+    if (struct_info) O2_FREE(struct_info);
     O2_FREE(handler);
   free_key_return: // not necessarily an error (case 1 & 2)
     O2_FREE(key);
+    // struct_info belongs to handler unless there is an error
+    if (!handler && struct_info) O2_FREE(struct_info);
   just_return:
     return ret;
 }
 
 
+int o2_method_new(const char *path, const char *typespec,
+                  o2_method_handler h, void *user_data, int coerce, int parse)
+{
+    if (!o2_ensemble_name) {
+        return O2_NOT_INITIALIZED;
+    }
+    return method_new(path, typespec, h, user_data, coerce, parse, NULL);
+}
+
+
+int o2_method_new_struct(const char *path, const char *typespec,
+                         const int *offsets, int struct_size,
+                         o2_struct_handler h, void *user_data)
+{
+    if (!o2_ensemble_name) {
+        return O2_NOT_INITIALIZED;
+    }
+    if (!typespec || !offsets || struct_size < 0) {
+        return O2_BAD_ARGS;
+    }
+    int argc = (int) strlen(typespec);
+    for (int i = 0; i < argc; i++) {
+        int size = o2_struct_field_size(typespec[i]);
+        if (size < 0) {
+            return O2_BAD_TYPE; // arrays and vectors are not supported
+        } else if (size > 0 &&
+                   (offsets[i] < 0 || offsets[i] + size > struct_size)) {
+            return O2_BAD_ARGS; // field is not within the struct
+        }
+    }
+    return method_new(path, typespec, (o2_method_handler) h, user_data,
+                      TRUE, TRUE, struct_info_new(offsets, argc, struct_size));
+}
+
+
 static const char *info_to_ipport(o2_node_ptr info)
 {
     return info->tag == INFO_TCP_SERVER ?
@@ -686,6 +993,8 @@ int o2_service_provider_replace(const char *service_name,
                 break;
             case NODE_SERVICES: // can't have a services array as a service
             case INFO_TCP_SERVER: // can't have local server port as a service
+            case INFO_UNIX_SERVER: // can't have local server port as a service
+            case INFO_SHM_DOORBELL: // can't have local doorbell as a service
             case INFO_UDP_SOCKET: // can't have udp recv socket as a service
             case INFO_OSC_UDP_SERVER: // can't have incoming OSC as a service
             case INFO_OSC_TCP_SERVER: // can't have OSC server as a service
@@ -707,6 +1016,7 @@ done:
     }
     // ASSERT: i is now the index of the service we are replacing
     DA_SET(*svlist, o2_node_ptr, i, new_service);
+    o2_services_generation++;
     return O2_SUCCESS;
 }
 
@@ -722,6 +1032,7 @@ static void remove_empty_services_entry(services_entry_ptr ss,
     if (ss->services.length == 0 && ss->taps.length == 0) {
         printf("Removing %s from &o2_context->path_tree\n", ss->key);
         remove_node(&o2_context->path_tree, ss->key);
+        o2_services_generation++;
         printf(" Here is the result:\n");
         o2_info_show(&o2_context->path_tree, 2);
         // service name (the key in path_tree) is now freed.
@@ -801,6 +1112,7 @@ int o2_service_remove(const char *service_name, o2n_info_ptr proc,
     // we found the service to replace; finalized the info depending on the
     // type, so now we have a dangling pointer in the services list
     DA_REMOVE(*svlist, o2n_info_ptr, index);
+    o2_services_generation++;
 
     o2_do_not_reenter++; // protect data structures
     // send notification message
@@ -921,18 +1233,33 @@ int o2_service_free(const char *service_name)
 
 int o2_embedded_msgs_deliver(o2_msg_data_ptr msg, int tcp_flag)
 {
+    // msg is the data of an o2_message that each element can share
+    o2_message_ptr bundle = MSG_CONTAINER(msg);
     char *end_of_msg = PTR(msg) + MSG_DATA_LENGTH(msg);
     o2_msg_data_ptr embedded = (o2_msg_data_ptr)
             (msg->address + o2_strsize(msg->address) + sizeof(int32_t));
     while (PTR(embedded) < end_of_msg) {
-        // need to copy each embedded message before sending
         int len = MSG_DATA_LENGTH(embedded);
-        o2_message_ptr message = o2_alloc_size_message(len);
-        memcpy((char *) &(message->data), (char *) embedded, len);
-        message->next = NULL;
-        message->tcp_flag = tcp_flag;
-        message->length = len;
-        o2_message_send_sched(message, TRUE);
+        services_entry_ptr ss;
+        o2_node_ptr service;
+        // an element that is due now for a local service is delivered
+        // from the bundle data without making a message. Taps and nested
+        // bundles need the element to be in a message of its own. Once
+        // anything is pending (e.g. a nested bundle), later elements must
+        // be pending too, or they would be delivered out of order.
+        if (!IS_BUNDLE(embedded) && !o2_messages_pending() &&
+            (embedded->timestamp == 0.0 ||
+             embedded->timestamp <= o2_gtsched.last_time) &&
+            (service = o2_msg_service(embedded, &ss)) &&
+            (service->tag == NODE_HANDLER || service->tag == NODE_HASH) &&
+            ss->taps.length == 0) {
+            o2_do_not_reenter++;
+            o2_msg_data_deliver(embedded, tcp_flag, service, ss);
+            o2_do_not_reenter--;
+        } else { // send a view that shares the bundle data
+            o2_message_send_sched(o2_view_new(bundle, embedded, tcp_flag),
+                                  TRUE);
+        }
         embedded = (o2_msg_data_ptr)
                 (PTR(embedded) + len + sizeof(int32_t));
     }
@@ -942,50 +1269,13 @@ int o2_embedded_msgs_deliver(o2_msg_data_ptr msg, int tcp_flag)
 
 void send_msg_data_to_tapper(o2_msg_data_ptr msg, o2string tapper)
 {
-    // construct a new message to send to tapper by replacing service name
-    // how big is the existing service name?
-    // I think coerce to char * will remove bounds checking, which might
-    // limit the search to 4 characters since msg->address is declared to
-    // be char [4]
-    // Skip first character which might be a slash; we want the slash after the
-    // service name.
-    char *slash = strchr((char *) (msg->address) + 1, '/');
-    if (!slash) {
+    // send a view of the message that replaces the service name with
+    // tapper; msg is the data of an o2_message that the view can share
+    if (!strchr((char *) (msg->address) + 1, '/')) {
         return;  // this is not a valid address, stop now
     }
-    int curlen = (int) (slash - msg->address);
-
-    // how much space will tapper take?
-    int newlen = (int) strlen(tapper) + 1; // add 1 for initial '/' or '!'
-
-    // how long is current address?
-    int curaddrlen = (int) strlen((char *) (msg->address));
-
-    // how long is new address?
-    int newaddrlen = curaddrlen + (newlen - curlen);
-
-    // what is the difference in space needed for address (and message)?
-    // "+ 4" accounts for end-of-string byte and padding in each case
-    int curaddrall = WORD_OFFSET(curaddrlen + 4); // address + padding
-    int newaddrall = WORD_OFFSET(newaddrlen + 4);
-    int extra = newaddrall - curaddrall;
-
-    // allocate a new message
-    o2_message_ptr newmsg = o2_alloc_size_message(MSG_DATA_LENGTH(msg) + extra);
-    newmsg->length = MSG_DATA_LENGTH(msg) + extra;
-    newmsg->data.timestamp = msg->timestamp;
-    // fill end of address with zeros before creating address string
-    *((int32_t *) (newmsg->data.address + WORD_OFFSET(newaddrlen))) = 0;
-    // first character is either / or ! copied from original message
-    newmsg->data.address[0] = msg->address[0];
-    // copies name and EOS:
-    memcpy((char *) (newmsg->data.address + 1), tapper, newlen);
-    memcpy((char *) (newmsg->data.address + newlen), msg->address + curlen,
-           curaddrlen - curlen);
-    // copy the rest of the message
-    memcpy((char *) (newmsg->data.address + newaddrall),
-           msg->address + curaddrall, MSG_DATA_LENGTH(msg) - curaddrall);
-    o2_message_send_sched(newmsg, FALSE);
+    o2_message_send_sched(o2_message_view(MSG_CONTAINER(msg), tapper),
+                          FALSE);
 }
 
 
@@ -1020,7 +1310,8 @@ void o2_msg_data_deliver(o2_msg_data_ptr msg, int tcp_flag,
         call_handler((handler_entry_ptr) service, msg, types);
     } else if ((address[0]) == '!') { // do full path lookup
         address[0] = '/'; // must start with '/' to get consistent hash value
-        o2_node_ptr handler = *o2_lookup(&o2_context->full_path_table, address);
+        o2_node_ptr handler = o2_lookup_entry(&o2_context->full_path_table,
+                                              address);
         address[0] = '!'; // restore address for no particular reason
         if (handler && handler->tag == NODE_HANDLER) {
             call_handler((handler_entry_ptr) handler, msg, types);
@@ -1031,8 +1322,23 @@ void o2_msg_data_deliver(o2_msg_data_ptr msg, int tcp_flag,
         if (!address) {
             // address is "/service", but "/service" is not a NODE_HANDLER
             ;
+        } else if (strpbrk(address + 1, "*?[{")) {
+            // pattern addresses are cached with their handlers
+            call_pattern_handlers(ss, (hash_node_ptr) service, address + 1,
+                                  name, msg, types);
         } else {
-            find_and_call_handlers_rec(address + 1, name, (o2_node_ptr) service, msg, types);
+            // a literal address names at most one handler, so instead of
+            // a lookup for each node name, look up the whole address in
+            // the full_path_table (which may be frozen)
+            o2_node_ptr handler = o2_lookup_entry(&o2_context->full_path_table,
+                                                  msg->address);
+            if (handler && handler->tag == NODE_HANDLER) {
+                call_handler((handler_entry_ptr) handler, msg, types);
+            } else { // search the tree, e.g. o2_msg_service() maps an
+                // address that begins with our IP:Port to the _o2 service
+                find_and_call_handlers_rec(address + 1, name,
+                        (o2_node_ptr) service, msg, types, NULL);
+            }
         }
     } // else the assumption that the service is local fails, drop the message
 
@@ -1045,14 +1351,12 @@ void o2_msg_data_deliver(o2_msg_data_ptr msg, int tcp_flag,
 
 void o2_node_finish(hash_node_ptr node)
 {
+    thaw_table(node);
     for (int i = 0; i < node->children.length; i++) {
-        o2_node_ptr e = *DA_GET(node->children, o2_node_ptr, i);
-        while (e) {
-            o2_node_ptr next = e->next;
-            entry_free(e);
-            e = next;
-        }
+        o2_node_ptr e = DA_GET(node->children, hash_slot, i)->entry;
+        if (e) entry_free(e);
     }
+    DA_FINISH(node->children);
     // not all nodes have keys, top-level nodes have key == NULL
     if (node->key) O2_FREE((void *) node->key);
 }
@@ -1090,239 +1394,256 @@ hash_node_ptr o2_node_initialize(hash_node_ptr node, const char *key)
         }
     }
     node->num_children = 0;
+    node->num_deleted = 0;
+    node->frozen = NULL;
     initialize_table(&(node->children), 2);
     return node;
 }
 
 
 // o2_lookup returns a pointer to a pointer to the entry, if any.
-// The hash table uses linked lists for collisions to make
-// deletion simple. key must be aligned on a 32-bit word boundary
+// If there is no entry, *result is NULL and result is where to insert
+// the key with o2_add_entry_at(). The hash table uses open addressing
+// with linear probing: keys are compared only when the stored hash
+// matches, and removed entries leave SLOT_DELETED slots so that probes
+// continue past them. key must be aligned on a 32-bit word boundary
 // and must be padded with zeros to a 32-bit boundary
 o2_node_ptr *o2_lookup(hash_node_ptr node, o2string key)
 {
-    int n = node->children.length;
-    int64_t hash = get_hash(key);
-    int index = hash % n;
-    // printf("o2_lookup %s in %s hash %ld index %d\n", key, node->key, hash, *index);
-    o2_node_ptr *ptr = DA_GET(node->children, o2_node_ptr, index);
-    while (*ptr) {
-        if (streql(key, (*ptr)->key)) {
-            break;
+    uint32_t mask = node->children.length - 1;
+    uint32_t hash = (uint32_t) get_hash(key);
+    // get_hash() is weak in its low bits, so mix them for the index
+    uint32_t index = hash * 0x9E3779B1u;
+    index = (index ^ (index >> 15)) & mask;
+    // printf("o2_lookup %s in %s hash %u index %u\n", key, node->key, hash, index);
+    hash_slot_ptr slots = DA_GET(node->children, hash_slot, 0);
+    hash_slot_ptr deleted = NULL; // first deleted slot, to reuse
+    while (TRUE) { // there is always an empty slot (see o2_add_entry_at)
+        hash_slot_ptr slot = slots + index;
+        if (slot->entry) {
+            if (slot->hash == hash && streql(key, slot->entry->key)) {
+                return &slot->entry;
+            }
+        } else if (slot->hash == SLOT_EMPTY) {
+            return deleted ? &deleted->entry : &slot->entry;
+        } else if (!deleted) {
+            deleted = slot;
         }
-        ptr = &((*ptr)->next);
+        index = (index + 1) & mask;
     }
-    return ptr;
 }
 
 
-#ifndef NEGATE
-#define NEGATE  '!'
-#endif
-
-/**
- * robust glob pattern matcher
- *
- *  @param str oringinal string, a node name terminated by zero (eos)
- *  @param p   the string with pattern, p can be the remainder of a whole
- *             address pattern, so it is terminated by either zero (eos)
- *             or slash (/)
- *
- *  @return Iff match, return TRUE.
- *
- * glob patterns:
- *  *   matches zero or more characters
- *  ?   matches any single character
- *  [set]   matches any character in the set
- *  [^set]  matches any character NOT in the set
- *      where a set is a group of characters or ranges. a range
- *      is written as two characters seperated with a hyphen: a-z denotes
- *      all characters between a to z inclusive.
- *  [-set]  set matches a literal hypen and any character in the set
- *  []set]  matches a literal close bracket and any character in the set
- *
- *  char    matches itself except where char is '*' or '?' or '['
- *  \char   matches char, including any pattern character
+/*
+ * FROZEN TABLES
  *
- * examples:
- *  a*c     ac abc abbc ...
- *  a?c     acc abc aXc ...
- *  a[a-z]c     aac abc acc ...
- *  a[-a-z]c    a-c aac abc ...
+ * o2_dispatch_freeze() makes a frozen_table for full_path_table and
+ * path_tree, using "hash, displace": keys are hashed into buckets of
+ * 1 or 2 keys on average. Starting with the largest bucket, we find
+ * the smallest displacement d such that every key in the bucket goes
+ * to a free slot at (hash + d * step) & mask, where step is an odd
+ * number from the hash. The displacement is saved for the bucket, so
+ * a lookup finds the key's only possible slot directly. If some
+ * bucket cannot be placed (e.g. two of its keys collide), we try
+ * again with another seed.
  */
-static int o2_pattern_match(const char *str, const char *p)
+
+#define FREEZE_TRIES 8
+
+
+// hash the words of key, which is aligned and padded as for get_hash()
+static uint64_t frozen_hash(o2string key, uint64_t seed)
 {
-    int negate; // the ! is used before a character or range of characters
-    int match;  // a boolean used to exit a loop looking for a match
-    char c;     // a character from the pattern
-    
-    // match each character of the pattern p with string str up to
-    //   pattern end marked by zero (end of string) or '/'
-    while (*p && *p != '/') {
-        // fast exit: if we have exhausted str and there is more
-        //   pattern to match, give up (unless *p is '*', which can
-        //   match zero characters)
-        // also, [!...] processing assumes a character to match in str
-        //   without checking, so the case of !*str is handled here
-        if (!*str && *p != '*') {
-            return FALSE;
-        }
-        
-        // process the next character(s) of the pattern
-        switch ((c = *p++)) {
-            case '*': // matches 0 or more characters
-                while (*p == '*') p++; // "*...*" is equivalent to "*" so
-                                       // skip over a run of '*'s
-                
-                // if there are no more pattern characters, we can match
-                //   '*' to the rest of str, so we have a match. This is an
-                //   optimization that tests for a special case:
-                if (!*p || *p == '/') return TRUE;
-                
-                // if the next pattern character is not a meta character,
-                //   we can skip over all the characters in str that
-                //   do not match: at least these skipped characters must
-                //   match the '*'. This is an optimization:
-                if (*p != '?' && *p != '[' && *p != '{')
-                    while (*str && *p != *str) str++;
-                
-                // we do not know if '*' should match more characters or
-                //   not, so we have to try every possibility. This is
-                //   done recursively. There are more special cases and
-                //   possible optimizations, but at this point we give up
-                //   looking for special cases and just try everything:
-                while (*str) {
-                    if (o2_pattern_match(str, p)) {
-                        return TRUE;
-                    }
-                    str++;
-                }
-                return FALSE;
-                
-            case '?': // matches exactly 1 character in str
-                if (*str) break; // success
-                return FALSE;
-            /*
-             * set specification is inclusive, that is [a-z] is a, z and
-             * everything in between. this means [z-a] may be interpreted
-             * as a set that contains z, a and nothing in between.
-             */
-            case '[':
-                if (*p != NEGATE) {
-                    negate = 1;
-                } else {
-                    negate = 0; // note that negate == 0 if '!' found
-                    p++;        //   so in this case, 0 means "true"
-                }
-                
-                match = 0; // no match found yet
-                // search in set for a match until it is found
-                // if/when you exit the loop, p is pointing to ']' or
-                //   before it, or c == ']' and p points to the
-                //   next character, or there is no matching ']'
-                while (!match && (c = *p++)) {
-                    if (!*p || *p == '/') { // no matching ']' in pattern
-                        return FALSE;
-                    } else if (c == ']') {
-                        p--; // because we search forward for ']' below
-                        break;
-                    } else if (*p == '-') {  // expected syntax is c-c
-                        p++;
-                        if (!*p || *p == '/')
-                            return FALSE; // expected to find at least ']'
-                        if (*p != ']') {  // found end of range
-                            match = (*str == c || *str == *p ||
-                                     (*str > c && *str < *p));
-                        } else {  //  c-] means ok to match c or '-'
-                            match = (*str == c || *str == '-');
-                        }
-                    } else {   // no dash, so see if we match 'c'
-                        match = (c == *str);
-                    }
-                }
-                
-                if (negate == match) {
-                    return FALSE;
-                }
-                // if there is a match, skip past the cset and continue on
-                while ((c = *p++) != ']') {
-                    if (!c || c == '/') { // no matching ']' in pattern
-                        return FALSE;
-                    }
-                }
-                break;
-                
-            /*
-             * {astring,bstring,cstring}: This is tricky because astring
-             *   could be a prefix of bstring, so even if astring matches
-             *   the beginning of str, we may have to backtrack and match
-             *   bstring in order to get an overall match
-             */
-            case '{': {
-                // *p is now first character in the {brace list}
-                const char *place = str;        // to backtrack
-                const char *remainder = p;      // to forwardtrack
-                
-                // find the end of the brace list (or end of pattern)
-                c = *remainder;
-                while (c != '}') {
-                    if (!c || c == '/') {  // unexpected end of pattern
-                        return FALSE;
-                    }
-                    c = *remainder++;
-                }
-                c = *p++;
-                
-                // test each string in the {brace list}. At the top of
-                //   the loop:
-                //     c is a character of a {brace list} string
-                //     p points to the next character after c
-                //     str points to the so-far unmatched remainder of
-                //         the address
-                //     place points to the location in str that must
-                //         be matched with this {brace list}
-                while (c && c != '/') {
-                    if (c == ',') {
-                        // recursively see if we can complete the match
-                        if (o2_pattern_match(str, remainder)) {
-                            return TRUE;
-                        } else {
-                            str = place; // backtrack on test string
-                            // continue testing, skipping the comma
-                            p++;
-                            if (!*p || *p == '/') { // unexpected end
-                                return FALSE;
-                            }
-                        }
-                    } else if (c == '}') {
-                        str--;  // str is incremented again below
-                        break;
-                    } else if (c == *str) { // match a character
-                        str++;
-                    } else {    // skip to next comma
-                        str = place;
-                        while ((c = *p++) != ',') {
-                            if (!c || c == '/' || c == '}') {
-                                return FALSE; // no more choices, so no match
-                            }
-                        }
-                    }
-                    c = *p++;
-                }
-                break;
+    int32_t *ikey = (int32_t *) key;
+    uint64_t hash = seed;
+    int32_t c;
+    do {
+        c = *ikey++;
+        hash = (hash ^ (uint32_t) c) * 0x100000001B3ull;
+    } while (c & STRING_EOS_MASK);
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 32);
+}
+
+
+static uint32_t frozen_bucket(frozen_table_ptr ft, uint64_t hash)
+{
+    return (uint32_t) ((hash * 0x9E3779B97F4A7C15ull) >> ft->shift);
+}
+
+
+static hash_slot_ptr frozen_slot(frozen_table_ptr ft, uint64_t hash,
+                                 uint32_t displace)
+{
+    uint32_t step = (uint32_t) (hash >> 32) | 1;
+    return DA_GET(ft->slots, hash_slot,
+                  ((uint32_t) hash + displace * step) & ft->mask);
+}
+
+
+o2_node_ptr o2_lookup_entry(hash_node_ptr node, o2string key)
+{
+    frozen_table_ptr ft = node->frozen;
+    if (!ft) {
+        return *o2_lookup(node, key);
+    }
+    uint64_t hash = frozen_hash(key, ft->seed);
+    uint32_t displace = *DA_GET(ft->displace, uint32_t,
+                                frozen_bucket(ft, hash));
+    hash_slot_ptr slot = frozen_slot(ft, hash, displace);
+    if (slot->entry && slot->hash == (uint32_t) hash &&
+        streql(key, slot->entry->key)) {
+        return slot->entry;
+    }
+    return NULL;
+}
+
+
+static void thaw_table(hash_node_ptr node)
+{
+    frozen_table_ptr ft = node->frozen;
+    if (ft) {
+        DA_FINISH(ft->displace);
+        DA_FINISH(ft->slots);
+        O2_FREE(ft);
+        node->frozen = NULL;
+    }
+}
+
+
+// sort buckets by decreasing size: elements are (size << 32) | bucket
+static int bucket_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x < y) - (x > y);
+}
+
+
+// try to place all keys with seed. keys holds the entries (sorted by
+// bucket), first[b] is the index in keys of the first key in bucket
+// b, and order holds the buckets, largest first. Returns O2_SUCCESS
+// with ft filled in, or O2_FAIL if some bucket cannot be placed.
+//
+static int freeze_with_seed(frozen_table_ptr ft, o2_node_ptr *keys,
+                            uint64_t *hashes, int *first, uint64_t *order,
+                            int num_buckets)
+{
+    memset(ft->slots.array, 0, ft->slots.length * sizeof(hash_slot));
+    memset(ft->displace.array, 0, num_buckets * sizeof(uint32_t));
+    for (int i = 0; i < num_buckets; i++) {
+        uint32_t b = (uint32_t) order[i];
+        int start = first[b];
+        int end = first[b + 1];
+        if (start == end) break; // the rest are empty too
+        uint32_t d;
+        for (d = 0; d <= ft->mask; d++) {
+            int k;
+            for (k = start; k < end; k++) { // claim a slot for each key
+                hash_slot_ptr slot = frozen_slot(ft, hashes[k], d);
+                if (slot->entry) break;
+                slot->entry = keys[k];
+                slot->hash = (uint32_t) hashes[k];
             }
-                
-            default:
-                if (c != *str) {
-                    return FALSE;
-                }
-                break;
+            if (k == end) break; // every key in the bucket has a slot
+            while (k-- > start) { // give back the slots we claimed
+                frozen_slot(ft, hashes[k], d)->entry = NULL;
+            }
+        }
+        if (d > ft->mask) {
+            return O2_FAIL;
         }
-        str++;
+        DA_SET(ft->displace, uint32_t, b, d);
     }
-    // since we have reached the end of the pattern, we match iff we are
-    //   also at the end of the string:
-    return (*str == 0);
+    return O2_SUCCESS;
+}
+
+
+static int freeze_table(hash_node_ptr node)
+{
+    thaw_table(node);
+    int n = node->num_children;
+    int num_slots = 2; // at most 80% full
+    while (num_slots < n + n / 4) num_slots *= 2;
+    int bits = 1; // 1 or 2 keys per bucket on average
+    while ((2 << bits) < n) bits++;
+    int num_buckets = 1 << bits;
+
+    frozen_table_ptr ft = O2_CALLOC(1, sizeof(frozen_table));
+    ft->mask = num_slots - 1;
+    ft->shift = 64 - bits;
+    DA_INIT(ft->slots, hash_slot, num_slots);
+    ft->slots.length = num_slots;
+    DA_INIT(ft->displace, uint32_t, num_buckets);
+    ft->displace.length = num_buckets;
+
+    o2_node_ptr *entries = O2_MALLOC(n * sizeof(o2_node_ptr) + 1);
+    o2_node_ptr *keys = O2_MALLOC(n * sizeof(o2_node_ptr) + 1);
+    uint64_t *hashes = O2_MALLOC(n * sizeof(uint64_t) + 1);
+    int *first = O2_MALLOC((num_buckets + 1) * sizeof(int));
+    uint64_t *order = O2_MALLOC(num_buckets * sizeof(uint64_t));
+    enumerate enumerator;
+    o2_enumerate_begin(&enumerator, &node->children);
+    for (int i = 0; i < n; i++) {
+        entries[i] = o2_enumerate_next(&enumerator);
+    }
+
+    int rslt = O2_FAIL;
+    for (int t = 0; t < FREEZE_TRIES && rslt != O2_SUCCESS; t++) {
+        ft->seed = 0x9E3779B97F4A7C15ull * (t + 1);
+        // sort keys by bucket: count, then place each key after the
+        // keys of lower buckets
+        memset(first, 0, (num_buckets + 1) * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            first[frozen_bucket(ft, frozen_hash(entries[i]->key,
+                                                ft->seed)) + 1]++;
+        }
+        for (int b = 0; b < num_buckets; b++) {
+            order[b] = ((uint64_t) first[b + 1] << 32) | b;
+            first[b + 1] += first[b];
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t hash = frozen_hash(entries[i]->key, ft->seed);
+            int k = first[frozen_bucket(ft, hash)]++;
+            keys[k] = entries[i];
+            hashes[k] = hash;
+        }
+        // now first[b] is the end of bucket b; shift to make it the start
+        memmove(first + 1, first, num_buckets * sizeof(int));
+        first[0] = 0;
+        qsort(order, num_buckets, sizeof(uint64_t), &bucket_compare);
+        rslt = freeze_with_seed(ft, keys, hashes, first, order, num_buckets);
+    }
+    O2_FREE(order);
+    O2_FREE(first);
+    O2_FREE(hashes);
+    O2_FREE(keys);
+    O2_FREE(entries);
+    if (rslt == O2_SUCCESS) {
+        node->frozen = ft;
+    } else {
+        DA_FINISH(ft->displace);
+        DA_FINISH(ft->slots);
+        O2_FREE(ft);
+    }
+    O2_DBd(printf("%s freeze_table %s: %d keys, %d slots, %d buckets\n",
+                  o2_debug_prefix, rslt == O2_SUCCESS ? "done" : "failed",
+                  n, num_slots, num_buckets));
+    return rslt;
+}
+
+
+int o2_dispatch_freeze()
+{
+    if (!o2_ensemble_name) {
+        return O2_NOT_INITIALIZED;
+    }
+    int rslt = freeze_table(&o2_context->full_path_table);
+    if (rslt == O2_SUCCESS) {
+        rslt = freeze_table(&o2_context->path_tree);
+    }
+    return rslt;
 }
 
 
@@ -1346,11 +1667,25 @@ int o2_remove_method(const char *path)
     char *path_copy = (char *) o2_heapify(path);
     if (!path_copy) return O2_FAIL;
     char name[NAME_BUF_LEN];
+    int rslt = O2_FAIL;
+    
+    // the method is in the path tree of our local offering of the service
+    char *remaining = path_copy + 1; // skip the initial "/"
+    char *slash = strchr(remaining, '/');
+    if (!slash) goto done;
+    *slash = 0;
+    services_entry_ptr services = *o2_services_find(remaining);
+    *slash = '/';
+    if (!services) goto done;
+    o2_node_ptr node = o2_proc_service_find(o2_context->info, services);
+    if (!node || node->tag != NODE_HASH) goto done;
     
     // search path elements as tree nodes -- to get the keys, replace each
     // "/" with EOS and o2_heapify to copy it, then restore the "/"
-    char *remaining = path_copy + 1; // skip the initial "/"
-    return remove_method_from_tree(remaining, name, &o2_context->path_tree);
+    rslt = remove_method_from_tree(slash + 1, name, (hash_node_ptr) node);
+  done:
+    O2_FREE(path_copy);
+    return rslt;
 }
 
 // ORGANIZATION FOR OSC_TCP_CLIENT (service delegated to OSC over TCP)
@@ -1440,8 +1775,22 @@ int o2_info_remove(o2n_info_ptr info)
                info->tag == INFO_OSC_TCP_CONNECTING ||
                info->tag == INFO_OSC_TCP_CONNECTION ||
                info->tag == INFO_OSC_TCP_CLIENT) {
+        if ((info->tag == INFO_OSC_TCP_CONNECTING ||
+             info->tag == INFO_OSC_TCP_CLIENT) && info->osc.service_name) {
+            // the delegated service must not keep a pointer to info
+            services_entry_ptr services;
+            o2_node_ptr entry = o2_service_find(info->osc.service_name,
+                                                &services);
+            if (entry && entry->tag == NODE_OSC_REMOTE_SERVICE &&
+                ((osc_info_ptr) entry)->tcp_socket_info == info) {
+                ((osc_info_ptr) entry)->tcp_socket_info = NULL;
+            }
+        }
         // TODO: Does EVERY one of these cases have an osc.service.name?
         O2_FREE(info->osc.service_name);
+    } else if (info->tag == INFO_UNIX_SERVER ||
+               info->tag == INFO_SHM_DOORBELL) {
+        ; // nothing to free
     } else {
         printf("o2_info_remove no special handling?\n");
     }
@@ -1454,12 +1803,8 @@ int o2_info_remove(o2n_info_ptr info)
         O2_FREE((void *) info->proc.name);
         info->proc.name = NULL;
     }
-    if (info->in_message) O2_FREE(info->in_message);
-    while (info->out_message) {
-        o2_message_ptr p = info->out_message;
-        info->out_message = p->next;
-        O2_FREE(p);
-    }
+    if (info->in_message) o2_message_free(info->in_message);
+    o2n_free_out_messages(info);
     info->net_tag = NET_INFO_REMOVED;
     // continue: now that services are freed, we can remove the
     // socket and actually free info:
@@ -1510,19 +1855,21 @@ static hash_node_ptr tree_insert_node(hash_node_ptr node, o2string key)
 //
 static int entry_remove(hash_node_ptr node, o2_node_ptr *child, int resize)
 {
+    if (node->frozen) thaw_table(node);
     node->num_children--;
     o2_node_ptr entry = *child;
-    *child = entry->next;
+    hash_slot_ptr slot = (hash_slot_ptr) child;
+    slot->entry = NULL;
+    slot->hash = SLOT_DELETED;
+    node->num_deleted++;
     entry_free(entry);
     // if the table is too big, rehash to smaller table
-    if (resize && (node->num_children * 3 < node->children.length) &&
+    if (resize && (node->num_children * 6 < node->children.length) &&
         (node->num_children > 3)) {
-        // suppose we jumped to 12 locations when we got up to 8 entries.
-        // when we go back down to 4 entries, we still allow 12, but when
-        // we are one less, 3 entries, we want to cut the size in half.
-        // Therefore the math is (3 + 1) * 3 / 2 = 6, which is half of 12.
-        // We do not make table size less than 3.
-        return resize_table(node, ((node->num_children + 1) * 3) / 2);
+        // the table grows to 3 times the entries (rounded up to a power
+        // of 2) when it is 2/3 full, so at 1/6 full, half the size
+        // still leaves room for the entries to double.
+        return resize_table(node, node->num_children * 3);
     }
     return O2_SUCCESS;
 }
@@ -1551,13 +1898,13 @@ static int remove_method_from_tree(char *remaining, char *name,
             return O2_FAIL;
         }
         // *entry addresses a node entry
-        node = (hash_node_ptr) *entry_ptr;
-        remove_method_from_tree(slash + 1, name, node);
-        if (node->num_children == 0) {
+        hash_node_ptr child = (hash_node_ptr) *entry_ptr;
+        int rslt = remove_method_from_tree(slash + 1, name, child);
+        if (child->num_children == 0) {
             // remove the empty table
             return entry_remove(node, entry_ptr, TRUE);
         }
-        return O2_SUCCESS;
+        return rslt;
     }
     // now table is where we find the final path name with the handler
     // remaining points to the final segment of the path
@@ -1678,6 +2025,8 @@ static int resize_table(hash_node_ptr node, int new_locs)
     // now, old array is in old, node->children is newly allocated
     // copy all entries from old to nde->children
     assert(node->children.array != NULL);
+    node->num_children = 0;
+    node->num_deleted = 0;
     enumerate enumerator;
     o2_enumerate_begin(&enumerator, &old);
     o2_node_ptr entry;
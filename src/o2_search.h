@@ -29,23 +29,67 @@ extern "C" {
 typedef struct o2_node { // "subclass" of o2_info
     int tag;
     o2string key; // key is "owned" by this generic entry struct
-    struct o2_node *next;
+    struct o2_node *next; // (not used by hash tables, which do not chain)
 } o2_node, *o2_node_ptr;
 
 
+// a location in a hash table. Tables use open addressing with linear
+// probing, and the hash of each entry's key is stored with the entry
+// so that most probes are rejected without reading the key.
+typedef struct hash_slot {
+    o2_node_ptr entry; // must be first: o2_lookup() returns &slot->entry
+    uint32_t hash;     // hash of entry->key, or if entry is NULL,
+                       // SLOT_EMPTY or SLOT_DELETED
+} hash_slot, *hash_slot_ptr;
+
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 1 // the entry was removed: keep probing
+
+
+// a read-only copy of a hash table made by o2_dispatch_freeze(). The
+// keys have a perfect hash: each key's bucket gives a displacement that
+// leads to the only slot where the key can be, so a lookup takes one
+// hash and at most one key compare.
+typedef struct frozen_table {
+    uint64_t seed;      // seed for frozen_hash()
+    uint32_t mask;      // number of slots - 1 (a power of 2 - 1)
+    int shift;          // 64 - log2(number of buckets)
+    dyn_array displace; // displacement (uint32_t) for each bucket
+    dyn_array slots;    // hash_slot, where hash is the low 32 bits of
+                        // the entry's frozen_hash()
+} frozen_table, *frozen_table_ptr;
+
+
 // Hash table's entry for node, another hash table
 typedef struct hash_node { // "subclass" of o2_node
     int tag; // must be NODE_HASH
     o2string key; // key is "owned" by this hash_node struct
     o2_node_ptr next;
     int num_children;
-    dyn_array children; // children is a dynamic array of o2_node_ptr.
+    int num_deleted; // number of SLOT_DELETED slots in children
+    dyn_array children; // children is a dynamic array of hash_slot,
+    // and its length is a power of 2.
+    frozen_table_ptr frozen; // NULL unless frozen by o2_dispatch_freeze(),
+    // freed by any change to children.
     // At the top level, all children are services_entry_ptrs (tag
     // NODE_SERVICES). Below that level children can have tags NODE_HASH
     // or NODE_HANDLER.
 } hash_node, *hash_node_ptr;
 
 
+// a handler caches decode plans for this many message type strings
+#define HANDLER_PLANS 4
+
+typedef struct o2_decode_plan *o2_decode_plan_ptr;
+
+// for handlers added by o2_method_new_struct(): messages are decoded into
+// buffer, which is passed to the handler (an o2_struct_handler)
+typedef struct o2_struct_info {
+    char *buffer;    // struct_size bytes following offsets (aligned)
+    int struct_size;
+    int offsets[1];  // actual size is the length of the type string
+} o2_struct_info, *o2_struct_info_ptr;
+
 // Hash table's entry for handler
 typedef struct handler_entry { // "subclass" of o2_node
     int tag; // must be NODE_HANDLER
@@ -64,9 +108,40 @@ typedef struct handler_entry { // "subclass" of o2_node
                        ///<   to copies of type-coerced data as needed
                        ///<   (coerce_flag is only set if parse_args is true.)
     int parse_args;    ///< boolean - send argc and argv to handler?
+    ///< decode plans for the most recent message type strings (only
+    ///<   used when type_string and parse_args are set)
+    o2_decode_plan_ptr plans[HANDLER_PLANS];
+    int next_plan;     ///< index of the plan to replace next
+    o2_struct_info_ptr struct_info; ///< NULL unless o2_method_new_struct()
 } handler_entry, *handler_entry_ptr;
 
 
+// number of pattern addresses whose handlers are cached per service
+#define DISPATCH_CACHE_SIZE 16
+
+// the handlers that match a pattern address, in the order that
+// find_and_call_handlers_rec() finds them
+typedef struct dispatch_result {
+    char *address;      // the address after "/service/"
+    uint32_t hash;      // hash of address
+    int cached;         // TRUE while in dispatch_cache.results
+    int busy;           // number of dispatches calling the handlers
+    int64_t last_used;  // dispatch_cache.clock when last found
+    dyn_array handlers; // handler_entry_ptr's
+} dispatch_result, *dispatch_result_ptr;
+
+// results of dispatching pattern addresses to a local service, with
+// least-recently-used replacement. Results are valid while generation
+// == o2_handlers_generation.
+typedef struct dispatch_cache {
+    int generation;
+    int64_t clock;   // counts lookups, to find the least recently used
+    int64_t hits;
+    int64_t misses;
+    dyn_array results; // dispatch_result_ptr's (DISPATCH_CACHE_SIZE max)
+} dispatch_cache, *dispatch_cache_ptr;
+
+
 typedef struct services_entry { // "subclass" of o2_node
     int tag; // must be NODE_SERVICES
     o2string key; // key (service name) is "owned" by this struct
@@ -84,6 +159,8 @@ typedef struct services_entry { // "subclass" of o2_node
     dyn_array taps; // the "taps" on this service -- these are of type
             // service_tap and indicate services that should get copies
             // of messages sent to the service named by key. 
+    dispatch_cache_ptr dispatch; // NULL until a message with a pattern
+            // address is delivered to the local service
 } services_entry, *services_entry_ptr;
 
 
@@ -121,7 +198,6 @@ typedef struct osc_info {
 typedef struct enumerate {
     dyn_array_ptr dict;
     int index;
-    o2_node_ptr entry;
 } enumerate, *enumerate_ptr;
 
 
@@ -131,6 +207,9 @@ void o2_enumerate_begin(enumerate_ptr enumerator, dyn_array_ptr dict);
 o2_node_ptr o2_enumerate_next(enumerate_ptr enumerator);
 
 
+// number of compiled patterns cached in o2_context (direct-mapped)
+#define PATTERN_CACHE_SIZE 64
+
 typedef struct {
     o2_message_ptr message_freelist;
     // msg_types is used to hold type codes as message args are accumulated
@@ -158,6 +237,22 @@ typedef struct {
     dyn_array fds;      ///< pre-constructed fds parameter for poll()
     dyn_array fds_info; ///< info about sockets
 
+    // UDP messages waiting to be sent by o2n_udp_flush() (only used if
+    // o2_udp_batch() has enabled batching). Elements are o2n_udp_pending.
+    dyn_array udp_batch;
+    int udp_batch_bytes; ///< total length of messages in udp_batch
+
+    // connections with TCP messages waiting for o2n_tcp_flush() (only used
+    // if o2_tcp_deferred_send() is on). Elements are o2n_info_ptr.
+    dyn_array tcp_flush;
+
+    // connections to processes on this host that have shared memory
+    // rings (Linux only). Elements are o2n_info_ptr.
+    dyn_array shm_peers;
+
+    // compiled address patterns (see o2_pattern_find())
+    struct o2_pattern *pattern_cache[PATTERN_CACHE_SIZE];
+
 } o2_context_t, *o2_context_ptr;
 
 #define GET_PROCESS(i) (*DA_GET(o2_context->fds_info, o2n_info_ptr, (i)))
@@ -202,6 +297,10 @@ int o2_node_add(hash_node_ptr node, o2_node_ptr entry);
  */
 hash_node_ptr o2_hash_node_new(const char *key);
 
+extern int o2_services_generation;
+
+extern int o2_handlers_generation;
+
 int o2_service_provider_replace(const char *service_name,
                                 o2_node_ptr new_service);
 
@@ -271,6 +370,16 @@ hash_node_ptr o2_node_initialize(hash_node_ptr node, const char *key);
  */
 o2_node_ptr *o2_lookup(hash_node_ptr dict, o2string key);
 
+/**
+ *  Look up the key in a table that may be frozen (see o2_dispatch_freeze())
+ *
+ *  @param dict  The table that the entry is supposed to be in.
+ *  @param key   The key, aligned and padded as for o2_lookup().
+ *
+ *  @return The entry, or NULL if not found.
+ */
+o2_node_ptr o2_lookup_entry(hash_node_ptr dict, o2string key);
+
 int o2_info_remove(o2n_info_ptr info);
 
 services_entry_ptr o2_insert_new_service(o2string service_name,
@@ -25,6 +25,14 @@ static o2_message_ptr pending_head = NULL;
 static o2_message_ptr pending_tail = NULL;
 
 
+// TRUE if messages are waiting to be delivered by o2_deliver_pending()
+//
+int o2_messages_pending(void)
+{
+    return pending_head != NULL;
+}
+
+
 void o2_deliver_pending()
 {
     while (pending_head) {
@@ -119,7 +127,11 @@ o2_node_ptr o2_msg_service(o2_msg_data_ptr msg, services_entry_ptr *services)
  */
 o2_node_ptr o2_service_find(const char *service_name, services_entry_ptr *services)
 {
-    *services = *o2_services_find(service_name);
+    // like o2_services_find(), but the path_tree may be frozen
+    char key[NAME_BUF_LEN];
+    o2_string_pad(key, service_name);
+    *services = (services_entry_ptr)
+            o2_lookup_entry(&o2_context->path_tree, key);
     if (!*services)
         return NULL;
     assert((*services)->services.length > 0);
@@ -127,6 +139,58 @@ o2_node_ptr o2_service_find(const char *service_name, services_entry_ptr *servic
 }
 
 
+// find the service for a message to path without building the
+// message (see o2_msg_service())
+//
+static o2_node_ptr path_service(const char *path,
+                                services_entry_ptr *services)
+{
+    char name[NAME_BUF_LEN];
+    if (!path[0]) return NULL;
+    const char *slash = strchr(path + 1, '/');
+    size_t len = (slash ? (size_t) (slash - (path + 1)) : strlen(path + 1));
+    if (len >= NAME_BUF_LEN) {
+        len = NAME_BUF_LEN - 1;
+    }
+    memcpy(name, path + 1, len);
+    name[len] = 0;
+    o2_node_ptr rslt = o2_service_find(name, services);
+    if (rslt && rslt->tag == INFO_TCP_SERVER) { // IP:PORT is an alias for _o2
+        rslt = o2_service_find("_o2", services);
+    }
+    return rslt;
+}
+
+
+static int message_send_to(o2_message_ptr msg, int schedulable,
+                           o2_node_ptr service, services_entry_ptr services);
+
+
+// should a message for service be built in network byte order? Only
+// if service is remote and the message will be swapped anyway: UDP
+// is always in network order, but TCP and shared memory messages to a
+// process with our byte order are sent in host order (see o2n_enqueue())
+//
+static int build_net_order(o2_node_ptr service, int tcp_flag)
+{
+#if IS_LITTLE_ENDIAN
+    if (!service || !TAG_IS_REMOTE(service->tag)) return FALSE;
+#ifndef O2_NO_DEBUGGING
+    // debugging messages print the message before it is sent
+    if (o2_debug & (O2_DBs_FLAG | O2_DBS_FLAG)) return FALSE;
+#endif
+    o2n_info_ptr proc = (o2n_info_ptr) service;
+    if (proc->proc.byte_order != 'l') return TRUE;
+#ifdef __linux__
+    if (o2n_shm_ready(proc)) return FALSE;
+#endif
+    return !tcp_flag;
+#else
+    return FALSE;
+#endif
+}
+
+
 // This function is invoked by macros o2_send and o2_send_cmd.
 // It expects arguments to end with O2_MARKER_A and O2_MARKER_B
 int o2_send_marker(const char *path, double time, int tcp_flag, const char *typestring, ...)
@@ -134,9 +198,16 @@ int o2_send_marker(const char *path, double time, int tcp_flag, const char *type
     va_list ap;
     va_start(ap, typestring);
 
+    // find the service first: if it is remote, the message can be
+    // built in network byte order so that it is not swapped later
+    services_entry_ptr services;
+    o2_node_ptr service = path_service(path, &services);
     o2_message_ptr msg;
     int rslt = o2_message_build(&msg, time, NULL, path, typestring, tcp_flag,
-                                ap);
+                                build_net_order(service, tcp_flag), ap);
+    if (rslt != O2_SUCCESS) {
+        return rslt; // could not allocate a message!
+    }
 #ifndef O2_NO_DEBUGGING
     if (o2_debug & // either non-system (s) or system (S) mask
         (msg->data.address[1] != '_' && !isdigit(msg->data.address[1]) ?
@@ -146,12 +217,43 @@ int o2_send_marker(const char *path, double time, int tcp_flag, const char *type
         printf("\n");
     }
 #endif
+    return message_send_to(msg, TRUE, service, services);
+}
+
+
+// This function is invoked by macro o2_template_send.
+// It expects arguments to end with O2_MARKER_A and O2_MARKER_B
+int o2_template_send_marker(o2_template_ptr tpl, double time, ...)
+{
+    va_list ap;
+    va_start(ap, time);
+
+    // the service is only looked up again if services have changed
+    if (tpl->generation != o2_services_generation) {
+        tpl->service = path_service(tpl->header, &tpl->services);
+        tpl->generation = o2_services_generation;
+    }
+    o2_node_ptr service = tpl->service;
+    o2_message_ptr msg;
+    int rslt = o2_template_build(&msg, tpl, time,
+                                 build_net_order(service, tpl->tcp_flag), ap);
+    va_end(ap);
     if (rslt != O2_SUCCESS) {
-        return rslt; // could not allocate a message!
+        return rslt;
     }
-    return o2_message_send_sched(msg, TRUE);
+#ifndef O2_NO_DEBUGGING
+    if (o2_debug &
+        (msg->data.address[1] != '_' && !isdigit(msg->data.address[1]) ?
+         O2_DBs_FLAG : O2_DBS_FLAG)) {
+        printf("O2: sending%s ", (tpl->tcp_flag ? " cmd" : ""));
+        o2_msg_data_print(&(msg->data));
+        printf("\n");
+    }
+#endif
+    return message_send_to(msg, TRUE, service, tpl->services);
 }
 
+
 // This is the externally visible message send function.
 //
 int o2_message_send(o2_message_ptr msg)
@@ -172,12 +274,27 @@ int o2_message_send_sched(o2_message_ptr msg, int schedulable)
     // Find the remote service, note that we skip over the leading '/':
     services_entry_ptr services;
     o2_node_ptr service = o2_msg_service(&msg->data, &services);
+    return message_send_to(msg, schedulable, service, services);
+}
+
+
+// send msg to service, which was found by o2_msg_service()
+//
+static int message_send_to(o2_message_ptr msg, int schedulable,
+                           o2_node_ptr service, services_entry_ptr services)
+{
     if (!service) {
         o2_message_free(msg);
         return O2_FAIL;
     } else if (TAG_IS_REMOTE(service->tag)) { // remote delivery, UDP or TCP
         return o2_send_remote(msg, (o2n_info_ptr) service);
-    } else if (service->tag == NODE_BRIDGE_SERVICE) {
+    }
+    // only the TCP send queue can use a view; everything else needs a
+    // contiguous message, but a shared message is fine for reading
+    if (msg->flags & O2_MSG_VIEW) {
+        msg = o2_message_unshare(msg);
+    }
+    if (service->tag == NODE_BRIDGE_SERVICE) {
         bridge_entry_ptr info = (bridge_entry_ptr) service;
         (*(info->bridge_send))(&msg->data, msg->tcp_flag, info);
         o2_message_free(msg);
@@ -187,8 +304,10 @@ int o2_message_send_sched(o2_message_ptr msg, int schedulable)
         if (!schedulable || IS_BUNDLE(&msg->data) ||
              msg->data.timestamp == 0.0 ||
              msg->data.timestamp <= o2_gtsched.last_time) {
-            o2_send_osc((osc_info_ptr) service, &msg->data, services);
+            int rslt = o2_send_osc((osc_info_ptr) service, &msg->data,
+                                   services);
             o2_message_free(msg);
+            return rslt;
         } else {
             return o2_schedule(&o2_gtsched, msg); // delivery on time
         }
@@ -196,6 +315,7 @@ int o2_message_send_sched(o2_message_ptr msg, int schedulable)
                msg->data.timestamp > o2_gtsched.last_time) { // local delivery
         return o2_schedule(&o2_gtsched, msg); // local delivery later
     } else if (o2_do_not_reenter) {
+        msg = o2_message_unshare(msg); // we need msg->next
         if (pending_tail) {
             pending_tail->next = msg;
             pending_tail = msg;
@@ -249,24 +369,29 @@ int o2_send_remote(o2_message_ptr msg, o2n_info_ptr proc)
 {
     // send the message to remote process
     if (msg->tcp_flag) {
-        return o2_send_by_tcp(proc, TRUE, msg);
+        return o2_send_shared_by_tcp(proc, TRUE, msg);
     } else { // send via UDP
         O2_DBs(if (msg->data.address[1] != '_' && !isdigit(msg->data.address[1]))
                    o2_dbg_msg("sending UDP", &(msg->data), "to", proc->proc.name));
         O2_DBS(if (msg->data.address[1] == '_' || isdigit(msg->data.address[1]))
                    o2_dbg_msg("sending UDP", &(msg->data), "to", proc->proc.name));
+#ifdef __linux__
+        if (o2n_shm_ready(proc)) { // shared memory is faster, and lossless
+            return o2_send_shared_by_tcp(proc, FALSE, msg);
+        }
+#endif
+        msg = o2_message_unshare(msg); // we are about to modify msg
 #if IS_LITTLE_ENDIAN
-        o2_msg_swap_endian(&(msg->data), TRUE);
+        if (!(msg->flags & O2_MSG_NET_ORDER)) {
+            o2_msg_swap_endian(&(msg->data), TRUE);
+        }
 #endif
-        int rslt = sendto(o2n_udp_send_sock, (char *) &(msg->data), msg->length,
-                          0, (struct sockaddr *) &(proc->proc.udp_sa),
-                          sizeof(proc->proc.udp_sa));
-        o2_message_free(msg);
-        if (rslt < 0) {
-            O2_DBn(printf("o2_send_remote error, port %d\n", ntohs(proc->proc.udp_sa.sin_port)));
-            perror("o2_send_remote");
-            return O2_FAIL;
+#ifdef __linux__
+        if (proc->unix_port) { // process is on this host
+            return o2n_unix_udp_send(msg, proc);
         }
+#endif
+        return o2n_udp_send(msg, &(proc->proc.udp_sa));
     }
     return O2_SUCCESS;
 }
@@ -420,10 +545,27 @@ int o2_send_message(struct pollfd *pfd, o2_message_ptr msg,
 // Note: the message is converted to network byte order.
 // This function "owns" msg. Caller should assume it has been freed
 // (although it might be saved as pending and sent/freed later.)
-int o2_send_by_tcp(o2n_info_ptr info, int block, o2_message_ptr msg)
+// Unlike o2_send_by_tcp(), msg may be shared, a view, or already in
+// network byte order.
+int o2_send_shared_by_tcp(o2n_info_ptr info, int block, o2_message_ptr msg)
 {
-    // if proc has a pending message, we must send with blocking
-    if (info->out_message && block) {
+    if (msg->refs) { // shared: the queue needs msg->next, so send a view
+        o2_message_ptr view = o2_message_view(msg, NULL);
+        o2_message_free(msg);
+        msg = view;
+    }
+    if (block && o2n_queue_high) {
+        // queue up to the high watermark instead of blocking
+        if (info->congested) {
+            O2_DBs(o2_dbg_msg("dropping TCP (queue full)", &(msg->data),
+                              "to", TAG_IS_REMOTE(info->tag) ?
+                                    info->proc.name : NULL));
+            o2_message_free(msg);
+            return O2_BLOCKED;
+        }
+    // if proc has a pending message, we must send with blocking, unless
+    // the message is only waiting for o2n_tcp_flush()
+    } else if (info->out_message && block && !info->flush_pending) {
         int rslt = o2n_send(info, TRUE);
         if (rslt != O2_SUCCESS) { // process is dead and removed
             o2_message_free(msg); // we drop the message
@@ -434,3 +576,16 @@ int o2_send_by_tcp(o2n_info_ptr info, int block, o2_message_ptr msg)
     o2n_enqueue(info, msg);
     return O2_SUCCESS;
 }
+
+
+// Send a newly built message by TCP. The message may have been built
+// without O2 functions (see test/statusserver.c), so refs and flags
+// may be garbage. A new message is not shared, and O2_MSG_POOLED is the
+// only flag that o2_message_finish() sets (o2_message_free() checks the
+// size of a pooled message as well).
+int o2_send_by_tcp(o2n_info_ptr info, int block, o2_message_ptr msg)
+{
+    msg->refs = 0;
+    msg->flags &= O2_MSG_POOLED;
+    return o2_send_shared_by_tcp(info, block, msg);
+}
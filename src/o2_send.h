@@ -17,6 +17,8 @@
 
 extern int o2_do_not_reenter;
 
+int o2_messages_pending(void);
+
 void o2_deliver_pending(void);
 
 services_entry_ptr *o2_services_find(const char *service_name);
@@ -50,4 +52,6 @@ int o2_send_remote(o2_message_ptr msg, o2n_info_ptr info);
 
 int o2_send_by_tcp(o2n_info_ptr proc, int block, o2_message_ptr msg);
 
+int o2_send_shared_by_tcp(o2n_info_ptr proc, int block, o2_message_ptr msg);
+
 #endif /* o2_send_h */
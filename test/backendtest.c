@@ -0,0 +1,145 @@
+//  backendtest.c -- test the socket event mechanism reported by
+//      o2_poll_backend() and deferred TCP sends with it
+//
+// With io_uring, o2_use_epoll() cannot select epoll(), and no epoll
+// descriptor may exist, since sockets are not registered with epoll.
+// With poll() or epoll(), o2_use_epoll() switches between them if epoll
+// is available. In every case, deferred TCP messages to an OSC service
+// delegated to a plain TCP server in this process must not be written
+// before o2_poll(), and must all arrive intact after it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#define N_MSGS 20
+#define TCP_PORT 8113
+#define OSC_I_LEN 12 // length of OSC message "/i" ",i" int
+
+#ifdef __linux__
+// count the epoll descriptors open in this process
+//
+int count_epoll_fds(void)
+{
+    int count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    assert(dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        char path[300];
+        char link[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%s", entry->d_name);
+        int len = (int) readlink(path, link, sizeof(link) - 1);
+        if (len > 0) {
+            link[len] = 0;
+            if (strstr(link, "eventpoll")) count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+#endif
+
+
+void check_backend(void)
+{
+    const char *backend = o2_poll_backend();
+    printf("o2_poll() uses %s\n", backend);
+    if (streql(backend, "io_uring")) {
+#ifndef O2_IO_URING
+        assert(FALSE); // io_uring is only used if compiled in
+#endif
+        assert(o2_use_epoll(TRUE) == O2_FAIL);
+        assert(o2_use_epoll(FALSE) == FALSE);
+        assert(streql(o2_poll_backend(), "io_uring"));
+#ifdef __linux__
+        assert(count_epoll_fds() == 0);
+#endif
+    } else {
+        o2_use_epoll(FALSE);
+        assert(streql(o2_poll_backend(), "poll"));
+        if (o2_use_epoll(TRUE) != O2_FAIL) {
+            assert(streql(o2_poll_backend(), "epoll"));
+        }
+    }
+}
+
+
+void check_deferred_send(void)
+{
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TCP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(server, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(listen(server, 1) == 0);
+    assert(o2_osc_delegate("osctcp", "127.0.0.1", TCP_PORT, TRUE) ==
+           O2_SUCCESS);
+    int sock = accept(server, NULL, NULL);
+    assert(sock >= 0);
+    close(server);
+    // let the connection complete
+    for (int i = 0; i < 100; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+
+    o2_tcp_deferred_send(TRUE);
+    for (int i = 0; i < N_MSGS; i++) {
+        o2_send("/osctcp/i", 0, "i", i);
+    }
+    char data[N_MSGS * (4 + OSC_I_LEN)];
+    usleep(10000);
+    assert(recv(sock, data, sizeof(data), MSG_DONTWAIT) < 0); // deferred
+    o2_poll();
+    int len = 0;
+    while (len < (int) sizeof(data)) {
+        int n = (int) recv(sock, data + len, sizeof(data) - len, 0);
+        assert(n > 0);
+        len += n;
+    }
+    for (int i = 0; i < N_MSGS; i++) {
+        int32_t *msg = (int32_t *) (data + i * (4 + OSC_I_LEN));
+        assert(ntohl(msg[0]) == OSC_I_LEN);
+        assert(strcmp((char *) (msg + 1), "/i") == 0);
+        assert(ntohl(msg[3]) == i);
+    }
+    printf("%d deferred TCP messages arrived after o2_poll()\n", N_MSGS);
+    o2_tcp_deferred_send(FALSE);
+    close(sock);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: backendtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: backendtest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    check_backend();
+    check_deferred_send();
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -35,6 +35,17 @@ void service_two(o2_msg_data_ptr data, const char *types,
 }
 
 
+int tapped = 0;
+
+void tapper(o2_msg_data_ptr data, const char *types,
+            o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 1);
+    assert(argv[0]->i == 2345);
+    tapped++;
+}
+
+
 int main(int argc, const char * argv[])
 {
     o2_initialize("test");
@@ -57,13 +68,19 @@ int main(int argc, const char * argv[])
     o2_add_message(one);
     o2_add_message(two);
     o2_send_finish(0.0, "#one", TRUE);
-    // because delivery of messages in bundle is nested delivery,
-    // the nested messages are queued up. Delivery is strictly
-    // sequential. Therefore, we have to call o2_poll() to finish
-    // delivery. It's unspecified how many times you need to call
-    // o2_poll(), but once or twice should be enough. 100 to be sure!
-    for (int i = 0; i < 100 && expected != 0; i++) o2_poll();
+    // elements that are due now for local services are delivered in
+    // place from the bundle, so nothing waits for o2_poll()
     assert(expected == 0);
+
+    // a short bundle address fits in one word with its zero padding
+    o2_service_new("ab");
+    expected = 21;
+    o2_send_start();
+    o2_add_message(one);
+    o2_add_message(two);
+    o2_send_finish(0.0, "#ab", TRUE);
+    assert(expected == 0);
+    o2_service_free("ab");
     
     expected = 21;
     o2_send_start();
@@ -84,8 +101,29 @@ int main(int argc, const char * argv[])
     o2_add_message(bdl);
     o2_add_message(bdl);
     o2_send_finish(0.0, "#two", TRUE);
+    // because delivery of a nested bundle is nested delivery, the
+    // nested messages are queued up. Delivery is strictly sequential.
+    // Therefore, we have to call o2_poll() to finish delivery. It's
+    // unspecified how many times you need to call o2_poll(), but once
+    // or twice should be enough. 100 to be sure!
     for (int i = 0; i < 100 && expected != 0; i++) o2_poll();
     assert(expected == 0);
+
+    // a message to a tapped service is queued, so the element after it
+    // must be queued too rather than delivered first
+    o2_service_new("tapper");
+    o2_method_new("/tapper/i", "i", &tapper, NULL, TRUE, TRUE);
+    o2_tap("two", "tapper");
+    expected = 12;
+    o2_send_start();
+    o2_add_message(two);
+    o2_add_message(one);
+    o2_send_finish(0.0, "#one", TRUE);
+    for (int i = 0; i < 100 && (expected != 0 || tapped == 0); i++) {
+        o2_poll();
+    }
+    assert(expected == 0 && tapped == 1);
+    o2_untap("two", "tapper");
     
     o2_finish();
     printf("DONE\n");
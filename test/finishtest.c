@@ -0,0 +1,98 @@
+//  finishtest.c -- test calling o2_finish() from a message handler
+//
+// Datagrams are sent to our own UDP port from a plain socket before
+// o2_poll() is called, so they are received in one batch. The handler
+// for the first one calls o2_finish(), which frees the message pools
+// while the message being delivered and the rest of the batch are
+// still held by the receiver. None of them may be freed twice or
+// freed into a pool that no longer exists. Then O2 is initialized
+// again and the test is repeated.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#define N_MSGS 4
+#define REPS 3
+
+int received = 0;
+
+void finish_handler(o2_msg_data_ptr data, const char *types,
+                    o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argv[0]->i == 0); // no message after o2_finish()
+    received++;
+    assert(o2_finish() == O2_SUCCESS);
+}
+
+
+// build a message like o2_send("/fin/x", 0, "i", i) in network byte
+// order and send it as one datagram
+//
+void send_datagram(int sock, struct sockaddr_in *addr, int i)
+{
+    o2_send_start();
+    o2_add_int32(i);
+    o2_message_ptr msg = o2_message_finish(0.0, "/fin/x", FALSE);
+    if (!(msg->flags & O2_MSG_NET_ORDER)) {
+        o2_msg_swap_endian(&msg->data, TRUE);
+    }
+    assert(sendto(sock, (char *) &msg->data, msg->length, 0,
+                  (struct sockaddr *) addr, sizeof(*addr)) == msg->length);
+    o2_message_free(msg);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: finishtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: finishtest ignoring extra command line argments\n");
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(sock >= 0);
+    for (int rep = 0; rep < REPS; rep++) {
+        o2_initialize("test");
+        o2_service_new("fin");
+        o2_method_new("/fin/x", "i", &finish_handler, NULL, FALSE, TRUE);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((int) o2_context->info->proc.udp_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int i = 0; i < N_MSGS; i++) {
+            send_datagram(sock, &addr, i);
+        }
+        usleep(10000); // let the datagrams arrive
+
+        received = 0;
+        for (int polls = 0; received == 0 && polls < 1000; polls++) {
+            o2_poll();
+            if (received == 0) usleep(1000);
+        }
+        assert(received == 1);
+        assert(o2_finish() == O2_NOT_INITIALIZED); // already finished
+        printf("handler called o2_finish() with %d messages left\n",
+               N_MSGS - 1);
+    }
+    close(sock);
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,178 @@
+//  hostordertest.c -- test TCP messages between processes that know
+//      each other's byte order
+//
+// The test forks a child that acts like an O2 process that does not
+// know about byte orders: it has no handler for /_o2/bo, so it never
+// learns the parent's byte order and sends in network order. The child
+// does not broadcast, so it must discover the parent from the parent's
+// own /_o2/dy broadcast, which it handles with the "ssiii" type string
+// and no coercion, as such a process does. The parent learns the
+// child's byte order from /_o2/bo, so it sends in host order. Messages
+// with every kind of argument are sent both ways by TCP and must arrive
+// intact. The child reports what it received and the byte order it
+// recorded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_send.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define N_MSGS 10
+
+int received = 0;
+int done = FALSE;
+int child_count = 0;
+int child_order = 0;
+int child_bo_count = 0;
+int bo_count = 0;
+o2_blob_ptr blob = NULL;
+
+void all_handler(o2_msg_data_ptr data, const char *types,
+                 o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 6);
+    assert(argv[0]->i == received);
+    assert(argv[1]->h == ((int64_t) 1 << 40) + received);
+    assert(argv[2]->f == 1.5F);
+    assert(argv[3]->d == 2.25 * received);
+    assert(strcmp(argv[4]->s, "host order") == 0);
+    assert(argv[5]->b.size == blob->size);
+    assert(memcmp(argv[5]->b.data, blob->data, blob->size) == 0);
+    received++;
+}
+
+
+// the child reports how many messages it received, the byte order it
+// recorded for the parent, and how many /_o2/bo messages it ignored
+void done_handler(o2_msg_data_ptr data, const char *types,
+                  o2_arg_ptr *argv, int argc, void *user_data)
+{
+    child_count = argv[0]->i;
+    child_order = argv[1]->c;
+    child_bo_count = argv[2]->i;
+    done = TRUE;
+}
+
+
+// replaces the /_o2/bo handler in the child: a process without the
+// handler drops the message
+void ignore_bo_handler(o2_msg_data_ptr data, const char *types,
+                       o2_arg_ptr *argv, int argc, void *user_data)
+{
+    bo_count++;
+}
+
+
+void send_all(const char *address)
+{
+    for (int i = 0; i < N_MSGS; i++) {
+        o2_send_cmd(address, 0.0, "ihfdsb", i, ((int64_t) 1 << 40) + i,
+                    1.5, 2.25 * i, "host order", blob);
+    }
+}
+
+
+// poll until the status of service is at least O2_REMOTE_NOTIME
+int wait_for_service(const char *service)
+{
+    for (int i = 0; i < 5000; i++) {
+        if (o2_status(service) >= O2_REMOTE_NOTIME) return TRUE;
+        o2_poll();
+        usleep(1000);
+    }
+    return FALSE;
+}
+
+
+int poll_until(int *flag, int n)
+{
+    for (int i = 0; i < 5000 && *flag < n; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+    return *flag >= n;
+}
+
+
+void child()
+{
+    o2_initialize("test");
+    o2_hub(NULL, 0); // no broadcasts: we must discover the parent
+    o2_method_new("/_o2/bo", NULL, &ignore_bo_handler, NULL, FALSE, FALSE);
+    o2_service_new("child");
+    o2_method_new("/child/all", "ihfdsb", &all_handler, NULL, FALSE, TRUE);
+    assert(wait_for_service("parent"));
+    send_all("/parent/all");
+    assert(poll_until(&received, N_MSGS));
+    services_entry_ptr services;
+    o2n_info_ptr parent = (o2n_info_ptr) o2_service_find("parent", &services);
+    o2_send_cmd("/parent/done", 0.0, "ici", received,
+                TAG_IS_REMOTE(parent->tag) ? parent->proc.byte_order : 0,
+                bo_count);
+    for (int i = 0; i < 500; i++) { // let the parent receive and close
+        o2_poll();
+        usleep(1000);
+    }
+    o2_finish();
+    _exit(0);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: hostordertest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: hostordertest ignoring extra command line argments\n");
+    }
+    blob = o2_blob_new(1000);
+    blob->size = 1000;
+    for (int i = 0; i < 1000; i++) blob->data[i] = (char) i;
+
+    fflush(stdout); // do not print it again from the child
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        child();
+    }
+
+    o2_initialize("test");
+    o2_set_discovery_period(0.1); // the child waits for our broadcast
+    o2_service_new("parent");
+    o2_method_new("/parent/all", "ihfdsb", &all_handler, NULL, FALSE, TRUE);
+    o2_method_new("/parent/done", "ici", &done_handler, NULL, FALSE, TRUE);
+    assert(wait_for_service("child"));
+    services_entry_ptr services;
+    o2n_info_ptr child = (o2n_info_ptr) o2_service_find("child", &services);
+    assert(TAG_IS_REMOTE(child->tag));
+    printf("discovered by child %s\n", child->proc.name);
+    send_all("/child/all");
+    assert(poll_until(&received, N_MSGS));
+    assert(poll_until(&done, TRUE));
+    printf("parent received %d, child received %d, child ignored %d "
+           "/_o2/bo, parent recorded byte order '%c'\n", received,
+           child_count, child_bo_count, child->proc.byte_order);
+    assert(child_count == N_MSGS);
+    assert(child_bo_count == 1 && child_order == 0);
+    assert(child->proc.byte_order == (IS_LITTLE_ENDIAN ? 'l' : 'b'));
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    O2_FREE(blob);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+// lookupbenchmk.c -- performance test for path tree hash tables
+//
+// A service is given 10, 1000 or 100000 handlers, all in the root
+// node of its path tree. o2_lookup() is timed with the key of every
+// handler (hits) and with keys that are not in the table (misses),
+// and o2_send() is timed delivering messages to all the handlers.
+// Enumeration is checked to visit every handler once. Then full paths
+// ("!service/h1") are timed before and after o2_dispatch_freeze(), and
+// adding a method is checked to thaw the frozen tables. Last, o2_send()
+// is timed with deep addresses like "/mixer/bus/3/eq/band/2/gain".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_send.h"
+#include "assert.h"
+
+#define TOTAL_LOOKUPS 4000000
+#define DEEP_SENDS 400000
+#define KEY_LEN 16
+
+int calls = 0;
+
+
+void count_handler(o2_msg_data_ptr msg, const char *types,
+                   o2_arg_ptr *argv, int argc, void *user_data)
+{
+    calls++;
+}
+
+
+// time o2_lookup_entry() on the full path of every handler (and on
+// paths with no handler), returning ns per lookup
+//
+double time_full_paths(int n, const char **addresses, const char **misses)
+{
+    hash_node_ptr table = &o2_context->full_path_table;
+    int reps = TOTAL_LOOKUPS / n;
+    int found = 0;
+    o2_time start = o2_local_time();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            found += (o2_lookup_entry(table, addresses[i]) != NULL);
+            found -= (o2_lookup_entry(table, misses[i]) != NULL);
+        }
+    }
+    assert(found == reps * n);
+    return (o2_local_time() - start) * 1e9 / ((double) reps * n * 2);
+}
+
+
+// time o2_send() to "!service/h<i>", returning ns per message
+//
+double time_full_path_send(int n, const char **addresses)
+{
+    int reps = (TOTAL_LOOKUPS / n + 9) / 10;
+    char address[64];
+    calls = 0;
+    o2_time start = o2_local_time();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            strcpy(address, addresses[i]);
+            address[0] = '!';
+            o2_send(address, 0.0, "");
+        }
+    }
+    assert(calls == reps * n);
+    return (o2_local_time() - start) * 1e9 / ((double) reps * n);
+}
+
+
+void benchmark(int n)
+{
+    char service[32];
+    sprintf(service, "bench%d", n);
+    o2_service_new(service);
+    // keys for o2_lookup() must be aligned and padded with zeros
+    char *keys = (char *) O2_CALLOC(n, KEY_LEN);
+    char *misses = (char *) O2_CALLOC(n, KEY_LEN);
+    const char **addresses = (const char **) O2_MALLOC(n * sizeof(char *));
+    const char **miss_addresses = (const char **)
+            O2_MALLOC(n * sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        char path[64];
+        sprintf(path, "/%s/h%d", service, i);
+        assert(o2_method_new(path, NULL, &count_handler, NULL,
+                             FALSE, FALSE) == O2_SUCCESS);
+        addresses[i] = o2_heapify(path);
+        sprintf(path, "/%s/m%d", service, i);
+        miss_addresses[i] = o2_heapify(path);
+        sprintf(keys + i * KEY_LEN, "h%d", i);
+        sprintf(misses + i * KEY_LEN, "m%d", i);
+    }
+    services_entry_ptr ss = *o2_services_find(service);
+    hash_node_ptr node = (hash_node_ptr)
+            o2_proc_service_find(o2_context->info, ss);
+    assert(node && node->tag == NODE_HASH && node->num_children == n);
+
+    // every handler is found, and enumerated exactly once
+    for (int i = 0; i < n; i++) {
+        o2_node_ptr entry = *o2_lookup(node, keys + i * KEY_LEN);
+        assert(entry && streql(entry->key, keys + i * KEY_LEN));
+        assert(!*o2_lookup(node, misses + i * KEY_LEN));
+    }
+    enumerate en;
+    o2_enumerate_begin(&en, &node->children);
+    int count = 0;
+    while (o2_enumerate_next(&en)) count++;
+    assert(count == n);
+
+    int reps = TOTAL_LOOKUPS / n;
+    int found = 0;
+    o2_time start = o2_local_time();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            found += (*o2_lookup(node, keys + i * KEY_LEN) != NULL);
+        }
+    }
+    double hit_ns = (o2_local_time() - start) * 1e9 / ((double) reps * n);
+    start = o2_local_time();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            found += (*o2_lookup(node, misses + i * KEY_LEN) != NULL);
+        }
+    }
+    double miss_ns = (o2_local_time() - start) * 1e9 / ((double) reps * n);
+    assert(found == reps * n);
+
+    reps = (reps + 9) / 10; // sending is slower than lookup
+    calls = 0;
+    start = o2_local_time();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            o2_send(addresses[i], 0.0, "");
+        }
+    }
+    double send_ns = (o2_local_time() - start) * 1e9 / ((double) reps * n);
+    assert(calls == reps * n);
+    printf("%6d handlers: o2_lookup hit %6.1f ns, miss %6.1f ns, "
+           "o2_send %7.1f ns\n", n, hit_ns, miss_ns, send_ns);
+
+    // full paths, before and after freezing
+    double path_ns = time_full_paths(n, addresses, miss_addresses);
+    double path_send_ns = time_full_path_send(n, addresses);
+    assert(o2_dispatch_freeze() == O2_SUCCESS);
+    assert(o2_context->full_path_table.frozen);
+    assert(o2_context->path_tree.frozen);
+    double frozen_ns = time_full_paths(n, addresses, miss_addresses);
+    double frozen_send_ns = time_full_path_send(n, addresses);
+    printf("%6d handlers: full path lookup %6.1f ns, frozen %6.1f ns, "
+           "o2_send(\"!...\") %7.1f ns, frozen %7.1f ns\n", n,
+           path_ns, frozen_ns, path_send_ns, frozen_send_ns);
+
+    // a new method thaws the full path table; it is found either way
+    char path[64];
+    sprintf(path, "/%s/new", service);
+    assert(o2_method_new(path, NULL, &count_handler, NULL,
+                         FALSE, FALSE) == O2_SUCCESS);
+    assert(!o2_context->full_path_table.frozen);
+    assert(o2_context->path_tree.frozen);
+    o2_node_ptr *entry = o2_lookup(&o2_context->full_path_table,
+                                   addresses[n / 2]);
+    assert(o2_lookup_entry(&o2_context->full_path_table,
+                           addresses[n / 2]) == *entry);
+    assert(o2_dispatch_freeze() == O2_SUCCESS);
+    calls = 0;
+    path[0] = '!';
+    o2_send(path, 0.0, "");
+    assert(calls == 1);
+
+    for (int i = 0; i < n; i++) {
+        O2_FREE((void *) addresses[i]);
+        O2_FREE((void *) miss_addresses[i]);
+    }
+    O2_FREE(addresses);
+    O2_FREE(miss_addresses);
+    O2_FREE(misses);
+    O2_FREE(keys);
+    o2_service_free(service); // thaws path_tree and full_path_table
+    assert(!o2_context->path_tree.frozen);
+    assert(!o2_context->full_path_table.frozen);
+}
+
+
+// time o2_send() to 64 handlers at depth 7
+//
+void deep_paths()
+{
+    char path[64];
+    o2_service_new("mixer");
+    for (int i = 0; i < 64; i++) {
+        sprintf(path, "/mixer/bus/%d/eq/band/%d/gain", i / 8, i % 8);
+        assert(o2_method_new(path, NULL, &count_handler, NULL,
+                             FALSE, FALSE) == O2_SUCCESS);
+    }
+    calls = 0;
+    o2_send("/mixer/bus/3/eq/band/8/gain", 0.0, ""); // no such handler
+    o2_send("/mixer/bus/3/eq/band", 0.0, ""); // not a handler
+    assert(calls == 0);
+    o2_send("/mixer/bus/3/eq/band/2/gain", 0.0, "");
+    assert(calls == 1);
+
+    for (int frozen = 0; frozen < 2; frozen++) {
+        if (frozen) assert(o2_dispatch_freeze() == O2_SUCCESS);
+        calls = 0;
+        o2_time start = o2_local_time();
+        for (int i = 0; i < DEEP_SENDS; i++) {
+            sprintf(path, "/mixer/bus/%d/eq/band/%d/gain", (i / 8) % 8, i % 8);
+            o2_send(path, 0.0, "");
+        }
+        double send_ns = (o2_local_time() - start) * 1e9 / DEEP_SENDS;
+        assert(calls == DEEP_SENDS);
+        printf("/mixer/bus/3/eq/band/2/gain: o2_send %7.1f ns%s\n",
+               send_ns, frozen ? ", frozen" : "");
+    }
+    // a removed handler is not found by its full path
+    assert(o2_remove_method("/mixer/bus/3/eq/band/2/gain") == O2_SUCCESS);
+    calls = 0;
+    o2_send("/mixer/bus/3/eq/band/2/gain", 0.0, "");
+    assert(calls == 0);
+    o2_service_free("mixer");
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: lookupbenchmk [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: lookupbenchmk ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    benchmark(10);
+    benchmark(1000);
+    benchmark(100000);
+    deep_paths();
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,219 @@
+//  malformedtest.c -- test that malformed messages do not reach handlers
+//
+// Messages are built with o2_message_finish() and then damaged: the
+// length is cut so that arguments after a long string fall outside the
+// message, a string has no terminating zero, or a blob size is too big
+// or negative. Each damaged message is sent after a good one, so the
+// handler's decode plan already exists, and the handler must not be
+// called. Messages are sent to handlers that get argv and to handlers
+// made with o2_method_new_struct().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "o2.h"
+#include "assert.h"
+
+int sii_count = 0;
+int s_count = 0;
+int bi_count = 0;
+
+void sii_handler(o2_msg_data_ptr data, const char *types,
+                 o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 3);
+    assert(strcmp(argv[0]->s, "abcdefgh") == 0);
+    assert(argv[1]->i == 1 && argv[2]->h == 2);
+    sii_count++;
+}
+
+
+void s_handler(o2_msg_data_ptr data, const char *types,
+               o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 1);
+    assert(strcmp(argv[0]->s, "abcdefghijk") == 0);
+    s_count++;
+}
+
+
+void bi_handler(o2_msg_data_ptr data, const char *types,
+                o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 2);
+    assert(argv[0]->b.size == 8);
+    assert(memcmp(argv[0]->b.data, "blobdata", 8) == 0);
+    assert(argv[1]->i == 5);
+    bi_count++;
+}
+
+
+typedef struct {
+    const char *s;
+    int32_t i;
+    int64_t h;
+} sih_struct;
+
+int sih_offsets[] = { offsetof(sih_struct, s), offsetof(sih_struct, i),
+                      offsetof(sih_struct, h) };
+
+void sih_struct_handler(const o2_msg_data_ptr msg, const void *data,
+                        void *user_data)
+{
+    const sih_struct *sih = (const sih_struct *) data;
+    assert(strcmp(sih->s, "abcdefgh") == 0);
+    assert(sih->i == 1 && sih->h == 2);
+    sii_count++;
+}
+
+
+int s_offsets[] = { 0 };
+
+void s_struct_handler(const o2_msg_data_ptr msg, const void *data,
+                      void *user_data)
+{
+    assert(strcmp(*((const char **) data), "abcdefghijk") == 0);
+    s_count++;
+}
+
+
+typedef struct {
+    o2_blob_ptr b;
+    int32_t i;
+} bi_struct;
+
+int bi_offsets[] = { offsetof(bi_struct, b), offsetof(bi_struct, i) };
+
+void bi_struct_handler(const o2_msg_data_ptr msg, const void *data,
+                       void *user_data)
+{
+    const bi_struct *bi = (const bi_struct *) data;
+    assert(bi->b->size == 8);
+    assert(memcmp(bi->b->data, "blobdata", 8) == 0);
+    assert(bi->i == 5);
+    bi_count++;
+}
+
+
+o2_message_ptr make_sii(const char *address)
+{
+    o2_send_start();
+    o2_add_string("abcdefgh");
+    o2_add_int32(1);
+    o2_add_int32(2);
+    return o2_message_finish(0.0, address, TRUE);
+}
+
+
+o2_message_ptr make_s(const char *address)
+{
+    o2_send_start();
+    o2_add_string("abcdefghijk");
+    return o2_message_finish(0.0, address, TRUE);
+}
+
+
+o2_message_ptr make_bi(const char *address)
+{
+    o2_send_start();
+    o2_add_blob_data(8, "blobdata");
+    o2_add_int32(5);
+    return o2_message_finish(0.0, address, TRUE);
+}
+
+
+// return a pointer to the blob in a message made by make_bi()
+o2_blob_ptr bi_blob(o2_message_ptr msg)
+{
+    char *types = msg->data.address;
+    while (*types != ',') types += 4; // find the type string
+    return (o2_blob_ptr) (types + 4); // ",bi" fits in one word
+}
+
+
+// send good, then bad, then good again, and return how many times the
+// handler was called according to count
+//
+int send_bad(int *count, o2_message_ptr good, o2_message_ptr bad,
+             o2_message_ptr good2)
+{
+    int before = *count;
+    o2_message_send(good);
+    assert(*count == before + 1);
+    o2_message_send(bad);
+    o2_message_send(good2);
+    return *count - before;
+}
+
+
+// send malformed messages to the handlers at /service/sii, /service/s
+// and /service/bi
+//
+void check_handlers(const char *service)
+{
+    char sii[32], s[32], bi[32];
+    snprintf(sii, 32, "/%s/sii", service);
+    snprintf(s, 32, "/%s/s", service);
+    snprintf(bi, 32, "/%s/bi", service);
+    o2_message_ptr bad;
+
+    // the ints after a long string are cut off, but the data is at
+    // least as long as the plan expects for a 4-byte string
+    bad = make_sii(sii);
+    bad->length -= 8;
+    assert(send_bad(&sii_count, make_sii(sii), bad, make_sii(sii)) == 2);
+
+    // a string with no terminating zero inside the message
+    bad = make_s(s);
+    bad->length -= 8;
+    assert(send_bad(&s_count, make_s(s), bad, make_s(s)) == 2);
+
+    // a blob that is bigger than the message
+    bad = make_bi(bi);
+    bi_blob(bad)->size = 100;
+    assert(send_bad(&bi_count, make_bi(bi), bad, make_bi(bi)) == 2);
+
+    // a blob with a negative size
+    bad = make_bi(bi);
+    bi_blob(bad)->size = (uint32_t) -8;
+    assert(send_bad(&bi_count, make_bi(bi), bad, make_bi(bi)) == 2);
+    printf("%s handlers rejected malformed messages\n", service);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: malformedtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: malformedtest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("bad");
+    // coerce the second int to int64 so that a plan converts it
+    o2_method_new("/bad/sii", "sih", &sii_handler, NULL, TRUE, TRUE);
+    o2_method_new("/bad/s", "s", &s_handler, NULL, FALSE, TRUE);
+    o2_method_new("/bad/bi", "bi", &bi_handler, NULL, FALSE, TRUE);
+    o2_service_new("badst");
+    assert(o2_method_new_struct("/badst/sii", "sih", sih_offsets,
+                                sizeof(sih_struct), &sih_struct_handler,
+                                NULL) == O2_SUCCESS);
+    assert(o2_method_new_struct("/badst/s", "s", s_offsets,
+                                sizeof(char *), &s_struct_handler,
+                                NULL) == O2_SUCCESS);
+    assert(o2_method_new_struct("/badst/bi", "bi", bi_offsets,
+                                sizeof(bi_struct), &bi_struct_handler,
+                                NULL) == O2_SUCCESS);
+
+    check_handlers("bad");
+    check_handlers("badst");
+
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+//  msgpooltest.c -- test size-classed message pools
+//
+// Allocate and free messages of many sizes and check that freed
+// messages are reused, that o2_message_pool_stats() counts hits and
+// misses, that o2_message_pool_limit() bounds the memory held, and that
+// o2_finish() releases the pools.
+
+#include <stdio.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#define N 100
+
+o2_message_ptr msgs[2 * N];
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: msgpooltest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: msgpooltest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    int64_t hits, misses, held, hits0, misses0, held0;
+    o2_message_pool_stats(&hits0, &misses0, &held0);
+
+    // a freed message should be reused for the next message of its class
+    o2_message_ptr m = o2_alloc_size_message(100);
+    assert(m->allocated >= 100 && m->length == 0);
+    m->length = 100;
+    o2_message_free(m);
+    o2_message_ptr m2 = o2_alloc_size_message(50);
+    assert(m2 == m && m2->length == 0);
+    o2_message_free(m2);
+
+    // messages of every size should have room for their data
+    for (int size = 4; size < 70000; size = size * 3 / 2 + 4) {
+        for (int i = 0; i < N; i++) {
+            msgs[i] = o2_alloc_size_message(size);
+            assert(msgs[i]->allocated >= size);
+            memset(&msgs[i]->data, i, size);
+            msgs[i]->length = size;
+        }
+        for (int i = 0; i < N; i++) {
+            o2_message_free(msgs[i]);
+        }
+    }
+    o2_message_pool_stats(&hits, &misses, &held);
+    printf("hits %lld misses %lld bytes held %lld\n", (long long) hits,
+           (long long) misses, (long long) held);
+    assert(hits > hits0 && held > held0);
+
+    // a second pass should not need any new slabs
+    int64_t hits1 = hits, misses1 = misses, held1 = held;
+    for (int i = 0; i < N; i++) {
+        msgs[i] = o2_alloc_size_message(1000);
+    }
+    for (int i = 0; i < N; i++) {
+        o2_message_free(msgs[i]);
+    }
+    o2_message_pool_stats(&hits, &misses, &held);
+    assert(hits == hits1 + N && misses == misses1 && held == held1);
+
+    // no pool may grow beyond the limit: the pool for 1000-byte
+    // messages holds at least N but not 2 * N messages, so the
+    // rest must be allocated individually
+    assert(o2_message_pool_limit(0) == 512 * 1024);
+    for (int i = 0; i < 2 * N; i++) {
+        msgs[i] = o2_alloc_size_message(1000);
+    }
+    for (int i = 0; i < 2 * N; i++) {
+        o2_message_free(msgs[i]);
+    }
+    o2_message_pool_stats(&hits, &misses, &held);
+    assert(held == held1);
+    assert(hits >= hits1 + 2 * N && misses > misses1);
+
+    // an individual message of exactly a class size is not pooled, and
+    // freeing it must not put it into a pool
+    int class_size = MESSAGE_ALLOCATED_FROM_SIZE(4096);
+    int n = 0;
+    do {
+        msgs[n] = o2_alloc_size_message(class_size);
+        assert(n < 2 * N && msgs[n]->allocated == class_size);
+    } while (msgs[n++]->flags & O2_MSG_POOLED);
+    for (int i = 0; i < n; i++) {
+        o2_message_free(msgs[i]);
+    }
+    o2_message_pool_stats(&hits, &misses, &held);
+    assert(held == held1);
+
+    // messages too big for any pool are allocated individually
+    m = o2_alloc_size_message(100000);
+    assert(m->allocated == 100000 && !(m->flags & O2_MSG_POOLED));
+    o2_message_free(m);
+
+    o2_message_pool_limit(512 * 1024);
+    o2_finish();
+    o2_message_pool_stats(&hits, &misses, &held);
+    assert(held == 0);
+
+    // pools are refilled after o2_finish()
+    o2_initialize("test");
+    m = o2_alloc_size_message(100);
+    assert(m->flags & O2_MSG_POOLED);
+    o2_message_free(m);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,251 @@
+// patternbenchmk.c -- performance test for address patterns
+//
+// Compiled patterns (o2_pattern_compile()) are checked against the
+// pattern interpreter o2_pattern_match() on fixed and random patterns
+// (including malformed sets such as "[!", which match nothing),
+// and both are timed on a set of node names. Then messages with pattern
+// addresses are dispatched to 64 "voices", checking how many handlers
+// are called and printing the time per message. The cache of handlers
+// for pattern addresses is checked with o2_dispatch_cache_stats(), and
+// dispatch is timed with addresses that miss the cache.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_pattern.h"
+#include "assert.h"
+
+#define N_VOICES 64
+#define MATCH_REPS 20000
+#define SEND_REPS 20000
+
+typedef struct {
+    const char *pattern;
+    const char *str;
+    int match;
+} pattern_case;
+
+pattern_case cases[] = {
+    {"voice*", "voice12", TRUE}, {"voice*", "voic", FALSE},
+    {"v?ice[0-9]", "voice7", TRUE}, {"v?ice[0-9]", "voice77", FALSE},
+    {"v?ice[!0-9]", "voicex", TRUE}, {"v?ice[!0-9]", "voice3", FALSE},
+    {"[z-a]", "z", TRUE}, {"[z-a]", "m", FALSE}, {"[a-]", "-", TRUE},
+    {"{gain,pan}", "pan", TRUE}, {"{gain,pan}", "gainpan", FALSE},
+    {"{a,ab}c", "abc", TRUE}, {"x{,y}", "x", TRUE}, {"x*{,y}", "x", TRUE},
+    {"*gain", "voice1gain", TRUE}, {"*a*b", "xaybzb", TRUE},
+    {"*a*a*a*a*b", "aaaaaaaaaaaaaaaa", FALSE}, {"a[bc", "ab", FALSE},
+    {"a{b", "ab", FALSE}, {"*", "", TRUE}, {"a/b", "a", TRUE},
+    // malformed sets match nothing
+    {"[!", "a", FALSE}, {"a[!", "ab", FALSE}, {"[", "a", FALSE},
+    {"[!a", "b", FALSE}, {"[a-", "a", FALSE}, {"[!/]", "a", FALSE},
+    {"[!]", "a", TRUE}, {NULL, NULL, FALSE}};
+
+const char *names[] = {"voice0", "voice12", "voice63", "gain", "pan",
+                       "aaaaaaaaaaaaaaaa", "synth", "reverb", NULL};
+
+const char *patterns[] = {"voice*", "voice1?", "v?ice[0-9]", "{gain,pan}",
+                          "*gain", "voice{1,2,3}*", "*a*a*a*a*b", NULL};
+
+int calls = 0;
+
+
+void voice_handler(o2_msg_data_ptr msg, const char *types,
+                   o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 1 && argv[0]->f == 0.5F);
+    calls++;
+}
+
+
+// check that the compiled pattern and o2_pattern_match() agree
+//
+int check(const char *pattern, const char *str)
+{
+    o2_pattern_ptr pat = o2_pattern_compile(pattern);
+    int match = o2_pattern_matches(pat, str);
+    assert(match == o2_pattern_match(str, pattern));
+    o2_pattern_free(pat);
+    return match;
+}
+
+
+// make a random pattern or string from a small alphabet so that
+// matches are likely
+//
+void random_text(char *text, int is_pattern)
+{
+    const char *pieces[] = {"a", "b", "c", "*", "?", "[ab]", "[!a]",
+                            "[a-b]", "{a,ab}", "{,b}", "{b,a,}", "[!", "]"};
+    int n = is_pattern ? 13 : 3;
+    int len = rand() % 6;
+    text[0] = 0;
+    for (int i = 0; i < len; i++) {
+        strcat(text, pieces[rand() % n]);
+    }
+}
+
+
+void time_matchers()
+{
+    for (int p = 0; patterns[p]; p++) {
+        o2_pattern_ptr pat = o2_pattern_compile(patterns[p]);
+        int count = 0;
+        o2_time start = o2_local_time();
+        for (int r = 0; r < MATCH_REPS; r++) {
+            for (int n = 0; names[n]; n++) {
+                count += o2_pattern_match(names[n], patterns[p]);
+            }
+        }
+        o2_time direct = o2_local_time() - start;
+        start = o2_local_time();
+        for (int r = 0; r < MATCH_REPS; r++) {
+            for (int n = 0; names[n]; n++) {
+                count -= o2_pattern_matches(pat, names[n]);
+            }
+        }
+        o2_time compiled = o2_local_time() - start;
+        assert(count == 0);
+        int n_names = sizeof(names) / sizeof(names[0]) - 1;
+        printf("%-14s o2_pattern_match %7.1f ns, compiled %6.1f ns "
+               "per name\n", patterns[p],
+               direct * 1e9 / (MATCH_REPS * n_names),
+               compiled * 1e9 / (MATCH_REPS * n_names));
+        o2_pattern_free(pat);
+    }
+}
+
+
+void time_dispatch(const char *address, int expected)
+{
+    calls = 0;
+    o2_send(address, 0.0, "f", 0.5F);
+    assert(calls == expected);
+    o2_time start = o2_local_time();
+    for (int i = 0; i < SEND_REPS; i++) {
+        o2_send(address, 0.0, "f", 0.5F);
+    }
+    o2_time elapsed = o2_local_time() - start;
+    assert(calls == expected * (SEND_REPS + 1));
+    printf("dispatch %-30s %3d handlers %8.1f ns per message\n",
+           address, expected, elapsed * 1e9 / SEND_REPS);
+}
+
+
+// send address and check the number of handlers called and the change
+// in cache hits and misses
+//
+void check_cached(const char *address, int expected, int hit, int miss)
+{
+    int64_t hits, misses, hits2, misses2;
+    assert(o2_dispatch_cache_stats("synth", &hits, &misses) == O2_SUCCESS);
+    calls = 0;
+    o2_send(address, 0.0, "f", 0.5F);
+    assert(calls == expected);
+    o2_dispatch_cache_stats("synth", &hits2, &misses2);
+    assert(hits2 == hits + hit && misses2 == misses + miss);
+}
+
+
+// make addresses that match all gain handlers but differ, e.g.
+// "/synth/voice**/gain" for n == 2
+//
+void star_address(char *address, int n)
+{
+    strcpy(address, "/synth/voice");
+    while (n-- > 0) strcat(address, "*");
+    strcat(address, "/gain");
+}
+
+
+void check_cache()
+{
+    int64_t hits, misses;
+    assert(o2_dispatch_cache_stats("nosuchservice", &hits, &misses) ==
+           O2_NO_SERVICE);
+    check_cached("/synth/voice*/gai[n]", N_VOICES, 0, 1);
+    check_cached("/synth/voice*/gai[n]", N_VOICES, 1, 0);
+    check_cached("/synth/voice12/gain", 1, 0, 0); // not a pattern,
+    check_cached("/synth/voice12/gain", 1, 0, 0); // so never cached
+
+    // adding and removing methods makes cached results invalid
+    assert(o2_method_new("/synth/voice100/gain", "f", &voice_handler, NULL,
+                         FALSE, TRUE) == O2_SUCCESS);
+    check_cached("/synth/voice*/gai[n]", N_VOICES + 1, 0, 1);
+    check_cached("/synth/voice*/gai[n]", N_VOICES + 1, 1, 0);
+    assert(o2_remove_method("/synth/voice100/gain") == O2_SUCCESS);
+    assert(o2_remove_method("/synth/voice100/gain") == O2_FAIL);
+    check_cached("/synth/voice*/gai[n]", N_VOICES, 0, 1);
+    check_cached("/synth/voice100/gain", 0, 0, 0);
+
+    // the least recently used address is replaced
+    char address[64];
+    for (int i = 2; i < DISPATCH_CACHE_SIZE + 2; i++) {
+        star_address(address, i);
+        check_cached(address, N_VOICES, 0, 1);
+    }
+    check_cached("/synth/voice*/gai[n]", N_VOICES, 0, 1);
+    check_cached(address, N_VOICES, 1, 0);
+
+    // time dispatch when every address misses the cache
+    o2_time start = o2_local_time();
+    for (int i = 0; i < SEND_REPS; i++) {
+        star_address(address, 1 + i % (DISPATCH_CACHE_SIZE + 1));
+        o2_send(address, 0.0, "f", 0.5F);
+    }
+    o2_time elapsed = o2_local_time() - start;
+    o2_dispatch_cache_stats("synth", &hits, &misses);
+    printf("dispatch %-30s %3d handlers %8.1f ns per message, "
+           "cache misses\n", "/synth/voice*/gain", N_VOICES,
+           elapsed * 1e9 / SEND_REPS);
+    printf("synth dispatch cache: %lld hits, %lld misses\n",
+           (long long) hits, (long long) misses);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: patternbenchmk [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: patternbenchmk ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+
+    for (int i = 0; cases[i].pattern; i++) {
+        assert(check(cases[i].pattern, cases[i].str) == cases[i].match);
+    }
+    srand(1);
+    char pattern[64];
+    char str[64];
+    for (int i = 0; i < 100000; i++) {
+        random_text(pattern, TRUE);
+        random_text(str, FALSE);
+        check(pattern, str);
+    }
+    time_matchers();
+
+    o2_service_new("synth");
+    char path[64];
+    for (int i = 0; i < N_VOICES; i++) {
+        sprintf(path, "/synth/voice%d/gain", i);
+        o2_method_new(path, "f", &voice_handler, NULL, FALSE, TRUE);
+        sprintf(path, "/synth/voice%d/pan", i);
+        o2_method_new(path, "f", &voice_handler, NULL, FALSE, TRUE);
+    }
+    time_dispatch("/synth/voice12/gain", 1);
+    time_dispatch("/synth/voice*/gain", N_VOICES);
+    time_dispatch("/synth/voice?/pan", 10);
+    time_dispatch("/synth/voice1*/{gain,pan}", 22);
+    time_dispatch("/synth/voice[0-2]/*", 6);
+    time_dispatch("/synth/*/[!g]*", N_VOICES);
+    check_cache();
+
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+// pollbenchmk.c -- compare the cost of o2_poll() using poll() and epoll()
+//
+// This program opens 10, 100 and 1000 idle TCP connections to its own
+// O2 server port and measures the time per call to o2_poll() with each
+// socket event mechanism. With poll(), the cost grows with the number
+// of connections; with epoll(), it should stay about the same. If O2
+// uses io_uring, only io_uring is timed, since it cannot be switched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "assert.h"
+
+#ifdef WIN32
+#include "usleep.h" // special windows implementation of sleep/usleep
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#define MAX_CONN 1000
+#define N_POLLS 10000
+
+SOCKET conn[MAX_CONN];
+
+
+// connect n sockets to our own server port; o2_poll() accepts them
+//
+void open_connections(int n)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(o2_local_tcp_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int base = o2_context->fds.length;
+    for (int i = 0; i < n; i++) {
+        conn[i] = socket(AF_INET, SOCK_STREAM, 0);
+        assert(conn[i] != INVALID_SOCKET);
+        if (connect(conn[i], (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            perror("connect");
+            exit(1);
+        }
+        o2_poll(); // accept now so that the listen queue never fills
+    }
+    while (o2_context->fds.length < base + n) {
+        o2_poll();
+        usleep(1000);
+    }
+}
+
+
+void close_connections(int n)
+{
+    int base = o2_context->fds.length - n;
+    for (int i = 0; i < n; i++) {
+        closesocket(conn[i]);
+    }
+    while (o2_context->fds.length > base) {
+        o2_poll();
+        usleep(1000);
+    }
+}
+
+
+// return microseconds per o2_poll()
+//
+double time_polls()
+{
+    o2_time start = o2_local_time();
+    for (int i = 0; i < N_POLLS; i++) {
+        o2_poll();
+    }
+    return (o2_local_time() - start) * 1000000.0 / N_POLLS;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: pollbenchmk [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: pollbenchmk ignoring extra command line argments\n");
+    }
+#ifndef WIN32
+    // each connection uses 2 sockets, so make sure we can open them
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < 2 * MAX_CONN + 100) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+#endif
+    o2_initialize("test");
+    // with io_uring, sockets are not polled, so there is no choice
+    int have_uring = streql(o2_poll_backend(), "io_uring");
+    int have_epoll = !have_uring && (o2_use_epoll(TRUE) != O2_FAIL);
+    if (have_uring) {
+        printf("O2 uses io_uring, timing io_uring only\n");
+    } else if (!have_epoll) {
+        printf("epoll() is not available, timing poll() only\n");
+    }
+    int counts[] = {10, 100, 1000};
+    for (int i = 0; i < 3; i++) {
+        int n = counts[i];
+        open_connections(n);
+        printf("%4d idle connections:", n);
+        if (!have_uring) {
+            o2_use_epoll(FALSE);
+            double poll_usec = time_polls();
+            printf(" %s %7.3f us/o2_poll", o2_poll_backend(), poll_usec);
+        }
+        if (have_uring || have_epoll) {
+            o2_use_epoll(TRUE);
+            double usec = time_polls();
+            printf("%s %s %7.3f us/o2_poll", have_uring ? "" : ",",
+                   o2_poll_backend(), usec);
+        }
+        printf("\n");
+        close_connections(n);
+    }
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
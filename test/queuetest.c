@@ -0,0 +1,255 @@
+//  queuetest.c -- test TCP send queue accounting and watermarks
+//
+// This program delegates service "slow" to an OSC server over TCP. The
+// "server" is a socket in this program that does not read, so messages
+// pile up in the O2 send queue. After o2_send_queue_limits(), the queue
+// should grow to the high watermark, then o2_send_cmd() should return
+// O2_BLOCKED. Changing the limits should report changes in congestion
+// to the callback. When the server reads, the queue should drain, the
+// callback should report that the connection is no longer congested,
+// and every message that was accepted should arrive in order. Finally,
+// with deferred TCP sends, the callback sends to a second OSC server
+// ("fast") when the flush of "slow" drains it, so "fast" is added to
+// the deferred sends while they are being flushed; its message must
+// still arrive.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "assert.h"
+
+#ifdef WIN32
+#include "usleep.h" // special windows implementation of sleep/usleep
+#else
+#include <unistd.h>
+#endif
+
+#define HIGH 65536
+#define LOW 16384
+#define PORT 8118
+
+int congested_count = 0;
+int drained_count = 0;
+int send_to_fast = FALSE;
+char padding[201];
+
+
+void queue_callback(const char *process, int congested, void *user_data)
+{
+    assert(process == NULL); // an OSC connection has no process name
+    assert(user_data == (void *) padding);
+    printf("queue_callback: %s\n", congested ? "congested" : "drained");
+    if (congested) {
+        congested_count++;
+    } else {
+        drained_count++;
+        if (send_to_fast) {
+            assert(o2_send_cmd("/fast/data", 0, "i", 1234) == O2_SUCCESS);
+        }
+    }
+}
+
+
+// read whatever is available from sock and check message numbers;
+// returns the number of messages received so far
+//
+SOCKET server;
+char buffer[65536];
+int buffer_len = 0;
+int next_expected = 0;
+
+int server_read()
+{
+    int n = recv(server, buffer + buffer_len, sizeof(buffer) - buffer_len,
+                 MSG_DONTWAIT);
+    if (n <= 0) return next_expected;
+    buffer_len += n;
+    int pos = 0;
+    while (buffer_len - pos >= 4) {
+        int len = ntohl(*((int32_t *) (buffer + pos)));
+        if (buffer_len - pos < len + 4) break;
+        // OSC message is "/data" ",is" i s, so int starts after 8 + 4 bytes
+        int i = ntohl(*((int32_t *) (buffer + pos + 4 + 12)));
+        assert(i == next_expected);
+        next_expected++;
+        pos += len + 4;
+    }
+    memmove(buffer, buffer + pos, buffer_len - pos);
+    buffer_len -= pos;
+    return next_expected;
+}
+
+
+// read one message ("/data" ",i" i) from the "fast" server socket;
+// returns the int, or -1 if the message has not arrived yet
+//
+SOCKET fast_server;
+char fast_buffer[64];
+int fast_len = 0;
+
+int fast_read()
+{
+    int n = recv(fast_server, fast_buffer + fast_len,
+                 sizeof(fast_buffer) - fast_len, MSG_DONTWAIT);
+    if (n > 0) fast_len += n;
+    if (fast_len < 4) return -1;
+    int len = ntohl(*((int32_t *) fast_buffer));
+    assert(len == 16);
+    if (fast_len < len + 4) return -1;
+    return ntohl(*((int32_t *) (fast_buffer + 4 + 12)));
+}
+
+
+// make a server socket on port, using a small receive buffer if rcvbuf
+//
+SOCKET make_listener(int port, int rcvbuf)
+{
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+    int option = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char *) &option,
+               sizeof(option));
+    if (rcvbuf) {
+        setsockopt(listener, SOL_SOCKET, SO_RCVBUF, (char *) &rcvbuf,
+                   sizeof(rcvbuf));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    assert(bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(listen(listener, 1) == 0);
+    return listener;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: queuetest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: queuetest ignoring extra command line argments\n");
+    }
+    memset(padding, 'x', 200);
+
+    // make a server socket with a small receive buffer
+    SOCKET listener = make_listener(PORT, 2048);
+    SOCKET fast_listener = make_listener(PORT + 1, 0);
+
+    o2_initialize("test");
+    assert(o2_send_queue_depth("slow", NULL) == O2_FAIL);
+    assert(o2_osc_delegate("slow", "127.0.0.1", PORT, TRUE) == O2_SUCCESS);
+    server = accept(listener, NULL, NULL);
+    assert(server != INVALID_SOCKET);
+    assert(o2_osc_delegate("fast", "127.0.0.1", PORT + 1, TRUE) ==
+           O2_SUCCESS);
+    fast_server = accept(fast_listener, NULL, NULL);
+    assert(fast_server != INVALID_SOCKET);
+    for (int i = 0; i < 10; i++) { // let the connection complete
+        o2_poll();
+        usleep(1000);
+    }
+    int bytes;
+    assert(o2_send_queue_depth("slow", &bytes) == 0 && bytes == 0);
+
+    assert(o2_send_queue_limits(LOW, HIGH, NULL, NULL) == O2_BAD_ARGS);
+    assert(o2_send_queue_limits(HIGH, LOW, &queue_callback,
+                                (void *) padding) == O2_SUCCESS);
+
+    // send until blocked: this must happen before we run out of memory
+    int sent = 0;
+    int rslt;
+    while ((rslt = o2_send_cmd("/slow/data", 0, "is", sent, padding)) ==
+           O2_SUCCESS) {
+        sent++;
+        assert(sent < 1000000);
+        if (sent % 100 == 0) o2_poll();
+    }
+    assert(rslt == O2_BLOCKED);
+    int depth = o2_send_queue_depth("slow", &bytes);
+    printf("blocked after %d messages, queue has %d messages, %d bytes\n",
+           sent, depth, bytes);
+    assert(congested_count == 1 && drained_count == 0);
+    assert(depth > 0 && bytes >= HIGH);
+    assert(o2_can_send("slow") == O2_BLOCKED);
+    // still blocked:
+    assert(o2_send_cmd("/slow/data", 0, "is", sent, padding) == O2_BLOCKED);
+
+    // raising high keeps the connection congested until the queue is at
+    // or below low; raising low then tells the callback it has drained
+    assert(o2_send_queue_limits(bytes + 1, LOW, &queue_callback,
+                                (void *) padding) == O2_SUCCESS);
+    assert(congested_count == 1 && drained_count == 0);
+    assert(o2_can_send("slow") == O2_BLOCKED);
+    assert(o2_send_queue_limits(bytes + 1, bytes, &queue_callback,
+                                (void *) padding) == O2_SUCCESS);
+    assert(congested_count == 1 && drained_count == 1);
+    assert(o2_can_send("slow") == O2_SUCCESS);
+    // restoring the limits makes it congested again
+    assert(o2_send_queue_limits(HIGH, LOW, &queue_callback,
+                                (void *) padding) == O2_SUCCESS);
+    assert(congested_count == 2 && drained_count == 1);
+    assert(o2_can_send("slow") == O2_BLOCKED);
+
+    // read until the queue drains to the low watermark
+    while (drained_count == 1) {
+        server_read();
+        o2_poll();
+    }
+    depth = o2_send_queue_depth("slow", &bytes);
+    printf("drained to %d messages, %d bytes\n", depth, bytes);
+    assert(bytes <= LOW);
+    assert(o2_can_send("slow") == O2_SUCCESS);
+    assert(o2_send_cmd("/slow/data", 0, "is", sent, padding) == O2_SUCCESS);
+    sent++;
+
+    // everything that was accepted should be received
+    while (server_read() < sent) {
+        o2_poll();
+    }
+    assert(o2_send_queue_depth("slow", &bytes) == 0 && bytes == 0);
+    assert(congested_count == 2 && drained_count == 2);
+    printf("received all %d messages\n", sent);
+
+    // with deferred sends, congest "slow" with a few queued messages;
+    // the flush in o2_poll() drains it, and the callback sends to "fast"
+    // while the deferred sends are being flushed
+    assert(o2_send_queue_limits(1024, 512, &queue_callback,
+                                (void *) padding) == O2_SUCCESS);
+    o2_tcp_deferred_send(TRUE);
+    send_to_fast = TRUE;
+    while (o2_send_cmd("/slow/data", 0, "is", sent, padding) ==
+           O2_SUCCESS) {
+        sent++;
+    }
+    assert(congested_count == 3 && drained_count == 2);
+    int polls;
+    for (polls = 0; fast_read() < 0 && polls < 1000; polls++) {
+        server_read();
+        o2_poll();
+        usleep(1000);
+    }
+    assert(fast_read() == 1234);
+    assert(congested_count == 3 && drained_count == 3);
+    assert(o2_send_queue_depth("fast", &bytes) == 0 && bytes == 0);
+    printf("callback's message to fast arrived after %d polls\n", polls);
+    send_to_fast = FALSE;
+    o2_tcp_deferred_send(FALSE);
+    while (server_read() < sent) {
+        o2_poll();
+    }
+
+    o2_send_queue_limits(0, 0, NULL, NULL);
+    closesocket(fast_server);
+    closesocket(fast_listener);
+    closesocket(server);
+    closesocket(listener);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -83,6 +83,54 @@ while true; do
     runtest "proptest"
     if [ $status == -1 ]; then break; fi
 
+    runtest "pollbenchmk"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "waittest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "udprecvtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "sendwaittest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "queuetest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "msgpooltest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "structtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "viewtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "templatetest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "malformedtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "hostordertest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "tcpframetest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "unixdgramtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "backendtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "shmringtest"
+    if [ $status == -1 ]; then break; fi
+
+    runtest "finishtest"
+    if [ $status == -1 ]; then break; fi
+
     rundouble "statusserver" "SERVER DONE" "statusclient" "CLIENT DONE"
     if [ $status == -1 ]; then break; fi
 
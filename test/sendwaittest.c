@@ -0,0 +1,185 @@
+//  sendwaittest.c -- test that o2_poll_wait() sends batched UDP and
+//      deferred TCP messages before it waits
+//
+// Messages are sent outside of any handler. o2_poll_wait() must send
+// them before it blocks, otherwise they would not arrive until a later
+// call.
+//
+// UDP messages go to an OSC service delegated to our own OSC port.
+// TCP messages go to an OSC service delegated to a plain TCP server in
+// a child process, which replies with a UDP message to our O2 port
+// after it receives all of them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#define N_MSGS 10
+#define UDP_PORT 8111
+#define TCP_PORT 8112
+#define OSC_I_LEN 12 // length of OSC message "/i" ",i" int
+
+int received = 0;
+
+void osc_i_handler(o2_msg_data_ptr data, const char *types,
+                   o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argv[0]->i == received);
+    received++;
+}
+
+
+// the child reports how many TCP messages it received in order
+void tcp_count_handler(o2_msg_data_ptr data, const char *types,
+                       o2_arg_ptr *argv, int argc, void *user_data)
+{
+    received = argv[0]->i;
+}
+
+
+// wait with o2_poll_wait() until n messages have been received,
+// returning the number of calls it took
+//
+int wait_for(int n)
+{
+    int waits = 0;
+    o2_time start = o2_local_time();
+    while (received < n && o2_local_time() < start + 5) {
+        o2_poll_wait(1.0);
+        waits++;
+    }
+    return waits;
+}
+
+
+// child process: accept one connection, read N_MSGS length-prefixed
+// OSC messages, then send the count of good ones to /tcp/count at
+// udp_port as an O2 message in network byte order
+//
+void tcp_receiver(int server, int udp_port)
+{
+    int sock = accept(server, NULL, NULL);
+    assert(sock >= 0);
+    char data[N_MSGS * (4 + OSC_I_LEN)];
+    int len = 0;
+    while (len < (int) sizeof(data)) {
+        int n = (int) recv(sock, data + len, sizeof(data) - len, 0);
+        if (n <= 0) break;
+        len += n;
+    }
+    int count = 0;
+    for (int i = 0; i < len / (4 + OSC_I_LEN); i++) {
+        int32_t *msg = (int32_t *) (data + i * (4 + OSC_I_LEN));
+        if (ntohl(msg[0]) == OSC_I_LEN && !strcmp((char *) (msg + 1), "/i") &&
+            ntohl(msg[3]) == i) {
+            count++;
+        }
+    }
+    o2_send_start();
+    o2_add_int32(count);
+    o2_message_ptr msg = o2_message_finish(0.0, "/tcp/count", FALSE);
+    if (!(msg->flags & O2_MSG_NET_ORDER)) {
+        o2_msg_swap_endian(&msg->data, TRUE);
+    }
+    int reply = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(udp_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(reply, (char *) &msg->data, msg->length, 0,
+           (struct sockaddr *) &addr, sizeof(addr));
+    _exit(0);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: sendwaittest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: sendwaittest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("oscrecv");
+    o2_method_new("/oscrecv/i", "i", &osc_i_handler, NULL, FALSE, TRUE);
+    o2_service_new("tcp");
+    o2_method_new("/tcp/count", "i", &tcp_count_handler, NULL, FALSE, TRUE);
+    assert(o2_osc_port_new("oscrecv", UDP_PORT, FALSE) == O2_SUCCESS);
+    assert(o2_osc_delegate("oscudp", "localhost", UDP_PORT, FALSE) ==
+           O2_SUCCESS);
+
+    // UDP: a batch of messages is sent by one sendmmsg() before waiting
+    o2_udp_batch(100000);
+    for (int i = 0; i < N_MSGS; i++) {
+        o2_send("/oscudp/i", 0, "i", i);
+    }
+    int waits = wait_for(N_MSGS);
+    int64_t batches, messages;
+    int largest;
+    o2_udp_batch_stats(&batches, &messages, &largest);
+    printf("UDP: %d messages received after %d waits, %lld batches, "
+           "%lld messages, largest %d\n", received, waits,
+           (long long) batches, (long long) messages, largest);
+    assert(received == N_MSGS);
+    assert(waits == 1); // sent before waiting, received after waking
+    assert(messages == N_MSGS && largest == N_MSGS);
+    o2_udp_batch(0);
+
+    // TCP: deferred messages are written before waiting
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TCP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(server, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(listen(server, 1) == 0);
+    pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+        tcp_receiver(server, (int) o2_context->info->proc.udp_port);
+    }
+    close(server);
+    assert(o2_osc_delegate("osctcp", "127.0.0.1", TCP_PORT, TRUE) ==
+           O2_SUCCESS);
+    // let the connection complete
+    for (int i = 0; i < 100; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+    o2_tcp_deferred_send(TRUE);
+    received = 0;
+    for (int i = 0; i < N_MSGS; i++) {
+        o2_send("/osctcp/i", 0, "i", i);
+    }
+    waits = wait_for(N_MSGS);
+    printf("TCP: %d messages received after %d waits\n", received, waits);
+    assert(received == N_MSGS);
+    assert(waits == 1);
+    o2_tcp_deferred_send(FALSE);
+    waitpid(child, NULL, 0);
+
+    o2_osc_port_free(UDP_PORT);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
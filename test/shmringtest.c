@@ -0,0 +1,232 @@
+//  shmringtest.c -- test that a peer cannot corrupt our shared memory
+//      rings
+//
+// Processes on the same host exchange messages through rings in a
+// shared memory segment that both can write. The test forks a parent,
+// which forks a child, which connects to the parent and switches to
+// shared memory. Then the child writes a bad tail into both rings and
+// stops polling. The parent must treat the tail of the ring it reads as
+// a hangup and remove the child, and must not use the tail of the ring
+// it writes. Then a new parent and child do the same with a bad head,
+// and the parent sends to the child: the parent must treat the head of
+// the ring it writes as a hangup, and must not use the head of the ring
+// it reads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define DY_INFO 50 // O2_DY_INFO in o2_discovery.c
+// layout of the segment (see o2n_ring in o2_net.c)
+#define RING_SIZE (1 << 18)
+#define RING_HEADER 4096
+#define HEAD_OFFSET 64
+#define TAIL_OFFSET 128
+#define BAD_COUNT 0x80000000
+
+int received = 0;
+
+void x_handler(o2_msg_data_ptr data, const char *types,
+               o2_arg_ptr *argv, int argc, void *user_data)
+{
+    received++;
+}
+
+
+// poll until the status of service is at least O2_REMOTE_NOTIME
+int wait_for_service(const char *service)
+{
+    for (int i = 0; i < 5000; i++) {
+        if (o2_status(service) >= O2_REMOTE_NOTIME) return TRUE;
+        o2_poll();
+        usleep(1000);
+    }
+    return FALSE;
+}
+
+
+// poll until service is gone
+int wait_for_no_service(const char *service)
+{
+    for (int i = 0; i < 5000; i++) {
+        if (o2_status(service) < 0) return TRUE;
+        o2_poll();
+        usleep(1000);
+    }
+    return FALSE;
+}
+
+
+#ifdef __linux__
+// find our mapping of the shared memory segment
+//
+char *find_segment(void)
+{
+    FILE *maps = fopen("/proc/self/maps", "r");
+    assert(maps);
+    char line[512];
+    char *base = NULL;
+    while (fgets(line, sizeof(line), maps)) {
+        if (strstr(line, "memfd:o2-shm")) {
+            unsigned long start;
+            assert(sscanf(line, "%lx-", &start) == 1);
+            assert(!base); // only one peer
+            base = (char *) start;
+        }
+    }
+    fclose(maps);
+    return base;
+}
+
+
+// add BAD_COUNT to the count at offset in both rings of the segment
+//
+void corrupt(char *base, int offset)
+{
+    for (int i = 0; i < 2; i++) {
+        uint32_t *count = (uint32_t *)
+                (base + i * (RING_HEADER + RING_SIZE) + offset);
+        __atomic_store_n(count, *count + BAD_COUNT, __ATOMIC_SEQ_CST);
+    }
+}
+
+
+// connect to the parent, corrupt the counts at offset, tell the parent
+// whether there were rings to corrupt, and wait without polling until
+// the parent closes the pipe
+//
+void child(int pipe_out, int pipe_in, int offset)
+{
+    o2_initialize("test");
+    o2_hub(NULL, 0); // no broadcasts: the parent must find us
+    o2_service_new("child");
+    o2_method_new("/child/x", "i", &x_handler, NULL, FALSE, TRUE);
+    char address[64];
+    const char *ip;
+    int tcp;
+    o2_get_address(&ip, &tcp);
+    snprintf(address, 64, "%s %d %d", ip, tcp,
+             (int) o2_context->info->proc.udp_port);
+    write(pipe_out, address, sizeof(address));
+    assert(wait_for_service("parent"));
+    // wait for a message through the ring
+    for (int i = 0; i < 5000 && received == 0; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+    assert(received == 1);
+    char *base = find_segment();
+    if (base) {
+        corrupt(base, offset);
+    } // else shared memory is not used, e.g. with io_uring
+    write(pipe_out, base ? "c" : "n", 1);
+    char c;
+    read(pipe_in, &c, 1); // until the parent closes the pipe
+    _exit(0);
+}
+
+
+// run a child that corrupts the counts at offset; when the parent sends
+// to it if send is TRUE, the parent must remove it
+//
+void check_corrupt(int offset, int send)
+{
+    int to_parent[2], to_child[2];
+    assert(pipe(to_parent) == 0 && pipe(to_child) == 0);
+    fflush(stdout); // do not print it again from the child
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(to_parent[0]);
+        close(to_child[1]);
+        child(to_parent[1], to_child[0], offset);
+    }
+    close(to_parent[1]);
+    close(to_child[0]);
+
+    o2_initialize("test");
+    o2_hub(NULL, 0);
+    o2_service_new("parent");
+    char address[64];
+    assert(read(to_parent[0], address, sizeof(address)) == sizeof(address));
+    char ip[64];
+    int tcp, udp;
+    assert(sscanf(address, "%63s %d %d", ip, &tcp, &udp) == 3);
+    o2_send_cmd("!_o2/dy", 0.0, "ssiii", "test", ip, tcp, udp, DY_INFO);
+    assert(wait_for_service("child"));
+    // let the connection switch to shared memory before sending
+    for (int i = 0; i < 100; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+    o2_send_cmd("/child/x", 0.0, "i", 1);
+    o2_poll();
+    char c;
+    assert(read(to_parent[0], &c, 1) == 1);
+    if (c == 'c') { // the child corrupted the rings
+        if (send) {
+            o2_send_cmd("/child/x", 0.0, "i", 2);
+        }
+        assert(wait_for_no_service("child"));
+        printf("parent removed child after bad %s\n",
+               offset == HEAD_OFFSET ? "head" : "tail");
+    } else {
+        printf("shared memory is not used, skipping test\n");
+    }
+    close(to_child[1]);
+    close(to_parent[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    o2_finish();
+}
+
+
+// run check_corrupt() in a new process, so that each check starts with
+// a new O2 instance
+//
+void run_check(int offset, int send)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        check_corrupt(offset, send);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+#endif
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: shmringtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: shmringtest ignoring extra command line argments\n");
+    }
+#ifdef __linux__
+    run_check(TAIL_OFFSET, FALSE);
+    run_check(HEAD_OFFSET, TRUE);
+#else
+    printf("shared memory is only used on Linux, skipping test\n");
+#endif
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+//  structtest.c -- test o2_method_new_struct()
+//
+// Messages are sent with exactly the handler's types and with types
+// that must be coerced, and the struct fields are checked. Messages
+// that cannot be coerced must not reach the handler, and bad type
+// strings and offsets must be rejected.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "o2.h"
+#include "assert.h"
+
+typedef struct {
+    double d;
+    int32_t i;
+    float f;
+    int64_t h;
+    const char *s;
+    o2_blob_ptr b;
+    int32_t c;
+    int32_t B;
+    double t;
+} all_types;
+
+int all_offsets[] = { offsetof(all_types, i), offsetof(all_types, f),
+                      offsetof(all_types, d), offsetof(all_types, h),
+                      offsetof(all_types, s), offsetof(all_types, b),
+                      offsetof(all_types, c), offsetof(all_types, B),
+                      offsetof(all_types, t), 0 /* for T */ };
+
+int all_count = 0;
+
+void all_handler(const o2_msg_data_ptr msg, const void *data,
+                 void *user_data)
+{
+    const all_types *a = (const all_types *) data;
+    assert(user_data == &all_count);
+    assert(a->i == 3 + all_count);
+    assert(a->f == 4.5F);
+    assert(a->d == 5.25);
+    assert(a->h == ((int64_t) 1 << 40) + all_count);
+    assert(strcmp(a->s, "hello") == 0);
+    assert(a->b->size == 3 && memcmp(a->b->data, "abc", 3) == 0);
+    assert(a->c == 'x');
+    assert(a->B == (all_count & 1));
+    assert(a->t == 6.5);
+    all_count++;
+}
+
+
+typedef struct {
+    float f;
+    double d;
+    int32_t i;
+} coerced;
+
+int coerced_offsets[] = { offsetof(coerced, f), offsetof(coerced, d),
+                          offsetof(coerced, i) };
+
+int coerced_count = 0;
+double coerced_expect = 0.0;
+
+void coerced_handler(const o2_msg_data_ptr msg, const void *data,
+                     void *user_data)
+{
+    const coerced *c = (const coerced *) data;
+    assert(c->f == (float) coerced_expect);
+    assert(c->d == coerced_expect);
+    assert(c->i == (int32_t) coerced_expect);
+    coerced_count++;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: structtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: structtest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("one");
+    assert(o2_method_new_struct("/one/all", "ifdhsbcBtT", all_offsets,
+                                sizeof(all_types), &all_handler,
+                                &all_count) == O2_SUCCESS);
+    assert(o2_method_new_struct("/one/coerce", "fdi", coerced_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_SUCCESS);
+
+    // bad type strings and offsets
+    assert(o2_method_new_struct("/one/bad", "vi", coerced_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_BAD_TYPE);
+    assert(o2_method_new_struct("/one/bad", "[f]", coerced_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_BAD_TYPE);
+    int bad_offsets[] = { 0, sizeof(coerced) - 4 };
+    assert(o2_method_new_struct("/one/bad", "fd", bad_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_BAD_ARGS);
+    assert(o2_method_new_struct("/one/bad", NULL, coerced_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_BAD_ARGS);
+    assert(o2_method_new_struct("/nosuchservice/x", "f", coerced_offsets,
+                                sizeof(coerced), &coerced_handler,
+                                NULL) == O2_NO_SERVICE);
+
+    // exact types
+    o2_blob_ptr blob = o2_blob_new(3);
+    blob->size = 3;
+    memcpy(blob->data, "abc", 3);
+    for (int i = 0; i < 10; i++) {
+        o2_send("/one/all", 0.0, "ifdhsbcBtT", 3 + i, 4.5, 5.25,
+                ((int64_t) 1 << 40) + i, "hello", blob, 'x', i & 1, 6.5);
+    }
+    assert(all_count == 10);
+
+    // coerced types: the same message in every numeric type
+    const char *types[] = {"fdi", "ifd", "dhf", "hih", "iii", "ddd"};
+    for (int i = 0; i < 6; i++) {
+        coerced_expect = i * 2;
+        o2_send_start();
+        for (int j = 0; j < 3; j++) {
+            switch (types[i][j]) {
+                case 'i': o2_add_int32(i * 2); break;
+                case 'h': o2_add_int64(i * 2); break;
+                case 'f': o2_add_float(i * 2); break;
+                case 'd': o2_add_double(i * 2); break;
+            }
+        }
+        o2_send_finish(0.0, "/one/coerce", TRUE);
+    }
+    assert(coerced_count == 6);
+
+    // these cannot be coerced and are dropped
+    o2_send("/one/coerce", 0.0, "fds", 1.0, 2.0, "three");
+    o2_send("/one/coerce", 0.0, "fd", 1.0, 2.0);
+    o2_send("/one/all", 0.0, "ifdhsbcBtF", 3, 4.5, 5.25,
+            (int64_t) 1, "hello", blob, 'x', 0, 6.5);
+    assert(coerced_count == 6 && all_count == 10);
+    O2_FREE(blob);
+
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,154 @@
+// swapbenchmk.c -- performance test for byte swapping of vectors
+//
+// Messages with float and double vectors of 16 to 64K elements are
+// converted to network byte order and back with o2_msg_swap_endian().
+// The time per element is compared to an element-by-element loop like
+// the one o2_msg_swap_endian() used before it swapped whole vectors.
+// The results are checked against the loop, and so are messages with
+// runs of scalar arguments.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#define TOTAL_ELEMENTS 20000000
+
+
+// swap vector elements one at a time, choosing the size in the loop
+//
+void scalar_swap(char *data, int len, o2_type vtype)
+{
+    len /= 4;
+    if (vtype == O2_DOUBLE || vtype == O2_INT64) {
+        len /= 2;
+    }
+    for (int i = 0; i < len; i++) {
+        if (vtype == O2_INT32 || vtype == O2_FLOAT) {
+            *(int32_t *) data = swap32(*(int32_t *) data);
+            data += sizeof(int32_t);
+        } else if (vtype == O2_INT64 || vtype == O2_DOUBLE) {
+            *(int64_t *) data = swap64(*(int64_t *) data);
+            data += sizeof(int64_t);
+        }
+    }
+}
+
+
+// return a pointer to the vector data in a message with one vector
+//
+char *vector_data(o2_message_ptr msg, int *len)
+{
+    char *types = O2_MSG_TYPES(&msg->data);
+    char *data = WORD_ALIGN_PTR(types + strlen(types) + 4);
+    *len = *(int32_t *) data;
+    return data + sizeof(int32_t);
+}
+
+
+// time swapping a vector of n elements of type vtype both ways, and
+// print nanoseconds per element
+//
+void benchmark(o2_type vtype, int n)
+{
+    int size = (vtype == O2_DOUBLE ? sizeof(double) : sizeof(float));
+    char *values = (char *) O2_MALLOC(n * size);
+    for (int i = 0; i < n * size; i++) {
+        values[i] = (char) (i * 7 + 3);
+    }
+    o2_send_start();
+    o2_add_vector(vtype, n, values);
+    o2_message_ptr msg = o2_message_finish(0.0, "/test/v", TRUE);
+    int len;
+    char *data = vector_data(msg, &len);
+    assert(len == n * size);
+
+    // check the result against scalar_swap()
+    char *expected = (char *) O2_MALLOC(len);
+    memcpy(expected, data, len);
+    scalar_swap(expected, len, vtype);
+    assert(o2_msg_swap_endian(&msg->data, TRUE) == O2_SUCCESS);
+    assert(memcmp(data, expected, len) == 0);
+    assert(o2_msg_swap_endian(&msg->data, FALSE) == O2_SUCCESS);
+    data = vector_data(msg, &len);
+    assert(len == n * size && memcmp(data, values, len) == 0);
+
+    int reps = TOTAL_ELEMENTS / n;
+    o2_time start = o2_local_time();
+    for (int i = 0; i < reps; i++) {
+        scalar_swap(data, len, vtype);
+    }
+    double scalar_ns = (o2_local_time() - start) * 1e9 / ((double) reps * n);
+    start = o2_local_time();
+    for (int i = 0; i < reps; i += 2) {
+        o2_msg_swap_endian(&msg->data, TRUE);
+        o2_msg_swap_endian(&msg->data, FALSE);
+    }
+    double swap_ns = (o2_local_time() - start) * 1e9 / ((double) reps * n);
+    printf("%c vector %6d elements: element loop %6.3f ns, "
+           "o2_msg_swap_endian %6.3f ns per element\n",
+           vtype, n, scalar_ns, swap_ns);
+    O2_FREE(expected);
+    O2_FREE(values);
+    o2_message_free(msg);
+}
+
+
+// check swapping of scalar arguments, which are swapped in runs
+//
+void check_scalars()
+{
+    o2_send_start();
+    o2_add_int32(0x01020304);
+    o2_add_float(1.5F);
+    o2_add_char('c');
+    o2_add_midi(0x00904064);
+    o2_add_string("abc");
+    o2_add_double(2.5);
+    o2_add_int64(0x0102030405060708LL);
+    o2_add_time(3.5);
+    o2_add_true();
+    o2_add_int32(5);
+    o2_add_int64(6);
+    o2_message_ptr msg = o2_message_finish(1.0, "/test/s", TRUE);
+    o2_message_ptr copy = o2_alloc_size_message(msg->length);
+    memcpy(&copy->data, &msg->data, msg->length);
+    assert(o2_msg_swap_endian(&msg->data, TRUE) == O2_SUCCESS);
+    char *types = O2_MSG_TYPES(&msg->data);
+    int32_t *data = (int32_t *) WORD_ALIGN_PTR(types + strlen(types) + 4);
+    assert(data[0] == swap32(0x01020304));
+    assert(data[3] == swap32(0x00904064));
+    int64_t *h = (int64_t *) (data + 5); // after 4 ints and "abc"
+    assert(h[1] == swap64(0x0102030405060708LL));
+    assert(data[11] == swap32(5));
+    assert(*(int64_t *) (data + 12) == swap64((int64_t) 6));
+    assert(o2_msg_swap_endian(&msg->data, FALSE) == O2_SUCCESS);
+    assert(memcmp(&msg->data, &copy->data, msg->length) == 0);
+    o2_message_free(msg);
+    o2_message_free(copy);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: swapbenchmk [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: swapbenchmk ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    check_scalars();
+    for (int n = 16; n <= 65536; n *= 4) {
+        benchmark(O2_FLOAT, n);
+        benchmark(O2_DOUBLE, n);
+    }
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
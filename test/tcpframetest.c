@@ -0,0 +1,144 @@
+//  tcpframetest.c -- test receiving length-prefixed messages that are
+//      split across reads
+//
+// A plain TCP socket connects to our own O2 TCP port and writes a
+// stream of O2 messages in network byte order. First the stream is
+// written in pieces of odd sizes, with o2_poll() after each one, so
+// messages and even their lengths are split across reads. Then the
+// whole stream is written at once, so one read holds many messages.
+// Some messages are bigger than the receive buffer. Every message must
+// arrive once, in order and intact.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#define N_MSGS 40
+#define BIG_SIZE 10000 // bigger than the 4 KB receive buffer
+#define BIG_EVERY 13   // every 13th message is big
+#define STREAM_SIZE (N_MSGS * 100 + (N_MSGS / BIG_EVERY + 1) * BIG_SIZE)
+
+int received = 0;
+int bad = 0;
+
+void seq_handler(o2_msg_data_ptr data, const char *types,
+                 o2_arg_ptr *argv, int argc, void *user_data)
+{
+    if (argv[0]->i != received) bad++;
+    for (int i = 0; i < (int) argv[1]->b.size; i++) {
+        if (argv[1]->b.data[i] != (char) (i + received)) {
+            bad++;
+            break;
+        }
+    }
+    received++;
+}
+
+
+// append message i with a blob of size bytes to stream at len,
+// preceded by its length, in network byte order. Returns the new len.
+//
+int append_message(char *stream, int len, int i, int size)
+{
+    char data[BIG_SIZE];
+    for (int j = 0; j < size; j++) data[j] = (char) (j + i);
+    o2_send_start();
+    o2_add_int32(i);
+    o2_add_blob_data(size, data);
+    o2_message_ptr msg = o2_message_finish(0.0, "/frame/seq", TRUE);
+    if (!(msg->flags & O2_MSG_NET_ORDER)) {
+        o2_msg_swap_endian(&msg->data, TRUE);
+    }
+    int32_t prefix = htonl(msg->length);
+    memcpy(stream + len, &prefix, sizeof(prefix));
+    memcpy(stream + len + sizeof(prefix), &msg->data, msg->length);
+    len += sizeof(prefix) + msg->length;
+    assert(len <= STREAM_SIZE);
+    o2_message_free(msg);
+    return len;
+}
+
+
+void poll_a_little(void)
+{
+    for (int i = 0; i < 3; i++) {
+        o2_poll();
+        usleep(1000);
+    }
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: tcpframetest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: tcpframetest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("frame");
+    o2_method_new("/frame/seq", "ib", &seq_handler, NULL, FALSE, TRUE);
+
+    char *stream = (char *) malloc(STREAM_SIZE);
+    int len = 0;
+    for (int i = 0; i < N_MSGS; i++) {
+        len = append_message(stream, len, i, i % BIG_EVERY ? i : BIG_SIZE);
+    }
+
+    const char *ip;
+    int port;
+    o2_get_address(&ip, &port);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    poll_a_little(); // accept the connection
+
+    // pieces of 1, 2, 3, 5, 8, ... bytes, up to 3000, then again
+    int a = 1, b = 2;
+    for (int sent = 0; sent < len; ) {
+        int n = a < len - sent ? a : len - sent;
+        assert(send(sock, stream + sent, n, 0) == n);
+        sent += n;
+        poll_a_little();
+        int c = a + b;
+        a = b;
+        b = c > 3000 ? 1 : c;
+    }
+    for (int i = 0; i < 1000 && received < N_MSGS; i++) poll_a_little();
+    printf("received %d messages sent in pieces, %d bad\n", received, bad);
+    assert(received == N_MSGS && bad == 0);
+
+    // the whole stream at once
+    received = 0;
+    assert(send(sock, stream, len, 0) == len);
+    for (int i = 0; i < 1000 && received < N_MSGS; i++) poll_a_little();
+    printf("received %d messages sent at once, %d bad\n", received, bad);
+    assert(received == N_MSGS && bad == 0);
+
+    close(sock);
+    free(stream);
+    poll_a_little();
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+//  templatetest.c -- test o2_template_new() and o2_template_send()
+//
+// Messages sent from templates are compared byte for byte with the
+// same messages built by o2_send_start() and o2_message_finish().
+// Then services are created, removed and replaced to check that a
+// template finds the current service for its address.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+char last_msg[1024];
+int last_len = 0;
+int one_count = 0;
+int new_one_count = 0;
+int three_count = 0;
+
+
+// save a copy of every message for comparison
+void save_handler(o2_msg_data_ptr data, const char *types,
+                  o2_arg_ptr *argv, int argc, void *user_data)
+{
+    last_len = MSG_DATA_LENGTH(data);
+    assert(last_len <= sizeof(last_msg));
+    memcpy(last_msg, data, last_len);
+    if (user_data) {
+        new_one_count++;
+    } else {
+        one_count++;
+    }
+}
+
+
+void three_handler(o2_msg_data_ptr data, const char *types,
+                   o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 2);
+    assert(argv[0]->i == three_count);
+    assert(argv[1]->f == 1.5);
+    three_count++;
+}
+
+
+// check that the last message received is the same as msg
+void check_last(o2_message_ptr msg)
+{
+    assert(last_len == msg->length);
+    assert(memcmp(last_msg, &msg->data, last_len) == 0);
+    o2_message_free(msg);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: templatetest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: templatetest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("one");
+    o2_method_new("/one", NULL, &save_handler, NULL, FALSE, FALSE);
+
+    // fixed size data
+    o2_template_ptr tpl = o2_template_new("/one/fixed", "ifdhcmBt", FALSE);
+    assert(tpl);
+    for (int i = 0; i < 100; i++) {
+        assert(o2_template_send(tpl, 0.0, i, 2.5, 3.25, (int64_t) 1 << 40,
+                                'c', 0x90403f, i & 1, 12.0) == O2_SUCCESS);
+        o2_send_start();
+        o2_add_int32(i);
+        o2_add_float(2.5);
+        o2_add_double(3.25);
+        o2_add_int64((int64_t) 1 << 40);
+        o2_add_char('c');
+        o2_add_midi(0x90403f);
+        o2_add_bool(i & 1);
+        o2_add_time(12.0);
+        check_last(o2_message_finish(0.0, "/one/fixed", FALSE));
+    }
+    assert(one_count == 100);
+    o2_template_free(tpl);
+
+    // strings, blobs and type codes without data
+    o2_blob_ptr blob = o2_blob_new(7);
+    memcpy(blob->data, "abcdefg", 7);
+    tpl = o2_template_new("/one/variable/size", "sTbSNiFI", TRUE);
+    const char *strings[] = {"", "abc", "abcd", "a longer string"};
+    for (int i = 0; i < 4; i++) {
+        blob->size = i * 2 + 1;
+        assert(o2_template_send(tpl, 0.0, strings[i], blob, strings[3 - i],
+                                i) == O2_SUCCESS);
+        o2_send_start();
+        o2_add_string(strings[i]);
+        o2_add_true();
+        o2_add_blob(blob);
+        o2_add_symbol(strings[3 - i]);
+        o2_add_nil();
+        o2_add_int32(i);
+        o2_add_false();
+        o2_add_infinitum();
+        check_last(o2_message_finish(0.0, "/one/variable/size", TRUE));
+    }
+    o2_template_free(tpl);
+    O2_FREE(blob);
+
+    // no data at all
+    tpl = o2_template_new("/one/empty", NULL, FALSE);
+    assert(o2_template_send(tpl, 0.0) == O2_SUCCESS);
+    o2_send_start();
+    check_last(o2_message_finish(0.0, "/one/empty", FALSE));
+    o2_template_free(tpl);
+
+    // invalid address
+    assert(o2_template_new("one/x", "i", FALSE) == NULL);
+
+    // the service is found when it is created...
+    o2_template_ptr tpl1 = o2_template_new("/one/x", "i", FALSE);
+    o2_template_ptr tpl3 = o2_template_new("/three/x", "if", FALSE);
+    assert(o2_template_send(tpl3, 0.0, 0, 1.5) == O2_FAIL);
+    o2_service_new("three");
+    o2_method_new("/three/x", "if", &three_handler, NULL, FALSE, TRUE);
+    for (int i = 0; i < 10; i++) {
+        assert(o2_template_send(tpl3, 0.0, i, 1.5) == O2_SUCCESS);
+    }
+    assert(three_count == 10);
+
+    // ... forgotten when it is removed ...
+    assert(o2_template_send(tpl1, 0.0, 1) == O2_SUCCESS);
+    assert(one_count == 106 && new_one_count == 0);
+    o2_service_free("one");
+    assert(o2_template_send(tpl1, 0.0, 2) == O2_FAIL);
+
+    // ... and found again when it is replaced
+    o2_service_new("one");
+    o2_method_new("/one", NULL, &save_handler, (void *) tpl1, FALSE, FALSE);
+    assert(o2_template_send(tpl1, 0.0, 3) == O2_SUCCESS);
+    assert(one_count == 106 && new_one_count == 1);
+    o2_template_free(tpl1);
+    o2_template_free(tpl3);
+
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,119 @@
+//  udprecvtest.c -- test receiving batches of UDP messages
+//
+// Datagrams are sent to our own UDP port from a plain socket before
+// o2_poll() is called, so they wait in the socket. One o2_poll() should
+// receive MAX_PER_POLL of them (several batches of recvmmsg()) and the
+// next o2_poll() the rest, all in order, including messages too big to
+// fit in a preallocated message.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#define N_SMALL 100
+#define MAX_PER_POLL 64 // O2N_UDP_BATCH * O2N_UDP_MAX_BATCHES in o2_net.c
+#define BIG_SIZE 4000
+#define BIG_EVERY 15 // every 15th message is big
+
+int received = 0;
+int bad = 0;
+
+void seq_handler(o2_msg_data_ptr data, const char *types,
+                 o2_arg_ptr *argv, int argc, void *user_data)
+{
+    if (argv[0]->i != received) bad++;
+    if (argv[1]->b.size > 0) {
+        for (int i = 0; i < (int) argv[1]->b.size; i++) {
+            if (argv[1]->b.data[i] != (char) (i + received)) {
+                bad++;
+                break;
+            }
+        }
+    }
+    received++;
+}
+
+
+// build a message like o2_send("/udp/seq", 0, "ib", i, blob) in
+// network byte order and send it as one datagram
+//
+void send_datagram(int sock, struct sockaddr_in *addr, int i, int size)
+{
+    char data[BIG_SIZE];
+    for (int j = 0; j < size; j++) data[j] = (char) (j + i);
+    o2_send_start();
+    o2_add_int32(i);
+    o2_add_blob_data(size, data);
+    o2_message_ptr msg = o2_message_finish(0.0, "/udp/seq", FALSE);
+    if (!(msg->flags & O2_MSG_NET_ORDER)) {
+        o2_msg_swap_endian(&msg->data, TRUE);
+    }
+    assert(sendto(sock, (char *) &msg->data, msg->length, 0,
+                  (struct sockaddr *) addr, sizeof(*addr)) == msg->length);
+    o2_message_free(msg);
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: udprecvtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: udprecvtest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("udp");
+    o2_method_new("/udp/seq", "ib", &seq_handler, NULL, FALSE, TRUE);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((int) o2_context->info->proc.udp_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int rep = 0; rep < 3; rep++) {
+        received = 0;
+        for (int i = 0; i < N_SMALL; i++) {
+            send_datagram(sock, &addr, i, i % BIG_EVERY ? i : BIG_SIZE);
+        }
+        usleep(10000); // let the datagrams arrive
+        int polls = 0;
+        while (received < N_SMALL && polls < 1000) {
+            o2_poll();
+            polls++;
+#ifndef O2_IO_URING
+            // one poll does not read the socket until it is empty
+            if (polls == 1) assert(received == MAX_PER_POLL);
+#endif
+            if (received < N_SMALL) usleep(1000);
+        }
+        printf("received %d messages with %d calls to o2_poll\n",
+               received, polls);
+        assert(received == N_SMALL);
+        assert(bad == 0);
+#ifndef O2_IO_URING
+        assert(polls == 2); // the next poll reads the rest
+#endif
+    }
+    close(sock);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
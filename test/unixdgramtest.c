@@ -0,0 +1,137 @@
+//  unixdgramtest.c -- test that UDP messages to a process on this host
+//      are not lost when its AF_UNIX datagram socket is full
+//
+// o2n_unix_udp_send() is called with a process whose AF_UNIX datagram
+// socket is made by this test in place of another process, and whose
+// UDP address is a plain UDP socket. The sockets are not read until
+// every message has been sent. An AF_UNIX datagram socket holds only a
+// few messages, so most messages must go to the UDP socket instead.
+// Every message must arrive exactly once and in order: the first ones
+// by AF_UNIX and the rest by UDP.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "assert.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#endif
+
+#define N_MSGS 100
+#define FAKE_PORT 7 // names the AF_UNIX socket "o2-7-dg"
+
+int got[N_MSGS];
+int next_expected = 0;
+
+// read every datagram waiting on sock, check that message numbers are
+// in order, and mark them in got. Returns the number of datagrams read.
+//
+int receive_all(int sock)
+{
+    int n = 0;
+    int64_t data[32]; // the length goes in the word before the message
+    int len;
+    while ((len = (int) recv(sock, data + 1, sizeof(data) - sizeof(int64_t),
+                             MSG_DONTWAIT)) > 0) {
+        o2_msg_data_ptr msg = (o2_msg_data_ptr) (data + 1);
+        ((int32_t *) msg)[-1] = len;
+        o2_msg_swap_endian(msg, FALSE);
+        assert(strcmp(msg->address, "/x/i") == 0);
+        o2_extract_start(msg);
+        o2_arg_ptr arg = o2_get_next(O2_INT32);
+        assert(arg && arg->i >= 0 && arg->i < N_MSGS);
+        assert(arg->i == next_expected);
+        next_expected++;
+        got[arg->i]++;
+        n++;
+    }
+    return n;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: unixdgramtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: unixdgramtest ignoring extra command line argments\n");
+    }
+#ifdef __linux__
+    o2_initialize("test");
+
+    // the AF_UNIX datagram socket of the "process"
+    int unix_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    assert(unix_sock >= 0);
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    int len = snprintf(sa.sun_path + 1, sizeof(sa.sun_path) - 1,
+                       "o2-%d-dg", FAKE_PORT);
+    assert(bind(unix_sock, (struct sockaddr *) &sa,
+                offsetof(struct sockaddr_un, sun_path) + 1 + len) == 0);
+
+    // its UDP socket
+    int udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(udp_sock >= 0);
+    struct sockaddr_in udp_sa;
+    memset(&udp_sa, 0, sizeof(udp_sa));
+    udp_sa.sin_family = AF_INET;
+    udp_sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(udp_sock, (struct sockaddr *) &udp_sa, sizeof(udp_sa)) == 0);
+    socklen_t sa_len = sizeof(udp_sa);
+    assert(getsockname(udp_sock, (struct sockaddr *) &udp_sa, &sa_len) == 0);
+
+    // the process, as far as o2n_unix_udp_send() is concerned
+    o2n_info proc;
+    memset(&proc, 0, sizeof(proc));
+    proc.unix_port = FAKE_PORT;
+    proc.proc.udp_sa = udp_sa;
+
+    for (int i = 0; i < N_MSGS; i++) {
+        o2_send_start();
+        o2_add_int32(i);
+        o2_message_ptr msg = o2_message_finish(0.0, "/x/i", FALSE);
+        if (!(msg->flags & O2_MSG_NET_ORDER)) {
+            o2_msg_swap_endian(&msg->data, TRUE);
+        }
+        // as in o2_send_remote(): once o2n_unix_udp_send() falls back to
+        // UDP, it clears unix_port, and messages go by UDP from then on
+        if (proc.unix_port) {
+            assert(o2n_unix_udp_send(msg, &proc) == O2_SUCCESS);
+        } else {
+            assert(o2n_udp_send(msg, &proc.proc.udp_sa) == O2_SUCCESS);
+        }
+    }
+    usleep(10000); // let the UDP datagrams arrive
+    int by_unix = receive_all(unix_sock);
+    int by_udp = receive_all(udp_sock);
+    printf("%d messages arrived by AF_UNIX and %d by UDP\n", by_unix, by_udp);
+    for (int i = 0; i < N_MSGS; i++) {
+        assert(got[i] == 1);
+    }
+    assert(by_unix + by_udp == N_MSGS);
+    assert(by_udp > 0 && proc.unix_port == 0);
+
+    close(unix_sock);
+    close(udp_sock);
+    o2_finish();
+#else
+    printf("AF_UNIX datagrams are only used on Linux, skipping test\n");
+#endif
+    printf("DONE\n");
+    return 0;
+}
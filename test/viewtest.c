@@ -0,0 +1,208 @@
+//  viewtest.c -- test shared messages and views
+//
+// A message is sent to several local services with o2_message_ref()
+// and o2_message_view(), and a view is scheduled. Then many views and
+// shared messages are sent to an OSC-over-TCP "server" that is a
+// socket in this program. Views are written to the socket from the
+// shared message, so the server checks that every message arrives
+// complete and in order, even when sends are split by a small
+// receive buffer. Finally, a message built without O2 functions, so
+// that its refs and flags are garbage, is sent the same way.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "o2.h"
+#include "o2_internal.h"
+#include "o2_message.h"
+#include "o2_send.h"
+#include "o2_sched.h"
+#include "assert.h"
+
+#ifdef WIN32
+#include "usleep.h" // special windows implementation of sleep/usleep
+#else
+#include <unistd.h>
+#endif
+
+#define PORT 8119
+#define N 2000
+
+char padding[901];
+int one_count = 0;
+int two_count = 0;
+
+
+void service_handler(o2_msg_data_ptr data, const char *types,
+                     o2_arg_ptr *argv, int argc, void *user_data)
+{
+    assert(argc == 3);
+    assert(argv[0]->i == 1234);
+    assert(streql(argv[1]->s, padding));
+    assert(argv[2]->d == 5.5);
+    if (user_data) {
+        assert(streql(data->address, "/two/x"));
+        two_count++;
+    } else {
+        assert(streql(data->address, "/one/x"));
+        one_count++;
+    }
+}
+
+
+o2_message_ptr make_message(const char *address)
+{
+    o2_send_start();
+    o2_add_int32(1234);
+    o2_add_string(padding);
+    o2_add_double(5.5);
+    return o2_message_finish(0.0, address, TRUE);
+}
+
+
+// read whatever is available from sock and compare each message to
+// expected (which is in network byte order); returns the number of
+// messages received so far
+//
+SOCKET server;
+char buffer[65536];
+int buffer_len = 0;
+int received = 0;
+
+int server_read(o2_message_ptr expected)
+{
+    int n = recv(server, buffer + buffer_len, sizeof(buffer) - buffer_len,
+                 MSG_DONTWAIT);
+    if (n <= 0) return received;
+    buffer_len += n;
+    int pos = 0;
+    while (buffer_len - pos >= 4) {
+        int len = ntohl(*((int32_t *) (buffer + pos)));
+        if (buffer_len - pos < len + 4) break;
+        assert(len == expected->length);
+        assert(memcmp(buffer + pos + 4, &expected->data, len) == 0);
+        received++;
+        pos += len + 4;
+    }
+    memmove(buffer, buffer + pos, buffer_len - pos);
+    buffer_len -= pos;
+    return received;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: viewtest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: viewtest ignoring extra command line argments\n");
+    }
+    memset(padding, 'x', 900);
+
+    o2_initialize("test");
+    o2_service_new("one");
+    o2_service_new("two");
+    o2_method_new("/one/x", "isd", &service_handler, NULL, FALSE, TRUE);
+    o2_method_new("/two/x", "isd", &service_handler, (void *) padding,
+                  FALSE, TRUE);
+
+    // local delivery of a shared message and a view of it
+    o2_message_ptr msg = make_message("/one/x");
+    o2_message_ptr view = o2_message_view(msg, "two");
+    assert(msg->refs == 1 && view->length == msg->length);
+    o2_message_send(view);
+    assert(two_count == 1 && msg->refs == 0);
+    o2_message_send(o2_message_ref(msg));
+    assert(one_count == 1 && msg->refs == 0);
+
+    // a scheduled view is copied, so the original can be freed
+    o2_schedule(&o2_ltsched, o2_message_view(msg, "two"));
+    o2_message_free(msg);
+    while (two_count < 2) {
+        o2_poll();
+        usleep(1000);
+    }
+
+    // make a server socket with a small receive buffer
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+    int option = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char *) &option,
+               sizeof(option));
+    option = 2048;
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, (char *) &option,
+               sizeof(option));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    assert(bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(listen(listener, 1) == 0);
+
+    assert(o2_osc_delegate("osc", "127.0.0.1", PORT, TRUE) == O2_SUCCESS);
+    server = accept(listener, NULL, NULL);
+    assert(server != INVALID_SOCKET);
+    for (int i = 0; i < 10; i++) { // let the connection complete
+        o2_poll();
+        usleep(1000);
+    }
+    services_entry_ptr services;
+    osc_info_ptr osc = (osc_info_ptr) o2_service_find("osc", &services);
+    assert(osc && osc->tag == NODE_OSC_REMOTE_SERVICE);
+    o2n_info_ptr info = osc->tcp_socket_info;
+
+    // send views and shared messages; the server expects
+    // "/osc/x" in network byte order
+    msg = make_message("/one/x");
+    o2_message_ptr shared = make_message("/osc/x");
+    o2_message_ptr expected = make_message("/osc/x");
+    o2_msg_swap_endian(&expected->data, TRUE);
+    int sent = 0;
+    while (sent < N) {
+        if (sent % 3 == 0) {
+            o2_send_shared_by_tcp(info, FALSE, o2_message_view(msg, "osc"));
+        } else if (sent % 3 == 1) { // a view of a view of msg
+            o2_message_ptr v = o2_message_view(msg, "three");
+            o2_send_shared_by_tcp(info, FALSE, o2_message_view(v, "osc"));
+            o2_message_free(v);
+        } else { // the queue sends a view of a shared message
+            o2_send_shared_by_tcp(info, FALSE, o2_message_ref(shared));
+        }
+        sent++;
+        if (sent % 100 == 0) {
+            server_read(expected);
+            o2_poll();
+        }
+    }
+    o2_message_free(msg);
+    o2_message_free(shared);
+
+    // a message built without O2 functions may have any refs and flags
+    msg = make_message("/osc/x");
+    int size = MESSAGE_SIZE_FROM_ALLOCATED(msg->length);
+    o2_message_ptr built = (o2_message_ptr) O2_MALLOC(size);
+    memset(built, 0xff, size);
+    built->next = NULL;
+    built->tcp_flag = TRUE;
+    built->allocated = msg->length;
+    built->length = msg->length;
+    memcpy(&built->data, &msg->data, msg->length);
+    o2_message_free(msg);
+    o2_send_by_tcp(info, FALSE, built);
+    sent++;
+
+    while (server_read(expected) < sent) {
+        o2_poll();
+    }
+    printf("received all %d messages\n", received);
+
+    o2_message_free(expected);
+    closesocket(server);
+    closesocket(listener);
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+//  waittest.c -- test that o2_poll_wait() and o2_run() wake up for
+//      scheduled messages without busy polling
+//
+
+#include <stdio.h>
+#include "o2.h"
+#include "assert.h"
+
+int got_the_message = FALSE;
+o2_time got_time = 0;
+
+void service_tick(o2_msg_data_ptr data, const char *types,
+                  o2_arg_ptr *argv, int argc, void *user_data)
+{
+    got_the_message = TRUE;
+    got_time = o2_local_time();
+    printf("service_tick at %g, timestamp %g\n", got_time, data->timestamp);
+    if (user_data) o2_stop_flag = TRUE;
+}
+
+
+// schedule a message for /one/tick (or /one/stop) on the local scheduler
+//
+o2_time schedule_tick(const char *path, o2_time delay)
+{
+    o2_time when = o2_local_time() + delay;
+    o2_send_start();
+    o2_message_ptr m = o2_message_finish(when, path, TRUE);
+    o2_schedule(&o2_ltsched, m);
+    return when;
+}
+
+
+int main(int argc, const char * argv[])
+{
+    printf("Usage: waittest [debugflags] "
+           "(see o2.h for flags, use a for all)\n");
+    if (argc == 2) {
+        o2_debug_flags(argv[1]);
+        printf("debug flags are: %s\n", argv[1]);
+    }
+    if (argc > 2) {
+        printf("WARNING: waittest ignoring extra command line argments\n");
+    }
+    o2_initialize("test");
+    o2_service_new("one");
+    o2_method_new("/one/tick", "", &service_tick, NULL, FALSE, TRUE);
+    o2_method_new("/one/stop", "", &service_tick, (void *) "stop",
+                  FALSE, TRUE);
+
+    // wait with no timeout: we should wake up for the scheduled message
+    o2_time when = schedule_tick("/one/tick", 0.3);
+    int polls = 0;
+    while (!got_the_message) {
+        o2_poll_wait(-1);
+        polls++;
+    }
+    printf("message delivered %g late after %d calls to o2_poll_wait\n",
+           got_time - when, polls);
+    assert(got_time >= when);
+    assert(got_time < when + 0.05);
+    assert(polls < 100); // a busy loop would take many thousands of polls
+
+    // max_timeout should limit the wait when nothing is scheduled sooner
+    o2_time start = o2_local_time();
+    o2_poll_wait(0.05);
+    o2_time elapsed = o2_local_time() - start;
+    printf("o2_poll_wait(0.05) returned after %g\n", elapsed);
+    assert(elapsed < 0.1);
+
+    // o2_run(1) polls only once per second, but should wake up for the
+    // scheduled message and return when the handler stops it
+    got_the_message = FALSE;
+    when = schedule_tick("/one/stop", 0.2);
+    o2_run(1);
+    assert(got_the_message);
+    assert(got_time >= when && got_time < when + 0.05);
+
+    // o2_run(0) polls at the default rate (1000 Hz)
+    got_the_message = FALSE;
+    when = schedule_tick("/one/stop", 0.1);
+    o2_run(0);
+    assert(got_the_message);
+    assert(got_time >= when && got_time < when + 0.05);
+
+    o2_finish();
+    printf("DONE\n");
+    return 0;
+}